@@ -0,0 +1,266 @@
+#ifndef AFFINE_TRANSFORM_H
+#define AFFINE_TRANSFORM_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector> //std::vector
+#include <cstdint> //uint32_t
+#include <cstddef> //size_t
+#include <cmath> //std::asin, std::atan2
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define AFFINE_TRANSFORM_SSE 1
+#else
+#define AFFINE_TRANSFORM_SSE 0
+#endif
+
+//Affine transforms are stored as glm::mat4x3: four columns of three floats, the last row (0, 0, 0, 1) is implied.
+//48 bytes instead of the 64 of a glm::mat4. Columns 0 to 2 are the scaled axes, column 3 the translation.
+
+//Quaternion of the Euler angles (in degrees) used by Transform, applied in the Y * X * Z order
+inline glm::quat eulerDegreesToQuat(const glm::vec3& eulerRot)
+{
+	const glm::vec3 radians = glm::radians(eulerRot);
+	return glm::angleAxis(radians.y, glm::vec3(0.f, 1.f, 0.f)) * glm::angleAxis(radians.x, glm::vec3(1.f, 0.f, 0.f)) *
+		glm::angleAxis(radians.z, glm::vec3(0.f, 0.f, 1.f));
+}
+
+//Inverse of eulerDegreesToQuat. X is returned in [-90, 90], Z is zero at the gimbal lock.
+inline glm::vec3 quatToEulerDegrees(const glm::quat& rotation)
+{
+	const glm::mat3 m = glm::mat3_cast(rotation);
+	//m[column][row] of Ry * Rx * Rz: row 1 of column 2 is -sin(x)
+	const float sinX = glm::clamp(-m[2][1], -1.f, 1.f);
+	const float x = std::asin(sinX);
+	float y, z;
+	if (std::abs(sinX) < 0.9999f)
+	{
+		y = std::atan2(m[2][0], m[2][2]);
+		z = std::atan2(m[0][1], m[1][1]);
+	}
+	else
+	{
+		y = std::atan2(-m[0][2], m[0][0]);
+		z = 0.f;
+	}
+	return glm::degrees(glm::vec3(x, y, z));
+}
+
+//translation * rotation * scale without building any intermediate matrix
+inline glm::mat4x3 composeAffine(const glm::vec3& pos, const glm::quat& rotation, const glm::vec3& scale)
+{
+	const glm::mat3 r = glm::mat3_cast(rotation);
+	return glm::mat4x3(r[0] * scale.x, r[1] * scale.y, r[2] * scale.z, pos);
+}
+
+//a * b, both affine
+inline glm::mat4x3 multiplyAffine(const glm::mat4x3& a, const glm::mat4x3& b)
+{
+	const glm::mat3 linear(a[0], a[1], a[2]);
+	return glm::mat4x3(linear * b[0], linear * b[1], linear * b[2], linear * b[3] + a[3]);
+}
+
+inline glm::mat4 toMat4(const glm::mat4x3& affine)
+{
+	return glm::mat4(affine);
+}
+
+//Drops the last row of an affine glm::mat4. Not glm::mat4x3(m), which drops the translation instead.
+inline glm::mat4x3 toAffine(const glm::mat4& matrix)
+{
+	return glm::mat4x3(glm::vec3(matrix[0]), glm::vec3(matrix[1]), glm::vec3(matrix[2]), glm::vec3(matrix[3]));
+}
+
+//Translation, rotation and scale of many transforms, one array per component so four of them fill an SSE register
+struct TRSArrays
+{
+	std::vector<float> posX, posY, posZ;
+	std::vector<float> rotX, rotY, rotZ, rotW;
+	std::vector<float> scaleX, scaleY, scaleZ;
+
+	size_t size() const
+	{
+		return posX.size();
+	}
+
+	void reserve(size_t count)
+	{
+		for (std::vector<float>* component : { &posX, &posY, &posZ, &rotX, &rotY, &rotZ, &rotW, &scaleX, &scaleY, &scaleZ })
+			component->reserve(count);
+	}
+
+	void resize(size_t count)
+	{
+		for (std::vector<float>* component : { &posX, &posY, &posZ, &rotX, &rotY, &rotZ, &rotW, &scaleX, &scaleY, &scaleZ })
+			component->resize(count);
+	}
+
+	void push_back(const glm::vec3& pos, const glm::quat& rotation, const glm::vec3& scale)
+	{
+		posX.push_back(pos.x); posY.push_back(pos.y); posZ.push_back(pos.z);
+		rotX.push_back(rotation.x); rotY.push_back(rotation.y); rotZ.push_back(rotation.z); rotW.push_back(rotation.w);
+		scaleX.push_back(scale.x); scaleY.push_back(scale.y); scaleZ.push_back(scale.z);
+	}
+
+	glm::vec3 getPosition(size_t i) const
+	{
+		return { posX[i], posY[i], posZ[i] };
+	}
+
+	glm::quat getRotation(size_t i) const
+	{
+		return glm::quat(rotW[i], rotX[i], rotY[i], rotZ[i]);
+	}
+
+	glm::vec3 getScale(size_t i) const
+	{
+		return { scaleX[i], scaleY[i], scaleZ[i] };
+	}
+
+	void setPosition(size_t i, const glm::vec3& pos)
+	{
+		posX[i] = pos.x; posY[i] = pos.y; posZ[i] = pos.z;
+	}
+
+	void setRotation(size_t i, const glm::quat& rotation)
+	{
+		rotX[i] = rotation.x; rotY[i] = rotation.y; rotZ[i] = rotation.z; rotW[i] = rotation.w;
+	}
+
+	void setScale(size_t i, const glm::vec3& scale)
+	{
+		scaleX[i] = scale.x; scaleY[i] = scale.y; scaleZ[i] = scale.z;
+	}
+};
+
+namespace affine_transform_detail
+{
+	inline glm::mat4x3 composeOne(const TRSArrays& trs, size_t i)
+	{
+		return composeAffine(trs.getPosition(i), trs.getRotation(i), trs.getScale(i));
+	}
+
+#if AFFINE_TRANSFORM_SSE
+	//Four transforms per iteration, each lane computes one matrix. load(component, lane) reads a TRS value.
+	template<typename TLoad>
+	void composeFour(const TRSArrays& trs, TLoad&& load, glm::mat4x3* out)
+	{
+		const __m128 x = load(trs.rotX), y = load(trs.rotY), z = load(trs.rotZ), w = load(trs.rotW);
+		const __m128 sx = load(trs.scaleX), sy = load(trs.scaleY), sz = load(trs.scaleZ);
+		const __m128 one = _mm_set1_ps(1.f), two = _mm_set1_ps(2.f);
+
+		const __m128 x2 = _mm_mul_ps(x, two), y2 = _mm_mul_ps(y, two), z2 = _mm_mul_ps(z, two);
+		const __m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+		const __m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+		const __m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+
+		//Element e of the matrix (column e / 3, row e % 3) for the four lanes
+		__m128 e[12];
+		e[0] = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx);
+		e[1] = _mm_mul_ps(_mm_add_ps(xy, wz), sx);
+		e[2] = _mm_mul_ps(_mm_sub_ps(xz, wy), sx);
+		e[3] = _mm_mul_ps(_mm_sub_ps(xy, wz), sy);
+		e[4] = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy);
+		e[5] = _mm_mul_ps(_mm_add_ps(yz, wx), sy);
+		e[6] = _mm_mul_ps(_mm_add_ps(xz, wy), sz);
+		e[7] = _mm_mul_ps(_mm_sub_ps(yz, wx), sz);
+		e[8] = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz);
+		e[9] = load(trs.posX);
+		e[10] = load(trs.posY);
+		e[11] = load(trs.posZ);
+
+		//Transpose each group of four elements so every lane becomes four consecutive floats of its matrix
+		float* destination = &out[0][0][0];
+		for (int group = 0; group < 3; ++group)
+		{
+			__m128 r0 = e[group * 4], r1 = e[group * 4 + 1], r2 = e[group * 4 + 2], r3 = e[group * 4 + 3];
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(destination + 0 * 12 + group * 4, r0);
+			_mm_storeu_ps(destination + 1 * 12 + group * 4, r1);
+			_mm_storeu_ps(destination + 2 * 12 + group * 4, r2);
+			_mm_storeu_ps(destination + 3 * 12 + group * 4, r3);
+		}
+	}
+#endif
+}
+
+namespace affine_transform_detail
+{
+	//a * b with b given as four columns of which the first three floats are read, Stride floats apart
+	template<int Stride>
+	glm::mat4 multiplyAffineColumns(const glm::mat4& a, const float* b)
+	{
+		glm::mat4 out;
+#if AFFINE_TRANSFORM_SSE
+		const float* source = &a[0][0];
+		const __m128 a0 = _mm_loadu_ps(source), a1 = _mm_loadu_ps(source + 4), a2 = _mm_loadu_ps(source + 8), a3 = _mm_loadu_ps(source + 12);
+		float* destination = &out[0][0];
+		for (int column = 0; column < 4; ++column)
+		{
+			const float* c = b + column * Stride;
+			__m128 result = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(c[0])), _mm_mul_ps(a1, _mm_set1_ps(c[1]))), _mm_mul_ps(a2, _mm_set1_ps(c[2])));
+			if (column == 3)
+				result = _mm_add_ps(result, a3);
+			_mm_storeu_ps(destination + column * 4, result);
+		}
+#else
+		for (int column = 0; column < 4; ++column)
+		{
+			const float* c = b + column * Stride;
+			out[column] = a[0] * c[0] + a[1] * c[1] + a[2] * c[2];
+		}
+		out[3] += a[3];
+#endif
+		return out;
+	}
+}
+
+//a * b for an affine a kept as a glm::mat4, e.g. a transform that ends up in a mat4 uniform. Each column of the result
+//is one SSE combination of the columns of a, about twice as fast as multiplyAffine on mat4x3.
+inline glm::mat4 multiplyAffine(const glm::mat4& a, const glm::mat4x3& b)
+{
+	return affine_transform_detail::multiplyAffineColumns<3>(a, &b[0][0]);
+}
+
+//a * b, both affine and kept as glm::mat4, the last row of b is ignored
+inline glm::mat4 multiplyAffine(const glm::mat4& a, const glm::mat4& b)
+{
+	return affine_transform_detail::multiplyAffineColumns<4>(a, &b[0][0]);
+}
+
+//out[i] = composeAffine of the TRS first + i, for i in [0, count)
+inline void composeAffineBatch(const TRSArrays& trs, size_t first, size_t count, glm::mat4x3* out)
+{
+	static_assert(sizeof(glm::mat4x3) == 12 * sizeof(float), "mat4x3 must be tightly packed");
+	size_t i = 0;
+#if AFFINE_TRANSFORM_SSE
+	for (; i + 4 <= count; i += 4)
+	{
+		const size_t base = first + i;
+		affine_transform_detail::composeFour(trs, [base](const std::vector<float>& component) { return _mm_loadu_ps(&component[base]); }, out + i);
+	}
+#endif
+	for (; i < count; ++i)
+		out[i] = affine_transform_detail::composeOne(trs, first + i);
+}
+
+//out[i] = composeAffine of the TRS indices[i], for i in [0, count). Gathers the lanes, for scattered handles.
+inline void composeAffineIndexed(const TRSArrays& trs, const uint32_t* indices, size_t count, glm::mat4x3* out)
+{
+	size_t i = 0;
+#if AFFINE_TRANSFORM_SSE
+	for (; i + 4 <= count; i += 4)
+	{
+		const uint32_t* lanes = indices + i;
+		affine_transform_detail::composeFour(trs, [lanes](const std::vector<float>& component)
+			{
+				return _mm_setr_ps(component[lanes[0]], component[lanes[1]], component[lanes[2]], component[lanes[3]]);
+			}, out + i);
+	}
+#endif
+	for (; i < count; ++i)
+		out[i] = affine_transform_detail::composeOne(trs, indices[i]);
+}
+#endif
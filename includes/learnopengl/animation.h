@@ -2,11 +2,13 @@
 
 #include <vector>
 #include <map>
+#include <cfloat>
 #include <glm/glm.hpp>
 #include <assimp/scene.h>
 #include <learnopengl/bone.h>
 #include <functional>
 #include <learnopengl/animdata.h>
+#include <learnopengl/skeleton.h>
 #include <learnopengl/model_animation.h>
 
 struct AssimpNodeData
@@ -22,18 +24,19 @@ class Animation
 public:
 	Animation() = default;
 
+	/* Imports the file on every call, AnimationCache shares the clips of a file between models and characters */
 	Animation(const std::string& animationPath, Model* model)
 	{
 		Assimp::Importer importer;
 		const aiScene* scene = importer.ReadFile(animationPath, aiProcess_Triangulate);
 		assert(scene && scene->mRootNode);
-		auto animation = scene->mAnimations[0];
-		m_Duration = animation->mDuration;
-		m_TicksPerSecond = animation->mTicksPerSecond;
-		aiMatrix4x4 globalTransformation = scene->mRootNode->mTransformation;
-		globalTransformation = globalTransformation.Inverse();
-		ReadHierarchyData(m_RootNode, scene->mRootNode);
-		ReadMissingBones(animation, *model);
+		Load(scene->mAnimations[0], scene->mRootNode, *model);
+	}
+
+	/* From a scene already imported, e.g. one holding several animations */
+	Animation(const aiAnimation* animation, const aiNode* rootNode, Model* model)
+	{
+		Load(animation, rootNode, *model);
 	}
 
 	~Animation()
@@ -52,16 +55,81 @@ public:
 		else return &(*iter);
 	}
 
+	/* Index of the bone in GetBone, -1 if the node is not animated */
+	int FindBoneIndex(const std::string& name) const
+	{
+		for (int i = 0; i < static_cast<int>(m_Bones.size()); ++i)
+		{
+			if (m_Bones[i].GetBoneName() == name)
+				return i;
+		}
+		return -1;
+	}
+
+	inline const Bone& GetBone(int index) const { return m_Bones[index]; }
+	inline int GetBoneCount() const { return static_cast<int>(m_Bones.size()); }
+
 	
-	inline float GetTicksPerSecond() { return m_TicksPerSecond; }
-	inline float GetDuration() { return m_Duration;}
-	inline const AssimpNodeData& GetRootNode() { return m_RootNode; }
-	inline const std::map<std::string,BoneInfo>& GetBoneIDMap() 
-	{ 
-		return m_BoneInfoMap;
+	inline float GetTicksPerSecond() const { return m_TicksPerSecond; }
+	inline float GetDuration() const { return m_Duration;}
+	inline const AssimpNodeData& GetRootNode() const { return m_RootNode; }
+	inline const Skeleton& GetSkeleton() const { return m_Skeleton; }
+
+	/* Compresses every bone of the clip, see Bone::Compress. Positions and scales are quantized against the range of
+	   the whole clip. The rotation tolerance of a joint is lowered so that its error moves the furthest joint below it,
+	   in the bind pose, by at most translationTolerance. */
+	ClipCompressionReport Compress(const ClipCompressionSettings& settings = ClipCompressionSettings())
+	{
+		glm::vec3 positionMin(FLT_MAX), positionMax(-FLT_MAX), scaleMin(FLT_MAX), scaleMax(-FLT_MAX);
+		for (const Bone& bone : m_Bones)
+		{
+			for (const glm::vec3& position : bone.GetPositions().values)
+			{
+				positionMin = glm::min(positionMin, position);
+				positionMax = glm::max(positionMax, position);
+			}
+			for (const glm::vec3& scale : bone.GetScales().values)
+			{
+				scaleMin = glm::min(scaleMin, scale);
+				scaleMax = glm::max(scaleMax, scale);
+			}
+		}
+		const QuantizationRange positionRange = QuantizationRange::FromValues(positionMin, positionMax);
+		const QuantizationRange scaleRange = QuantizationRange::FromValues(scaleMin, scaleMax);
+
+		const int jointCount = m_Skeleton.GetJointCount();
+		const std::vector<float> spans = m_Skeleton.ComputeBindSpans();
+
+		ClipCompressionReport report;
+		for (int joint = 0; joint < jointCount; ++joint)
+		{
+			const int channel = m_Skeleton.jointChannels[joint];
+			if (channel < 0)
+				continue;
+			const float rotationTolerance = spans[joint] > 0.0f ?
+				std::min(settings.rotationTolerance, settings.translationTolerance / spans[joint]) : settings.rotationTolerance;
+			report.Merge(m_Bones[channel].Compress(positionRange, scaleRange,
+				settings.translationTolerance, rotationTolerance, settings.scaleTolerance));
+		}
+		/* Channels of nodes missing from the hierarchy are never played, still release their keys */
+		for (Bone& bone : m_Bones)
+		{
+			if (!bone.IsCompressed())
+				report.Merge(bone.Compress(positionRange, scaleRange, settings.translationTolerance, settings.rotationTolerance, settings.scaleTolerance));
+		}
+		return report;
 	}
 
 private:
+	void Load(const aiAnimation* animation, const aiNode* rootNode, Model& model)
+	{
+		m_Duration = animation->mDuration;
+		m_TicksPerSecond = animation->mTicksPerSecond;
+		ReadHierarchyData(m_RootNode, rootNode);
+		ReadMissingBones(animation, model);
+		CompileSkeleton(m_RootNode, -1, model.GetBoneInfoMap());
+	}
+
 	void ReadMissingBones(const aiAnimation* animation, Model& model)
 	{
 		int size = animation->mNumChannels;
@@ -83,8 +151,6 @@ private:
 			m_Bones.push_back(Bone(channel->mNodeName.data,
 				boneInfoMap[channel->mNodeName.data].id, channel));
 		}
-
-		m_BoneInfoMap = boneInfoMap;
 	}
 
 	void ReadHierarchyData(AssimpNodeData& dest, const aiNode* src)
@@ -102,10 +168,28 @@ private:
 			dest.children.push_back(newData);
 		}
 	}
+	/* Depth first, so parents get their joint before their children. All name lookups happen here, once: the
+	   skeleton keeps the palette index and offset of its joints, the bone map of the model is not copied. */
+	void CompileSkeleton(const AssimpNodeData& node, int parent, const std::map<std::string, BoneInfo>& boneInfoMap)
+	{
+		const int joint = m_Skeleton.AddJoint(node.name, parent, node.transformation);
+		m_Skeleton.jointChannels[joint] = FindBoneIndex(node.name);
+
+		auto boneInfo = boneInfoMap.find(node.name);
+		if (boneInfo != boneInfoMap.end())
+		{
+			m_Skeleton.paletteIndices[joint] = boneInfo->second.id;
+			m_Skeleton.offsets[joint] = boneInfo->second.offset;
+		}
+
+		for (const AssimpNodeData& child : node.children)
+			CompileSkeleton(child, joint, boneInfoMap);
+	}
+
 	float m_Duration;
 	int m_TicksPerSecond;
 	std::vector<Bone> m_Bones;
 	AssimpNodeData m_RootNode;
-	std::map<std::string, BoneInfo> m_BoneInfoMap;
+	Skeleton m_Skeleton;
 };
 
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <utility>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <learnopengl/animation.h>
+
+/* Animation clips imported once and shared. A clip only holds immutable data, the keys and the compiled skeleton;
+   the time, key cursors and pose of a character live in its Animator or CrowdAnimator. Clips are keyed by file and
+   by the skeleton of the model they skin: models with the same bone map, e.g. several instances of one character,
+   share their clips. Every clip of a file is loaded by its first request. */
+class AnimationCache
+{
+public:
+	static AnimationCache& Instance()
+	{
+		static AnimationCache cache;
+		return cache;
+	}
+
+	/* Clips imported from now on are compressed with settings, see Animation::Compress */
+	void SetCompression(const ClipCompressionSettings& settings)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Compress = true;
+		m_CompressionSettings = settings;
+	}
+
+	/* Clip index of the file at path, nullptr if the file has no such animation. Like the Animation constructor,
+	   adds the animated nodes missing from the bone map of model. The clip lives until Clear. */
+	const Animation* Get(const std::string& path, Model* model, int index = 0)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		std::shared_ptr<File> file = Find(path, model->GetBoneInfoMap());
+		if (!file)
+		{
+			const BoneMap requested = model->GetBoneInfoMap();
+			file = Import(path, *model);
+			Insert(path, requested, file);
+			// the same model asks with the bones the import added to its map
+			Insert(path, model->GetBoneInfoMap(), file);
+		}
+		else if (AddMissingBones(*file, *model))
+		{
+			Insert(path, model->GetBoneInfoMap(), file);
+		}
+
+		if (index < 0 || index >= static_cast<int>(file->clips.size()))
+			return nullptr;
+		return file->clips[index].get();
+	}
+
+	/* Every clip handed out so far becomes invalid */
+	void Clear()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Files.clear();
+	}
+
+	/* Files actually read since the start, whatever the number of Get */
+	unsigned int GetImportCount() const { return m_ImportCount; }
+	const ClipCompressionReport& GetCompressionReport() const { return m_CompressionReport; }
+
+private:
+	typedef std::map<std::string, BoneInfo> BoneMap;
+	/* path and hash of the bone map */
+	typedef std::pair<std::string, size_t> Key;
+
+	struct File
+	{
+		std::vector<std::unique_ptr<Animation>> clips;
+	};
+
+	/* The bone map a file was requested with is kept whole, two maps with the same hash must not share clips */
+	struct Entry
+	{
+		BoneMap bones;
+		std::shared_ptr<File> file;
+	};
+
+	AnimationCache() = default;
+
+	std::shared_ptr<File> Find(const std::string& path, const BoneMap& bones) const
+	{
+		auto found = m_Files.find(Key(path, GetSkeletonHash(bones)));
+		if (found == m_Files.end())
+			return nullptr;
+		for (const Entry& entry : found->second)
+		{
+			if (IsSameSkeleton(entry.bones, bones))
+				return entry.file;
+		}
+		return nullptr;
+	}
+
+	void Insert(const std::string& path, const BoneMap& bones, const std::shared_ptr<File>& file)
+	{
+		if (!Find(path, bones))
+			m_Files[Key(path, GetSkeletonHash(bones))].push_back({ bones, file });
+	}
+
+	/* Same names, palette indices and offsets, bit for bit like the hash */
+	static bool IsSameSkeleton(const BoneMap& a, const BoneMap& b)
+	{
+		if (a.size() != b.size())
+			return false;
+		for (auto i = a.begin(), j = b.begin(); i != a.end(); ++i, ++j)
+		{
+			if (i->first != j->first || i->second.id != j->second.id ||
+				std::memcmp(&i->second.offset[0][0], &j->second.offset[0][0], sizeof(glm::mat4)) != 0)
+				return false;
+		}
+		return true;
+	}
+
+	/* Names, palette indices and offsets of the bones, the clip data that depends on the model */
+	static size_t GetSkeletonHash(const BoneMap& bones)
+	{
+		size_t hash = 0;
+		auto combine = [&hash](size_t value) { hash ^= value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2); };
+		for (const auto& bone : bones)
+		{
+			combine(std::hash<std::string>()(bone.first));
+			combine(std::hash<int>()(bone.second.id));
+			const float* offset = &bone.second.offset[0][0];
+			for (int i = 0; i < 16; ++i)
+			{
+				uint32_t bits;
+				std::memcpy(&bits, &offset[i], sizeof(bits));
+				combine(bits);
+			}
+		}
+		return hash;
+	}
+
+	std::shared_ptr<File> Import(const std::string& path, Model& model)
+	{
+		std::shared_ptr<File> file = std::make_shared<File>();
+		Assimp::Importer importer;
+		const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate);
+		++m_ImportCount;
+		if (!scene || !scene->mRootNode)
+		{
+			std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+			return file;
+		}
+
+		for (unsigned int i = 0; i < scene->mNumAnimations; ++i)
+		{
+			file->clips.push_back(std::make_unique<Animation>(scene->mAnimations[i], scene->mRootNode, &model));
+			if (m_Compress)
+				m_CompressionReport.Merge(file->clips.back()->Compress(m_CompressionSettings));
+		}
+		return file;
+	}
+
+	/* Another model with the same bone map gets the bones the first import added, with the same ids, so its next
+	   clips number them as the shared ones do */
+	static bool AddMissingBones(const File& file, Model& model)
+	{
+		auto& boneInfoMap = model.GetBoneInfoMap();
+		int& boneCount = model.GetBoneCount();
+		bool added = false;
+		for (const std::unique_ptr<Animation>& clip : file.clips)
+		{
+			for (int i = 0; i < clip->GetBoneCount(); ++i)
+			{
+				const Bone& bone = clip->GetBone(i);
+				if (boneInfoMap.find(bone.GetBoneName()) != boneInfoMap.end())
+					continue;
+				boneInfoMap[bone.GetBoneName()].id = bone.GetBoneID();
+				boneCount = std::max(boneCount, bone.GetBoneID() + 1);
+				added = true;
+			}
+		}
+		return added;
+	}
+
+	std::mutex m_Mutex;
+	std::map<Key, std::vector<Entry>> m_Files;
+	bool m_Compress = false;
+	ClipCompressionSettings m_CompressionSettings;
+	ClipCompressionReport m_CompressionReport;
+	unsigned int m_ImportCount = 0;
+};
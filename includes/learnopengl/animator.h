@@ -11,15 +11,11 @@
 class Animator
 {
 public:
-	Animator(Animation* animation)
+	Animator(const Animation* animation)
 	{
 		m_CurrentTime = 0.0;
 		m_CurrentAnimation = animation;
-
-		m_FinalBoneMatrices.reserve(100);
-
-		for (int i = 0; i < 100; i++)
-			m_FinalBoneMatrices.push_back(glm::mat4(1.0f));
+		ResetPose();
 	}
 
 	void UpdateAnimation(float dt)
@@ -29,51 +25,68 @@ public:
 		{
 			m_CurrentTime += m_CurrentAnimation->GetTicksPerSecond() * dt;
 			m_CurrentTime = fmod(m_CurrentTime, m_CurrentAnimation->GetDuration());
-			CalculateBoneTransform(&m_CurrentAnimation->GetRootNode(), glm::mat4(1.0f));
+			CalculateBoneTransforms();
 		}
 	}
 
-	void PlayAnimation(Animation* pAnimation)
+	/* Poses the skeleton at time, in ticks, without advancing. Used to sample a clip at fixed rate. */
+	void SetCurrentTime(float time)
+	{
+		if (!m_CurrentAnimation)
+			return;
+		m_CurrentTime = time;
+		CalculateBoneTransforms();
+	}
+
+	float GetCurrentTime() const { return m_CurrentTime; }
+
+	void PlayAnimation(const Animation* pAnimation)
 	{
 		m_CurrentAnimation = pAnimation;
 		m_CurrentTime = 0.0f;
+		ResetPose();
 	}
 
-	void CalculateBoneTransform(const AssimpNodeData* node, glm::mat4 parentTransform)
+	/* One pass over the joints of the skeleton, parents are always resolved before their children */
+	void CalculateBoneTransforms()
 	{
-		std::string nodeName = node->name;
-		glm::mat4 nodeTransform = node->transformation;
-
-		Bone* Bone = m_CurrentAnimation->FindBone(nodeName);
-
-		if (Bone)
+		const Skeleton& skeleton = m_CurrentAnimation->GetSkeleton();
+		for (int joint = 0; joint < skeleton.GetJointCount(); ++joint)
 		{
-			Bone->Update(m_CurrentTime);
-			nodeTransform = Bone->GetLocalTransform();
-		}
+			const int channel = skeleton.jointChannels[joint];
+			// the bones belong to the animation, the key cursors to this animator
+			const glm::mat4 nodeTransform = channel >= 0 ?
+				m_CurrentAnimation->GetBone(channel).Sample(m_CurrentTime, m_Cursors[channel]) : skeleton.bindLocals[joint];
 
-		glm::mat4 globalTransformation = parentTransform * nodeTransform;
+			const int parent = skeleton.parents[joint];
+			m_GlobalTransforms[joint] = parent >= 0 ? m_GlobalTransforms[parent] * nodeTransform : nodeTransform;
 
-		auto boneInfoMap = m_CurrentAnimation->GetBoneIDMap();
-		if (boneInfoMap.find(nodeName) != boneInfoMap.end())
-		{
-			int index = boneInfoMap[nodeName].id;
-			glm::mat4 offset = boneInfoMap[nodeName].offset;
-			m_FinalBoneMatrices[index] = globalTransformation * offset;
+			const int index = skeleton.paletteIndices[joint];
+			if (index >= 0)
+				m_FinalBoneMatrices[index] = m_GlobalTransforms[joint] * skeleton.offsets[joint];
 		}
-
-		for (int i = 0; i < node->childrenCount; i++)
-			CalculateBoneTransform(&node->children[i], globalTransformation);
 	}
 
-	std::vector<glm::mat4> GetFinalBoneMatrices()
+	const std::vector<glm::mat4>& GetFinalBoneMatrices() const
 	{
 		return m_FinalBoneMatrices;
 	}
 
 private:
+	void ResetPose()
+	{
+		const int jointCount = m_CurrentAnimation ? m_CurrentAnimation->GetSkeleton().GetJointCount() : 0;
+		const int paletteSize = m_CurrentAnimation ? m_CurrentAnimation->GetSkeleton().GetPaletteSize() : 0;
+		m_Cursors.assign(m_CurrentAnimation ? m_CurrentAnimation->GetBoneCount() : 0, BoneCursor{});
+		m_GlobalTransforms.assign(jointCount, glm::mat4(1.0f));
+		// as many matrices as the skeleton writes, bones past them are left in the bind pose by the shaders
+		m_FinalBoneMatrices.assign(std::max(1, paletteSize), glm::mat4(1.0f));
+	}
+
 	std::vector<glm::mat4> m_FinalBoneMatrices;
-	Animation* m_CurrentAnimation;
+	std::vector<glm::mat4> m_GlobalTransforms;
+	std::vector<BoneCursor> m_Cursors;
+	const Animation* m_CurrentAnimation;
 	float m_CurrentTime;
 	float m_DeltaTime;
 
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <unordered_set>
+#include <cassert>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/animator.h>
+#include <learnopengl/affine_transform.h>
+#include <learnopengl/mesh_textures.h>
+
+/* Rows of a clip in a BakedAnimationTexture. frameCount samples cover the clip evenly, the last one is its end. */
+struct BakedClip
+{
+	int firstRow = 0;
+	int frameCount = 0;
+	float framesPerSecond = 0.0f;
+	float duration = 0.0f;
+};
+
+/* Final bone matrices of animation clips sampled at a fixed rate and stored in one RGBA32F texture. A row holds the
+   palette of one frame, three texels per bone for the three rows of its 3x4 affine matrix. Clips are stacked one
+   after the other, all of them must skin the same model so they share the palette layout. */
+class BakedAnimationTexture
+{
+public:
+	explicit BakedAnimationTexture(float framesPerSecond = 30.0f)
+		: m_FramesPerSecond(framesPerSecond)
+	{
+	}
+
+	~BakedAnimationTexture()
+	{
+		if (m_Texture)
+			glDeleteTextures(1, &m_Texture);
+	}
+
+	BakedAnimationTexture(const BakedAnimationTexture&) = delete;
+	BakedAnimationTexture& operator=(const BakedAnimationTexture&) = delete;
+
+	/* Samples animation, returns the index of its clip or -1 if its palette size differs from the clips already added.
+	   Call Upload once every clip is added. */
+	int AddClip(const Animation& animation)
+	{
+		const int paletteSize = std::max(1, animation.GetSkeleton().GetPaletteSize());
+		assert((m_PaletteSize == 0 || paletteSize == m_PaletteSize) && "clips of a baked texture must skin the same model");
+		if (m_PaletteSize != 0 && paletteSize != m_PaletteSize)
+			return -1;
+		m_PaletteSize = paletteSize;
+
+		const float ticksPerSecond = animation.GetTicksPerSecond() > 0 ? animation.GetTicksPerSecond() : 25.0f;
+		const float duration = animation.GetDuration() / ticksPerSecond;
+		const int intervals = std::max(1, static_cast<int>(std::lround(duration * m_FramesPerSecond)));
+
+		BakedClip clip;
+		clip.firstRow = m_RowCount;
+		clip.frameCount = intervals + 1;
+		clip.duration = duration;
+		clip.framesPerSecond = duration > 0.0f ? intervals / duration : m_FramesPerSecond;
+
+		Animator animator(&animation);
+
+		m_Texels.resize(m_Texels.size() + static_cast<size_t>(clip.frameCount) * m_PaletteSize * 3);
+		for (int frame = 0; frame < clip.frameCount; ++frame)
+		{
+			// the last frame is the end of the clip, the key search clamps it to the last keys
+			animator.SetCurrentTime(animation.GetDuration() * frame / intervals);
+			const std::vector<glm::mat4>& palette = animator.GetFinalBoneMatrices();
+			glm::vec4* row = &m_Texels[static_cast<size_t>(clip.firstRow + frame) * m_PaletteSize * 3];
+			for (int bone = 0; bone < m_PaletteSize; ++bone)
+			{
+				const glm::mat4 matrix = bone < static_cast<int>(palette.size()) ? palette[bone] : glm::mat4(1.0f);
+				for (int r = 0; r < 3; ++r)
+					row[bone * 3 + r] = glm::vec4(matrix[0][r], matrix[1][r], matrix[2][r], matrix[3][r]);
+			}
+		}
+
+		m_RowCount += clip.frameCount;
+		m_Clips.push_back(clip);
+		m_Dirty = true;
+		return static_cast<int>(m_Clips.size()) - 1;
+	}
+
+	/* Creates or updates the texture, must be called from the thread owning the GL context */
+	void Upload()
+	{
+		if (!m_Dirty)
+			return;
+		if (!m_Texture)
+			glGenTextures(1, &m_Texture);
+		glBindTexture(GL_TEXTURE_2D, m_Texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_PaletteSize * 3, m_RowCount, 0, GL_RGBA, GL_FLOAT, m_Texels.data());
+		// read with texelFetch only
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		m_Dirty = false;
+	}
+
+	/* Binds the texture to unit and points the sampler uniform name of shader to it */
+	void Bind(Shader& shader, unsigned int unit, const char* name = "bakedPalettes") const
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, m_Texture);
+		glUniform1i(glGetUniformLocation(shader.ID, name), unit);
+	}
+
+	const BakedClip& GetClip(int clip) const { return m_Clips[clip]; }
+	int GetClipCount() const { return static_cast<int>(m_Clips.size()); }
+	int GetPaletteSize() const { return m_PaletteSize; }
+	int GetRowCount() const { return m_RowCount; }
+	unsigned int GetTexture() const { return m_Texture; }
+	size_t GetByteSize() const { return m_Texels.size() * sizeof(glm::vec4); }
+
+	/* Row r of the affine matrix of bone at frame of clip, as stored in the texture */
+	const glm::vec4& GetTexel(int clip, int frame, int bone, int r) const
+	{
+		return m_Texels[(static_cast<size_t>(m_Clips[clip].firstRow + frame) * m_PaletteSize + bone) * 3 + r];
+	}
+
+private:
+	float m_FramesPerSecond;
+	int m_PaletteSize = 0;
+	int m_RowCount = 0;
+	std::vector<glm::vec4> m_Texels;
+	std::vector<BakedClip> m_Clips;
+	unsigned int m_Texture = 0;
+	bool m_Dirty = false;
+};
+
+/* Instances of a skinned model animated from a BakedAnimationTexture, each mesh drawn with one glDrawElementsInstanced.
+   The vertex shader reads the model matrix as "layout (location = 7) in mat4x3 instanceMatrix" and the clip as
+   "layout (location = 11) in vec4 instanceAnimation": first row, frame count, frames per second and time offset.
+   Nothing is computed on the CPU per frame, the instance buffer is only uploaded again when instances change. */
+class BakedCrowdRenderer
+{
+public:
+	explicit BakedCrowdRenderer(GLuint instanceMatrixLocation = 7, GLuint instanceAnimationLocation = 11)
+		: m_MatrixLocation(instanceMatrixLocation), m_AnimationLocation(instanceAnimationLocation)
+	{
+		glGenBuffers(1, &m_InstanceVBO);
+	}
+
+	~BakedCrowdRenderer()
+	{
+		glDeleteBuffers(1, &m_InstanceVBO);
+	}
+
+	BakedCrowdRenderer(const BakedCrowdRenderer&) = delete;
+	BakedCrowdRenderer& operator=(const BakedCrowdRenderer&) = delete;
+
+	/* timeOffset in seconds, added to the time uniform of the shader */
+	int AddInstance(const glm::mat4& model, const BakedClip& clip, float timeOffset)
+	{
+		Instance instance;
+		instance.model = toAffine(model);
+		instance.animation = glm::vec4(static_cast<float>(clip.firstRow), static_cast<float>(clip.frameCount), clip.framesPerSecond, timeOffset);
+		m_Instances.push_back(instance);
+		m_Dirty = true;
+		return static_cast<int>(m_Instances.size()) - 1;
+	}
+
+	void SetInstanceModel(int instance, const glm::mat4& model)
+	{
+		m_Instances[instance].model = toAffine(model);
+		m_Dirty = true;
+	}
+
+	/* shader is expected to be in use with its view, projection and time uniforms set */
+	void Draw(Model& model, Shader& shader, const BakedAnimationTexture& baked)
+	{
+		m_DrawCalls = 0;
+		if (m_Instances.empty())
+			return;
+		Upload();
+
+		glBindBuffer(GL_ARRAY_BUFFER, m_InstanceVBO);
+		// unit 0 onwards are for the textures of the meshes
+		const unsigned int bakedUnit = 15;
+		baked.Bind(shader, bakedUnit);
+		for (Mesh& mesh : model.meshes)
+		{
+			bindMeshTextures(mesh, shader);
+			glBindVertexArray(mesh.VAO);
+			EnableInstanceAttributes(mesh.VAO);
+			glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(mesh.indices.size()), GL_UNSIGNED_INT, 0, static_cast<GLsizei>(m_Instances.size()));
+			++m_DrawCalls;
+		}
+
+		glBindVertexArray(0);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	int GetInstanceCount() const { return static_cast<int>(m_Instances.size()); }
+	unsigned int GetDrawCallCount() const { return m_DrawCalls; }
+
+private:
+	struct Instance
+	{
+		glm::mat4x3 model;
+		glm::vec4 animation;
+	};
+
+	void Upload()
+	{
+		if (!m_Dirty)
+			return;
+		glBindBuffer(GL_ARRAY_BUFFER, m_InstanceVBO);
+		glBufferData(GL_ARRAY_BUFFER, m_Instances.size() * sizeof(Instance), m_Instances.data(), GL_STATIC_DRAW);
+		m_Dirty = false;
+	}
+
+	void EnableInstanceAttributes(GLuint VAO)
+	{
+		if (!m_PreparedVAOs.insert(VAO).second)
+			return;
+
+		for (GLuint column = 0; column < 4; ++column)
+		{
+			glEnableVertexAttribArray(m_MatrixLocation + column);
+			glVertexAttribPointer(m_MatrixLocation + column, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(offsetof(Instance, model) + column * sizeof(glm::vec3)));
+			glVertexAttribDivisor(m_MatrixLocation + column, 1);
+		}
+		glEnableVertexAttribArray(m_AnimationLocation);
+		glVertexAttribPointer(m_AnimationLocation, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)offsetof(Instance, animation));
+		glVertexAttribDivisor(m_AnimationLocation, 1);
+	}
+
+	GLuint m_MatrixLocation;
+	GLuint m_AnimationLocation;
+	GLuint m_InstanceVBO = 0;
+	std::vector<Instance> m_Instances;
+	bool m_Dirty = false;
+	unsigned int m_DrawCalls = 0;
+	// VAOs whose instance attributes already point to the instance buffer
+	std::unordered_set<GLuint> m_PreparedVAOs;
+};
@@ -0,0 +1,320 @@
+#ifndef BATCH_CULLING_H
+#define BATCH_CULLING_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/entity.h>
+
+#include <vector> //std::vector
+#include <cstdint> //uint32_t, uint64_t
+#include <cmath> //std::abs
+
+#if defined(__AVX512F__) || defined(__AVX2__) || defined(__AVX__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+//Widest instruction set enabled at compile time (e.g. -mavx2, /arch:AVX2). 1 means scalar fallback.
+#if defined(__AVX512F__)
+#define BATCH_CULLING_WIDTH 16
+#elif defined(__AVX2__) || defined(__AVX__)
+#define BATCH_CULLING_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BATCH_CULLING_WIDTH 4
+#else
+#define BATCH_CULLING_WIDTH 1
+#endif
+
+//World space AABBs stored as structure of arrays, so one SIMD load fetches the same component of several boxes
+struct AABBSoA
+{
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+
+	size_t size() const
+	{
+		return centerX.size();
+	}
+
+	void clear()
+	{
+		centerX.clear(); centerY.clear(); centerZ.clear();
+		extentX.clear(); extentY.clear(); extentZ.clear();
+	}
+
+	void reserve(size_t count)
+	{
+		centerX.reserve(count); centerY.reserve(count); centerZ.reserve(count);
+		extentX.reserve(count); extentY.reserve(count); extentZ.reserve(count);
+	}
+
+	void push_back(const glm::vec3& center, const glm::vec3& extents)
+	{
+		centerX.push_back(center.x); centerY.push_back(center.y); centerZ.push_back(center.z);
+		extentX.push_back(extents.x); extentY.push_back(extents.y); extentZ.push_back(extents.z);
+	}
+
+	//Same box as Entity::getGlobalAABB, with the extents given by |M| * e instead of 9 dot products.
+	//Takes a glm::mat4 or an affine glm::mat4x3.
+	template<typename TMatrix>
+	void pushTransformed(const AABB& localAABB, const TMatrix& modelMatrix)
+	{
+		const glm::vec3 center{ modelMatrix * glm::vec4(localAABB.center, 1.f) };
+		const glm::vec3& e = localAABB.extents;
+		const glm::vec3 extents{
+			std::abs(modelMatrix[0][0]) * e.x + std::abs(modelMatrix[1][0]) * e.y + std::abs(modelMatrix[2][0]) * e.z,
+			std::abs(modelMatrix[0][1]) * e.x + std::abs(modelMatrix[1][1]) * e.y + std::abs(modelMatrix[2][1]) * e.z,
+			std::abs(modelMatrix[0][2]) * e.x + std::abs(modelMatrix[1][2]) * e.y + std::abs(modelMatrix[2][2]) * e.z };
+		push_back(center, extents);
+	}
+};
+
+//World space spheres stored as structure of arrays
+struct SphereSoA
+{
+	std::vector<float> centerX, centerY, centerZ, radius;
+
+	size_t size() const
+	{
+		return centerX.size();
+	}
+
+	void clear()
+	{
+		centerX.clear(); centerY.clear(); centerZ.clear(); radius.clear();
+	}
+
+	void reserve(size_t count)
+	{
+		centerX.reserve(count); centerY.reserve(count); centerZ.reserve(count); radius.reserve(count);
+	}
+
+	void push_back(const glm::vec3& center, float inRadius)
+	{
+		centerX.push_back(center.x); centerY.push_back(center.y); centerZ.push_back(center.z);
+		radius.push_back(inRadius);
+	}
+};
+
+namespace batch_culling_detail
+{
+	//The six planes of a Frustum, split by component, with the absolute normals precomputed for the AABB test
+	struct Planes
+	{
+		float nx[6], ny[6], nz[6], d[6];
+		float ax[6], ay[6], az[6];
+
+		explicit Planes(const Frustum& frustum)
+		{
+			//Same order as the scalar path, the planes which reject the most come first
+			const Plane* planes[6] = { &frustum.leftFace, &frustum.rightFace, &frustum.topFace,
+				&frustum.bottomFace, &frustum.nearFace, &frustum.farFace };
+			for (int i = 0; i < 6; ++i)
+			{
+				nx[i] = planes[i]->normal.x; ny[i] = planes[i]->normal.y; nz[i] = planes[i]->normal.z;
+				d[i] = planes[i]->distance;
+				ax[i] = std::abs(nx[i]); ay[i] = std::abs(ny[i]); az[i] = std::abs(nz[i]);
+			}
+		}
+	};
+
+	inline bool isAABBVisible(const Planes& p, const AABBSoA& boxes, size_t i)
+	{
+		for (int k = 0; k < 6; ++k)
+		{
+			const float dist = p.nx[k] * boxes.centerX[i] + p.ny[k] * boxes.centerY[i] + p.nz[k] * boxes.centerZ[i] - p.d[k];
+			const float r = p.ax[k] * boxes.extentX[i] + p.ay[k] * boxes.extentY[i] + p.az[k] * boxes.extentZ[i];
+			if (dist < -r)
+				return false;
+		}
+		return true;
+	}
+
+	inline bool isSphereVisible(const Planes& p, const SphereSoA& spheres, size_t i)
+	{
+		for (int k = 0; k < 6; ++k)
+		{
+			const float dist = p.nx[k] * spheres.centerX[i] + p.ny[k] * spheres.centerY[i] + p.nz[k] * spheres.centerZ[i] - p.d[k];
+			if (dist <= -spheres.radius[i])
+				return false;
+		}
+		return true;
+	}
+
+	//Visibility of BATCH_CULLING_WIDTH consecutive volumes starting at i, one bit per volume.
+	//All six planes are evaluated without early out, branches cost more than the arithmetic here.
+#if BATCH_CULLING_WIDTH == 16
+	inline uint32_t aabbBlockMask(const Planes& p, const AABBSoA& boxes, size_t i)
+	{
+		const __m512 cx = _mm512_loadu_ps(&boxes.centerX[i]), cy = _mm512_loadu_ps(&boxes.centerY[i]), cz = _mm512_loadu_ps(&boxes.centerZ[i]);
+		const __m512 ex = _mm512_loadu_ps(&boxes.extentX[i]), ey = _mm512_loadu_ps(&boxes.extentY[i]), ez = _mm512_loadu_ps(&boxes.extentZ[i]);
+		__mmask16 visible = 0xFFFF;
+		for (int k = 0; k < 6; ++k)
+		{
+			__m512 dist = _mm512_mul_ps(_mm512_set1_ps(p.nx[k]), cx);
+			dist = _mm512_fmadd_ps(_mm512_set1_ps(p.ny[k]), cy, dist);
+			dist = _mm512_fmadd_ps(_mm512_set1_ps(p.nz[k]), cz, dist);
+			dist = _mm512_sub_ps(dist, _mm512_set1_ps(p.d[k]));
+			__m512 r = _mm512_mul_ps(_mm512_set1_ps(p.ax[k]), ex);
+			r = _mm512_fmadd_ps(_mm512_set1_ps(p.ay[k]), ey, r);
+			r = _mm512_fmadd_ps(_mm512_set1_ps(p.az[k]), ez, r);
+			//dist >= -r  <=>  dist + r >= 0
+			visible &= _mm512_cmp_ps_mask(_mm512_add_ps(dist, r), _mm512_setzero_ps(), _CMP_GE_OQ);
+		}
+		return visible;
+	}
+
+	inline uint32_t sphereBlockMask(const Planes& p, const SphereSoA& spheres, size_t i)
+	{
+		const __m512 cx = _mm512_loadu_ps(&spheres.centerX[i]), cy = _mm512_loadu_ps(&spheres.centerY[i]), cz = _mm512_loadu_ps(&spheres.centerZ[i]);
+		const __m512 radius = _mm512_loadu_ps(&spheres.radius[i]);
+		__mmask16 visible = 0xFFFF;
+		for (int k = 0; k < 6; ++k)
+		{
+			__m512 dist = _mm512_mul_ps(_mm512_set1_ps(p.nx[k]), cx);
+			dist = _mm512_fmadd_ps(_mm512_set1_ps(p.ny[k]), cy, dist);
+			dist = _mm512_fmadd_ps(_mm512_set1_ps(p.nz[k]), cz, dist);
+			dist = _mm512_sub_ps(dist, _mm512_set1_ps(p.d[k]));
+			visible &= _mm512_cmp_ps_mask(_mm512_add_ps(dist, radius), _mm512_setzero_ps(), _CMP_GT_OQ);
+		}
+		return visible;
+	}
+#elif BATCH_CULLING_WIDTH == 8
+	inline uint32_t aabbBlockMask(const Planes& p, const AABBSoA& boxes, size_t i)
+	{
+		const __m256 cx = _mm256_loadu_ps(&boxes.centerX[i]), cy = _mm256_loadu_ps(&boxes.centerY[i]), cz = _mm256_loadu_ps(&boxes.centerZ[i]);
+		const __m256 ex = _mm256_loadu_ps(&boxes.extentX[i]), ey = _mm256_loadu_ps(&boxes.extentY[i]), ez = _mm256_loadu_ps(&boxes.extentZ[i]);
+		__m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int k = 0; k < 6; ++k)
+		{
+			__m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(p.nx[k]), cx),
+				_mm256_mul_ps(_mm256_set1_ps(p.ny[k]), cy)), _mm256_mul_ps(_mm256_set1_ps(p.nz[k]), cz));
+			dist = _mm256_sub_ps(dist, _mm256_set1_ps(p.d[k]));
+			const __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(p.ax[k]), ex),
+				_mm256_mul_ps(_mm256_set1_ps(p.ay[k]), ey)), _mm256_mul_ps(_mm256_set1_ps(p.az[k]), ez));
+			visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_add_ps(dist, r), _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+		return static_cast<uint32_t>(_mm256_movemask_ps(visible));
+	}
+
+	inline uint32_t sphereBlockMask(const Planes& p, const SphereSoA& spheres, size_t i)
+	{
+		const __m256 cx = _mm256_loadu_ps(&spheres.centerX[i]), cy = _mm256_loadu_ps(&spheres.centerY[i]), cz = _mm256_loadu_ps(&spheres.centerZ[i]);
+		const __m256 radius = _mm256_loadu_ps(&spheres.radius[i]);
+		__m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int k = 0; k < 6; ++k)
+		{
+			__m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(p.nx[k]), cx),
+				_mm256_mul_ps(_mm256_set1_ps(p.ny[k]), cy)), _mm256_mul_ps(_mm256_set1_ps(p.nz[k]), cz));
+			dist = _mm256_sub_ps(dist, _mm256_set1_ps(p.d[k]));
+			visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_add_ps(dist, radius), _mm256_setzero_ps(), _CMP_GT_OQ));
+		}
+		return static_cast<uint32_t>(_mm256_movemask_ps(visible));
+	}
+#elif BATCH_CULLING_WIDTH == 4
+	inline uint32_t aabbBlockMask(const Planes& p, const AABBSoA& boxes, size_t i)
+	{
+		const __m128 cx = _mm_loadu_ps(&boxes.centerX[i]), cy = _mm_loadu_ps(&boxes.centerY[i]), cz = _mm_loadu_ps(&boxes.centerZ[i]);
+		const __m128 ex = _mm_loadu_ps(&boxes.extentX[i]), ey = _mm_loadu_ps(&boxes.extentY[i]), ez = _mm_loadu_ps(&boxes.extentZ[i]);
+		__m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int k = 0; k < 6; ++k)
+		{
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.nx[k]), cx),
+				_mm_mul_ps(_mm_set1_ps(p.ny[k]), cy)), _mm_mul_ps(_mm_set1_ps(p.nz[k]), cz));
+			dist = _mm_sub_ps(dist, _mm_set1_ps(p.d[k]));
+			const __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.ax[k]), ex),
+				_mm_mul_ps(_mm_set1_ps(p.ay[k]), ey)), _mm_mul_ps(_mm_set1_ps(p.az[k]), ez));
+			visible = _mm_and_ps(visible, _mm_cmpge_ps(_mm_add_ps(dist, r), _mm_setzero_ps()));
+		}
+		return static_cast<uint32_t>(_mm_movemask_ps(visible));
+	}
+
+	inline uint32_t sphereBlockMask(const Planes& p, const SphereSoA& spheres, size_t i)
+	{
+		const __m128 cx = _mm_loadu_ps(&spheres.centerX[i]), cy = _mm_loadu_ps(&spheres.centerY[i]), cz = _mm_loadu_ps(&spheres.centerZ[i]);
+		const __m128 radius = _mm_loadu_ps(&spheres.radius[i]);
+		__m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int k = 0; k < 6; ++k)
+		{
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.nx[k]), cx),
+				_mm_mul_ps(_mm_set1_ps(p.ny[k]), cy)), _mm_mul_ps(_mm_set1_ps(p.nz[k]), cz));
+			dist = _mm_sub_ps(dist, _mm_set1_ps(p.d[k]));
+			visible = _mm_and_ps(visible, _mm_cmpgt_ps(_mm_add_ps(dist, radius), _mm_setzero_ps()));
+		}
+		return static_cast<uint32_t>(_mm_movemask_ps(visible));
+	}
+#else
+	inline uint32_t aabbBlockMask(const Planes& p, const AABBSoA& boxes, size_t i)
+	{
+		return isAABBVisible(p, boxes, i) ? 1u : 0u;
+	}
+
+	inline uint32_t sphereBlockMask(const Planes& p, const SphereSoA& spheres, size_t i)
+	{
+		return isSphereVisible(p, spheres, i) ? 1u : 0u;
+	}
+#endif
+
+	inline int countTrailingZeros(uint64_t value)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward64(&index, value);
+		return static_cast<int>(index);
+#else
+		return __builtin_ctzll(value);
+#endif
+	}
+
+	//Shared driver: full SIMD blocks, then the remainder one by one. Bit i of visibleMask is volume i.
+	template<typename TVolumes, typename TBlockTest, typename TScalarTest>
+	void cullToMask(const TVolumes& volumes, std::vector<uint64_t>& visibleMask, TBlockTest blockTest, TScalarTest scalarTest)
+	{
+		const size_t count = volumes.size();
+		visibleMask.assign((count + 63) / 64, 0);
+
+		size_t i = 0;
+		for (; i + BATCH_CULLING_WIDTH <= count; i += BATCH_CULLING_WIDTH)
+		{
+			//Blocks never straddle two words as 64 is a multiple of every width
+			visibleMask[i / 64] |= static_cast<uint64_t>(blockTest(i)) << (i % 64);
+		}
+		for (; i < count; ++i)
+		{
+			if (scalarTest(i))
+				visibleMask[i / 64] |= uint64_t(1) << (i % 64);
+		}
+	}
+}
+
+//Test every box against the six planes, one bit per box in visibleMask
+inline void cullAABBs(const Frustum& frustum, const AABBSoA& boxes, std::vector<uint64_t>& visibleMask)
+{
+	const batch_culling_detail::Planes planes(frustum);
+	batch_culling_detail::cullToMask(boxes, visibleMask,
+		[&](size_t i) { return batch_culling_detail::aabbBlockMask(planes, boxes, i); },
+		[&](size_t i) { return batch_culling_detail::isAABBVisible(planes, boxes, i); });
+}
+
+inline void cullSpheres(const Frustum& frustum, const SphereSoA& spheres, std::vector<uint64_t>& visibleMask)
+{
+	const batch_culling_detail::Planes planes(frustum);
+	batch_culling_detail::cullToMask(spheres, visibleMask,
+		[&](size_t i) { return batch_culling_detail::sphereBlockMask(planes, spheres, i); },
+		[&](size_t i) { return batch_culling_detail::isSphereVisible(planes, spheres, i); });
+}
+
+//Compact a visibility mask in the list of visible indices, in ascending order
+inline void visibleMaskToIndices(const std::vector<uint64_t>& visibleMask, std::vector<uint32_t>& visibleIndices)
+{
+	visibleIndices.clear();
+	for (size_t word = 0; word < visibleMask.size(); ++word)
+	{
+		for (uint64_t bits = visibleMask[word]; bits; bits &= bits - 1)
+			visibleIndices.push_back(static_cast<uint32_t>(word * 64 + batch_culling_detail::countTrailingZeros(bits)));
+	}
+}
+#endif
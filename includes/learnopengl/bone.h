@@ -3,29 +3,81 @@
 /* Container for bone data */
 
 #include <vector>
+#include <algorithm>
 #include <assimp/scene.h>
 #include <list>
 #include <glm/glm.hpp>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/quaternion.hpp>
 #include <learnopengl/assimp_glm_helpers.h>
+#include <learnopengl/clip_compression.h>
 
-struct KeyPosition
+/* Keyframes of one channel, times and values in separate arrays so the key search only walks the times */
+template<typename T>
+struct KeyTrack
 {
-	glm::vec3 position;
-	float timeStamp;
-};
+	std::vector<float> times;
+	std::vector<T> values;
 
-struct KeyRotation
-{
-	glm::quat orientation;
-	float timeStamp;
+	int Size() const { return static_cast<int>(times.size()); }
+
+	void Add(float timeStamp, const T& value)
+	{
+		times.push_back(timeStamp);
+		values.push_back(value);
+	}
+
+	/* Index i of the key pair [i, i + 1] around animationTime, clamped to the first and last pair.
+	   cursor is the pair found by the previous call: playback moves forward by less than a key per frame
+	   most of the time, so the next pair or two are checked before falling back to a binary search. */
+	int FindKey(float animationTime, int& cursor) const
+	{
+		const int lastPair = Size() - 2;
+		if (lastPair <= 0)
+			return cursor = 0;
+
+		int index = std::min(std::max(cursor, 0), lastPair);
+		for (int step = 0; step < 2 && index < lastPair && animationTime >= times[index + 1]; ++step)
+			++index;
+
+		if (animationTime < times[index] || (index < lastPair && animationTime >= times[index + 1]))
+			index = FindKey(animationTime);
+
+		cursor = index;
+		return index;
+	}
+
+	/* Same without cursor, binary search over the times */
+	int FindKey(float animationTime) const
+	{
+		if (Size() <= 2)
+			return 0;
+		const auto next = std::upper_bound(times.begin() + 1, times.end() - 1, animationTime);
+		return static_cast<int>(next - times.begin()) - 1;
+	}
+
+	/* Value at animationTime, the first or last key outside of the track. interpolate also decodes packed keys,
+	   so the result is whatever it returns. */
+	template<typename TInterpolate>
+	auto Sample(float animationTime, int& cursor, TInterpolate&& interpolate) const -> decltype(interpolate(values[0], values[0], 0.0f))
+	{
+		if (Size() == 1)
+			return interpolate(values[0], values[0], 0.0f);
+
+		const int p0Index = FindKey(animationTime, cursor);
+		const int p1Index = p0Index + 1;
+		const float framesDiff = times[p1Index] - times[p0Index];
+		const float scaleFactor = framesDiff > 0.0f ? glm::clamp((animationTime - times[p0Index]) / framesDiff, 0.0f, 1.0f) : 0.0f;
+		return interpolate(values[p0Index], values[p1Index], scaleFactor);
+	}
 };
 
-struct KeyScale
+/* Key search state of one bone for one animation instance */
+struct BoneCursor
 {
-	glm::vec3 scale;
-	float timeStamp;
+	int position = 0;
+	int rotation = 0;
+	int scale = 0;
 };
 
 class Bone
@@ -37,149 +89,233 @@ public:
 		m_ID(ID),
 		m_LocalTransform(1.0f)
 	{
-		m_NumPositions = channel->mNumPositionKeys;
-
-		for (int positionIndex = 0; positionIndex < m_NumPositions; ++positionIndex)
+		m_Positions.times.reserve(channel->mNumPositionKeys);
+		m_Positions.values.reserve(channel->mNumPositionKeys);
+		for (unsigned int positionIndex = 0; positionIndex < channel->mNumPositionKeys; ++positionIndex)
 		{
 			aiVector3D aiPosition = channel->mPositionKeys[positionIndex].mValue;
 			float timeStamp = channel->mPositionKeys[positionIndex].mTime;
-			KeyPosition data;
-			data.position = AssimpGLMHelpers::GetGLMVec(aiPosition);
-			data.timeStamp = timeStamp;
-			m_Positions.push_back(data);
+			m_Positions.Add(timeStamp, AssimpGLMHelpers::GetGLMVec(aiPosition));
 		}
 
-		m_NumRotations = channel->mNumRotationKeys;
-		for (int rotationIndex = 0; rotationIndex < m_NumRotations; ++rotationIndex)
+		m_Rotations.times.reserve(channel->mNumRotationKeys);
+		m_Rotations.values.reserve(channel->mNumRotationKeys);
+		for (unsigned int rotationIndex = 0; rotationIndex < channel->mNumRotationKeys; ++rotationIndex)
 		{
 			aiQuaternion aiOrientation = channel->mRotationKeys[rotationIndex].mValue;
 			float timeStamp = channel->mRotationKeys[rotationIndex].mTime;
-			KeyRotation data;
-			data.orientation = AssimpGLMHelpers::GetGLMQuat(aiOrientation);
-			data.timeStamp = timeStamp;
-			m_Rotations.push_back(data);
+			m_Rotations.Add(timeStamp, glm::normalize(AssimpGLMHelpers::GetGLMQuat(aiOrientation)));
 		}
 
-		m_NumScalings = channel->mNumScalingKeys;
-		for (int keyIndex = 0; keyIndex < m_NumScalings; ++keyIndex)
+		m_Scales.times.reserve(channel->mNumScalingKeys);
+		m_Scales.values.reserve(channel->mNumScalingKeys);
+		for (unsigned int keyIndex = 0; keyIndex < channel->mNumScalingKeys; ++keyIndex)
 		{
 			aiVector3D scale = channel->mScalingKeys[keyIndex].mValue;
 			float timeStamp = channel->mScalingKeys[keyIndex].mTime;
-			KeyScale data;
-			data.scale = AssimpGLMHelpers::GetGLMVec(scale);
-			data.timeStamp = timeStamp;
-			m_Scales.push_back(data);
+			m_Scales.Add(timeStamp, AssimpGLMHelpers::GetGLMVec(scale));
 		}
+
+		/* A channel may leave a component without keys, it keeps its rest value then */
+		if (m_Positions.Size() == 0)
+			m_Positions.Add(0.0f, glm::vec3(0.0f));
+		if (m_Rotations.Size() == 0)
+			m_Rotations.Add(0.0f, glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+		if (m_Scales.Size() == 0)
+			m_Scales.Add(0.0f, glm::vec3(1.0f));
 	}
-	
+
+	/* Samples with the cursor of the bone itself, for a single instance of the animation */
 	void Update(float animationTime)
 	{
-		glm::mat4 translation = InterpolatePosition(animationTime);
-		glm::mat4 rotation = InterpolateRotation(animationTime);
-		glm::mat4 scale = InterpolateScaling(animationTime);
-		m_LocalTransform = translation * rotation * scale;
+		m_LocalTransform = Sample(animationTime, m_Cursor);
 	}
-	glm::mat4 GetLocalTransform() { return m_LocalTransform; }
-	std::string GetBoneName() const { return m_Name; }
-	int GetBoneID() { return m_ID; }
-	
 
+	/* Local transform at animationTime. Instances sharing the animation each pass their own cursor. */
+	glm::mat4 Sample(float animationTime, BoneCursor& cursor) const
+	{
+		glm::vec3 position, scale;
+		glm::quat rotation;
+		SampleTRS(animationTime, cursor, position, rotation, scale);
+
+		glm::mat4 transform = glm::toMat4(rotation);
+		transform[0] *= scale.x;
+		transform[1] *= scale.y;
+		transform[2] *= scale.z;
+		transform[3] = glm::vec4(position, 1.0f);
+		return transform;
+	}
 
-	int GetPositionIndex(float animationTime)
+	/* Same, left as translation, rotation and scale */
+	void SampleTRS(float animationTime, BoneCursor& cursor, glm::vec3& position, glm::quat& rotation, glm::vec3& scale) const
 	{
-		for (int index = 0; index < m_NumPositions - 1; ++index)
+		if (m_Compressed)
 		{
-			if (animationTime < m_Positions[index + 1].timeStamp)
-				return index;
+			position = InterpolatePackedPosition(animationTime, cursor.position);
+			rotation = InterpolatePackedRotation(animationTime, cursor.rotation);
+			scale = InterpolatePackedScaling(animationTime, cursor.scale);
+		}
+		else
+		{
+			position = InterpolatePosition(animationTime, cursor.position);
+			rotation = InterpolateRotation(animationTime, cursor.rotation);
+			scale = InterpolateScaling(animationTime, cursor.scale);
 		}
-		assert(0);
 	}
 
-	int GetRotationIndex(float animationTime)
+	glm::mat4 GetLocalTransform() { return m_LocalTransform; }
+	std::string GetBoneName() const { return m_Name; }
+	int GetBoneID() const { return m_ID; }
+
+	int GetPositionIndex(float animationTime) const
 	{
-		for (int index = 0; index < m_NumRotations - 1; ++index)
-		{
-			if (animationTime < m_Rotations[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		return m_Positions.FindKey(animationTime);
 	}
 
-	int GetScaleIndex(float animationTime)
+	int GetRotationIndex(float animationTime) const
 	{
-		for (int index = 0; index < m_NumScalings - 1; ++index)
-		{
-			if (animationTime < m_Scales[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		return m_Rotations.FindKey(animationTime);
 	}
 
+	int GetScaleIndex(float animationTime) const
+	{
+		return m_Scales.FindKey(animationTime);
+	}
 
-private:
+	/* Full float keys, empty once the bone is compressed */
+	const KeyTrack<glm::vec3>& GetPositions() const { return m_Positions; }
+	const KeyTrack<glm::quat>& GetRotations() const { return m_Rotations; }
+	const KeyTrack<glm::vec3>& GetScales() const { return m_Scales; }
+	bool IsCompressed() const { return m_Compressed; }
 
-	float GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime)
+	/* Replaces the keys by packed ones: positions and scales quantized against the ranges of the clip, rotations
+	   as smallest three. Keys rebuilt by interpolation within the tolerances are removed. The full float keys are
+	   released, the report holds the sizes and the largest error at the original keys. */
+	ClipCompressionReport Compress(const QuantizationRange& positionRange, const QuantizationRange& scaleRange,
+		float translationTolerance, float rotationTolerance, float scaleTolerance)
 	{
-		float scaleFactor = 0.0f;
-		float midWayLength = animationTime - lastTimeStamp;
-		float framesDiff = nextTimeStamp - lastTimeStamp;
-		scaleFactor = midWayLength / framesDiff;
-		return scaleFactor;
+		ClipCompressionReport report;
+		if (m_Compressed)
+			return report;
+
+		m_PositionRange = positionRange;
+		m_ScaleRange = scaleRange;
+		report.originalKeys = m_Positions.Size() + m_Rotations.Size() + m_Scales.Size();
+		report.originalBytes = m_Positions.Size() * (sizeof(float) + sizeof(glm::vec3))
+			+ m_Rotations.Size() * (sizeof(float) + sizeof(glm::quat)) + m_Scales.Size() * (sizeof(float) + sizeof(glm::vec3));
+
+		const auto vec3Error = [](const glm::vec3& a, const glm::vec3& b) { return glm::distance(a, b); };
+		const auto mixVec3 = [](const glm::vec3& a, const glm::vec3& b, float factor) { return glm::mix(a, b, factor); };
+		const auto slerpQuat = [](const glm::quat& a, const glm::quat& b, float factor) { return glm::normalize(glm::slerp(a, b, factor)); };
+
+		m_PackedPositions = PackTrack(m_Positions, translationTolerance, mixVec3, vec3Error,
+			[&](const glm::vec3& value) { return PackVec3(value, m_PositionRange); },
+			[&](const PackedVec3& packed) { return UnpackVec3(packed, m_PositionRange); });
+		m_PackedRotations = PackTrack(m_Rotations, rotationTolerance, slerpQuat, RotationError, PackQuat, UnpackQuat);
+		m_PackedScales = PackTrack(m_Scales, scaleTolerance, mixVec3, vec3Error,
+			[&](const glm::vec3& value) { return PackVec3(value, m_ScaleRange); },
+			[&](const PackedVec3& packed) { return UnpackVec3(packed, m_ScaleRange); });
+		m_Compressed = true;
+
+		/* Errors of the track actually played back, at every original key */
+		BoneCursor cursor;
+		for (int i = 0; i < m_Positions.Size(); ++i)
+			report.maxTranslationError = std::max(report.maxTranslationError,
+				vec3Error(InterpolatePackedPosition(m_Positions.times[i], cursor.position), m_Positions.values[i]));
+		for (int i = 0; i < m_Rotations.Size(); ++i)
+			report.maxRotationError = std::max(report.maxRotationError,
+				RotationError(InterpolatePackedRotation(m_Rotations.times[i], cursor.rotation), m_Rotations.values[i]));
+		for (int i = 0; i < m_Scales.Size(); ++i)
+			report.maxScaleError = std::max(report.maxScaleError,
+				vec3Error(InterpolatePackedScaling(m_Scales.times[i], cursor.scale), m_Scales.values[i]));
+
+		report.compressedKeys = m_PackedPositions.Size() + m_PackedRotations.Size() + m_PackedScales.Size();
+		report.compressedBytes = m_PackedPositions.Size() * (sizeof(float) + sizeof(PackedVec3))
+			+ m_PackedRotations.Size() * (sizeof(float) + sizeof(PackedQuat)) + m_PackedScales.Size() * (sizeof(float) + sizeof(PackedVec3));
+
+		m_Positions = KeyTrack<glm::vec3>();
+		m_Rotations = KeyTrack<glm::quat>();
+		m_Scales = KeyTrack<glm::vec3>();
+		m_Cursor = BoneCursor();
+		return report;
 	}
 
-	glm::mat4 InterpolatePosition(float animationTime)
+private:
+	template<typename T, typename TInterpolate, typename TError, typename TPack, typename TUnpack>
+	static auto PackTrack(const KeyTrack<T>& track, float tolerance, TInterpolate&& interpolate, TError&& error, TPack&& pack, TUnpack&& unpack)
+		-> KeyTrack<decltype(pack(track.values[0]))>
 	{
-		if (1 == m_NumPositions)
-			return glm::translate(glm::mat4(1.0f), m_Positions[0].position);
+		KeyTrack<decltype(pack(track.values[0]))> packedTrack;
+		std::vector<T> decoded;
+		decoded.reserve(track.values.size());
+		for (const T& value : track.values)
+			decoded.push_back(unpack(pack(value)));
 
-		int p0Index = GetPositionIndex(animationTime);
-		int p1Index = p0Index + 1;
-		float scaleFactor = GetScaleFactor(m_Positions[p0Index].timeStamp,
-			m_Positions[p1Index].timeStamp, animationTime);
-		glm::vec3 finalPosition = glm::mix(m_Positions[p0Index].position, m_Positions[p1Index].position
-			, scaleFactor);
-		return glm::translate(glm::mat4(1.0f), finalPosition);
+		for (int index : ReduceKeys(track.times, track.values, decoded, tolerance, interpolate, error))
+			packedTrack.Add(track.times[index], pack(track.values[index]));
+		return packedTrack;
 	}
 
-	glm::mat4 InterpolateRotation(float animationTime)
+	glm::vec3 InterpolatePosition(float animationTime, int& cursor) const
 	{
-		if (1 == m_NumRotations)
-		{
-			auto rotation = glm::normalize(m_Rotations[0].orientation);
-			return glm::toMat4(rotation);
-		}
+		return m_Positions.Sample(animationTime, cursor, [](const glm::vec3& p0, const glm::vec3& p1, float scaleFactor)
+			{
+				return glm::mix(p0, p1, scaleFactor);
+			});
+	}
+
+	glm::quat InterpolateRotation(float animationTime, int& cursor) const
+	{
+		return m_Rotations.Sample(animationTime, cursor, [](const glm::quat& r0, const glm::quat& r1, float scaleFactor)
+			{
+				return glm::normalize(glm::slerp(r0, r1, scaleFactor));
+			});
+	}
 
-		int p0Index = GetRotationIndex(animationTime);
-		int p1Index = p0Index + 1;
-		float scaleFactor = GetScaleFactor(m_Rotations[p0Index].timeStamp,
-			m_Rotations[p1Index].timeStamp, animationTime);
-		glm::quat finalRotation = glm::slerp(m_Rotations[p0Index].orientation, m_Rotations[p1Index].orientation
-			, scaleFactor);
-		finalRotation = glm::normalize(finalRotation);
-		return glm::toMat4(finalRotation);
+	glm::vec3 InterpolateScaling(float animationTime, int& cursor) const
+	{
+		return m_Scales.Sample(animationTime, cursor, [](const glm::vec3& s0, const glm::vec3& s1, float scaleFactor)
+			{
+				return glm::mix(s0, s1, scaleFactor);
+			});
+	}
 
+	glm::vec3 InterpolatePackedPosition(float animationTime, int& cursor) const
+	{
+		return m_PackedPositions.Sample(animationTime, cursor, [this](const PackedVec3& p0, const PackedVec3& p1, float scaleFactor)
+			{
+				return glm::mix(UnpackVec3(p0, m_PositionRange), UnpackVec3(p1, m_PositionRange), scaleFactor);
+			});
 	}
 
-	glm::mat4 InterpolateScaling(float animationTime)
+	glm::quat InterpolatePackedRotation(float animationTime, int& cursor) const
 	{
-		if (1 == m_NumScalings)
-			return glm::scale(glm::mat4(1.0f), m_Scales[0].scale);
+		return m_PackedRotations.Sample(animationTime, cursor, [](const PackedQuat& r0, const PackedQuat& r1, float scaleFactor)
+			{
+				return glm::normalize(glm::slerp(UnpackQuat(r0), UnpackQuat(r1), scaleFactor));
+			});
+	}
 
-		int p0Index = GetScaleIndex(animationTime);
-		int p1Index = p0Index + 1;
-		float scaleFactor = GetScaleFactor(m_Scales[p0Index].timeStamp,
-			m_Scales[p1Index].timeStamp, animationTime);
-		glm::vec3 finalScale = glm::mix(m_Scales[p0Index].scale, m_Scales[p1Index].scale
-			, scaleFactor);
-		return glm::scale(glm::mat4(1.0f), finalScale);
+	glm::vec3 InterpolatePackedScaling(float animationTime, int& cursor) const
+	{
+		return m_PackedScales.Sample(animationTime, cursor, [this](const PackedVec3& s0, const PackedVec3& s1, float scaleFactor)
+			{
+				return glm::mix(UnpackVec3(s0, m_ScaleRange), UnpackVec3(s1, m_ScaleRange), scaleFactor);
+			});
 	}
 
-	std::vector<KeyPosition> m_Positions;
-	std::vector<KeyRotation> m_Rotations;
-	std::vector<KeyScale> m_Scales;
-	int m_NumPositions;
-	int m_NumRotations;
-	int m_NumScalings;
+	KeyTrack<glm::vec3> m_Positions;
+	KeyTrack<glm::quat> m_Rotations;
+	KeyTrack<glm::vec3> m_Scales;
+	BoneCursor m_Cursor;
+
+	/* Used instead of the tracks above once compressed */
+	bool m_Compressed = false;
+	KeyTrack<PackedVec3> m_PackedPositions;
+	KeyTrack<PackedQuat> m_PackedRotations;
+	KeyTrack<PackedVec3> m_PackedScales;
+	QuantizationRange m_PositionRange;
+	QuantizationRange m_ScaleRange;
 
 	glm::mat4 m_LocalTransform;
 	std::string m_Name;
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <algorithm>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+/* Where a palette was written in a BonePaletteBuffer */
+struct BonePaletteRange
+{
+	GLintptr offset = 0;
+	GLsizeiptr size = 0;
+	int boneCount = 0;
+};
+
+/* Final bone matrices of every character of a frame in one buffer object, written straight into mapped memory.
+   Only the three rows of the 3x4 affine part of each matrix are stored, as vec4: 48 bytes per bone instead of 64.
+   Each palette gets its own range, bound with glBindBufferRange before drawing its character.
+
+   With GL_SHADER_STORAGE_BUFFER (GL 4.3) the shader declares
+       layout(std430, binding = 0) readonly buffer BonePalettes { vec4 bonePalettes[]; };
+   and finds the bone count of the bound range with bonePalettes.length() / 3, so it has no limit but the buffer
+   size. GL_UNIFORM_BUFFER works with GL 3.3, a range then holds at most GL_MAX_UNIFORM_BLOCK_SIZE / 48 bones.
+
+   Per frame: Begin, Write every palette, End, then Bind the range of each character before its draw. */
+class BonePaletteBuffer
+{
+public:
+	explicit BonePaletteBuffer(GLenum target = GL_SHADER_STORAGE_BUFFER, GLuint binding = 0)
+		: m_Target(target), m_Binding(binding)
+	{
+		glGenBuffers(1, &m_Buffer);
+		GLint alignment = 0;
+		glGetIntegerv(target == GL_UNIFORM_BUFFER ? GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT : GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		m_Alignment = std::max<GLintptr>(alignment, sizeof(glm::vec4));
+		if (target == GL_UNIFORM_BUFFER)
+		{
+			GLint maxBlockSize = 0;
+			glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &maxBlockSize);
+			m_MaxBones = maxBlockSize / static_cast<int>(BYTES_PER_BONE);
+		}
+	}
+
+	~BonePaletteBuffer()
+	{
+		End();
+		glDeleteBuffers(1, &m_Buffer);
+	}
+
+	BonePaletteBuffer(const BonePaletteBuffer&) = delete;
+	BonePaletteBuffer& operator=(const BonePaletteBuffer&) = delete;
+
+	/* Maps room for paletteCount palettes of boneCount bones in total. The previous content is discarded, the
+	   driver hands out fresh memory while the draws of the last frame still read the old one. */
+	void Begin(size_t boneCount, size_t paletteCount)
+	{
+		const GLsizeiptr capacity = static_cast<GLsizeiptr>(boneCount * BYTES_PER_BONE + paletteCount * m_Alignment);
+		glBindBuffer(m_Target, m_Buffer);
+		if (capacity > m_Capacity)
+		{
+			m_Capacity = std::max(capacity, m_Capacity * 2);
+			glBufferData(m_Target, m_Capacity, nullptr, GL_STREAM_DRAW);
+		}
+		m_Mapped = static_cast<unsigned char*>(glMapBufferRange(m_Target, 0, m_Capacity, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+		m_Used = 0;
+	}
+
+	/* Reserves the range of a palette of boneCount bones, its rows are filled with WriteRows(GetRows(range), ...).
+	   Allocate and Write are called from one thread only, they bump the used size without locking. The ranges once
+	   allocated can be filled by WriteRows from different threads. */
+	BonePaletteRange Allocate(int boneCount)
+	{
+		assert(m_Mapped);
+		BonePaletteRange range;
+		range.boneCount = m_MaxBones > 0 ? std::min(boneCount, m_MaxBones) : boneCount;
+		range.offset = (m_Used + m_Alignment - 1) / m_Alignment * m_Alignment;
+		range.size = static_cast<GLsizeiptr>(range.boneCount * BYTES_PER_BONE);
+		assert(range.offset + range.size <= m_Capacity);
+		m_Used = range.offset + range.size;
+		return range;
+	}
+
+	glm::vec4* GetRows(const BonePaletteRange& range) const
+	{
+		return reinterpret_cast<glm::vec4*>(m_Mapped + range.offset);
+	}
+
+	/* Allocates and fills the range of a palette */
+	BonePaletteRange Write(const glm::mat4* palette, int boneCount)
+	{
+		const BonePaletteRange range = Allocate(boneCount);
+		WriteRows(GetRows(range), palette, range.boneCount);
+		return range;
+	}
+
+	/* Unmaps the buffer, the ranges written since Begin can be bound */
+	void End()
+	{
+		if (!m_Mapped)
+			return;
+		glBindBuffer(m_Target, m_Buffer);
+		glUnmapBuffer(m_Target);
+		glBindBuffer(m_Target, 0);
+		m_Mapped = nullptr;
+	}
+
+	/* One call per draw, the shader reads the palette at the binding point of the buffer. The range must hold at
+	   least one bone. */
+	void Bind(const BonePaletteRange& range) const
+	{
+		glBindBufferRange(m_Target, m_Binding, m_Buffer, range.offset, range.size);
+	}
+
+	/* The three rows of the affine part of each matrix. Written in order, the mapped memory may be write combined. */
+	static void WriteRows(glm::vec4* rows, const glm::mat4* palette, int boneCount)
+	{
+		for (int bone = 0; bone < boneCount; ++bone)
+		{
+			const glm::mat4& m = palette[bone];
+			rows[bone * 3 + 0] = glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+			rows[bone * 3 + 1] = glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+			rows[bone * 3 + 2] = glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+		}
+	}
+
+	/* Most bones a range can hold, 0 for no limit */
+	int GetMaxBones() const { return m_MaxBones; }
+	GLsizeiptr GetCapacity() const { return m_Capacity; }
+	GLintptr GetUsedBytes() const { return m_Used; }
+
+	static constexpr size_t BYTES_PER_BONE = 3 * sizeof(glm::vec4);
+
+private:
+	GLenum m_Target;
+	GLuint m_Binding;
+	GLuint m_Buffer = 0;
+	GLintptr m_Alignment = sizeof(glm::vec4);
+	GLsizeiptr m_Capacity = 0;
+	GLintptr m_Used = 0;
+	unsigned char* m_Mapped = nullptr;
+	int m_MaxBones = 0;
+};
@@ -0,0 +1,113 @@
+#ifndef BOUNDING_BOX_H
+#define BOUNDING_BOX_H
+
+#include <glm/glm.hpp>
+
+#include <cmath> //std::isinf
+#include <limits> //std::numeric_limits
+#include <algorithm> //std::min, std::max
+
+//Axis aligned box stored as min/max corners. Cheaper than the center/extents AABB of entity.h to merge and
+//compare, which is what acceleration structures mostly do.
+struct BoundingBox
+{
+	glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+	glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+
+	BoundingBox() = default;
+
+	BoundingBox(const glm::vec3& inMin, const glm::vec3& inMax)
+		: min{ inMin }, max{ inMax }
+	{}
+
+	static BoundingBox fromCenterExtents(const glm::vec3& center, const glm::vec3& extents)
+	{
+		return BoundingBox(center - extents, center + extents);
+	}
+
+	//Empty until a point or a box is merged in
+	bool isValid() const
+	{
+		return min.x <= max.x && min.y <= max.y && min.z <= max.z;
+	}
+
+	glm::vec3 getCenter() const
+	{
+		return (min + max) * 0.5f;
+	}
+
+	glm::vec3 getExtents() const
+	{
+		return (max - min) * 0.5f;
+	}
+
+	//Half the surface area, enough to compare insertion costs
+	float getHalfSurfaceArea() const
+	{
+		const glm::vec3 d = max - min;
+		return d.x * d.y + d.y * d.z + d.z * d.x;
+	}
+
+	void merge(const glm::vec3& point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	void merge(const BoundingBox& other)
+	{
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+	static BoundingBox merged(const BoundingBox& a, const BoundingBox& b)
+	{
+		return BoundingBox(glm::min(a.min, b.min), glm::max(a.max, b.max));
+	}
+
+	bool contains(const BoundingBox& other) const
+	{
+		return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z &&
+			other.max.x <= max.x && other.max.y <= max.y && other.max.z <= max.z;
+	}
+
+	bool overlaps(const BoundingBox& other) const
+	{
+		return min.x <= other.max.x && other.min.x <= max.x &&
+			min.y <= other.max.y && other.min.y <= max.y &&
+			min.z <= other.max.z && other.min.z <= max.z;
+	}
+
+	bool overlapsSphere(const glm::vec3& center, float radius) const
+	{
+		const glm::vec3 closest = glm::clamp(center, min, max);
+		const glm::vec3 d = closest - center;
+		return glm::dot(d, d) <= radius * radius;
+	}
+
+	//Slab test. invDir is 1 / direction, tMax the farthest hit accepted. Returns the entry distance in tHit.
+	//A zero direction component gives an infinite invDir, that axis is then only tested for the origin being
+	//inside the slab: on its planes (min - origin) * invDir would be 0 * inf = NaN.
+	bool intersectsRay(const glm::vec3& origin, const glm::vec3& invDir, float tMax, float& tHit) const
+	{
+		float enter = 0.f;
+		float exit = tMax;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (std::isinf(invDir[axis]))
+			{
+				if (origin[axis] < min[axis] || origin[axis] > max[axis])
+					return false;
+				continue;
+			}
+
+			const float t0 = (min[axis] - origin[axis]) * invDir[axis];
+			const float t1 = (max[axis] - origin[axis]) * invDir[axis];
+			enter = std::max(enter, std::min(t0, t1));
+			exit = std::min(exit, std::max(t0, t1));
+		}
+		tHit = enter;
+		return enter <= exit;
+	}
+};
+#endif
@@ -0,0 +1,458 @@
+#ifndef BOUNDS_BUILDER_H
+#define BOUNDS_BUILDER_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/bounding_box.h>
+#include <learnopengl/job_system.h>
+
+#include <vector> //std::vector
+#include <cmath> //std::sqrt, std::abs
+#include <cstddef> //size_t
+#include <algorithm> //std::min, std::max
+#include <limits> //std::numeric_limits
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define BOUNDS_BUILDER_SSE 1
+#else
+#define BOUNDS_BUILDER_SSE 0
+#endif
+
+struct BoundingSphere
+{
+	glm::vec3 center{ 0.f, 0.f, 0.f };
+	float radius = -1.f; //Negative while empty
+
+	bool isValid() const
+	{
+		return radius >= 0.f;
+	}
+
+	bool contains(const glm::vec3& point, float tolerance = 0.f) const
+	{
+		const glm::vec3 d = point - center;
+		return glm::dot(d, d) <= (radius + tolerance) * (radius + tolerance);
+	}
+};
+
+//Box with its own orthonormal axes (columns of axes), extents measured along them
+struct OrientedBox
+{
+	glm::vec3 center{ 0.f, 0.f, 0.f };
+	glm::mat3 axes = glm::mat3(1.0f);
+	glm::vec3 extents{ 0.f, 0.f, 0.f };
+
+	float getVolume() const
+	{
+		return 8.f * extents.x * extents.y * extents.z;
+	}
+
+	//Axis aligned box enclosing this one
+	BoundingBox getEnclosingBox() const
+	{
+		const glm::vec3 e = glm::abs(axes[0]) * extents.x + glm::abs(axes[1]) * extents.y + glm::abs(axes[2]) * extents.z;
+		return BoundingBox::fromCenterExtents(center, e);
+	}
+
+	bool contains(const glm::vec3& point, float tolerance = 0.f) const
+	{
+		const glm::vec3 local = glm::transpose(axes) * (point - center);
+		return std::abs(local.x) <= extents.x + tolerance && std::abs(local.y) <= extents.y + tolerance && std::abs(local.z) <= extents.z + tolerance;
+	}
+};
+
+//Every volume of one mesh, in the space of its vertices
+struct MeshBounds
+{
+	BoundingBox box;
+	BoundingSphere sphere;
+	OrientedBox orientedBox;
+};
+
+//Strided view over vertex positions, so interleaved vertices are read in place:
+//PositionStream(&mesh.vertices[0].Position, mesh.vertices.size(), sizeof(Vertex))
+struct PositionStream
+{
+	const unsigned char* data = nullptr;
+	size_t count = 0;
+	size_t stride = sizeof(glm::vec3);
+
+	PositionStream() = default;
+
+	PositionStream(const glm::vec3* first, size_t inCount, size_t inStride = sizeof(glm::vec3))
+		: data{ reinterpret_cast<const unsigned char*>(first) }, count{ inCount }, stride{ inStride }
+	{}
+
+	const glm::vec3& operator[](size_t index) const
+	{
+		return *reinterpret_cast<const glm::vec3*>(data + index * stride);
+	}
+};
+
+namespace bounds_builder_detail
+{
+	//Smaller streams are reduced on the calling thread, splitting them costs more than it saves
+	constexpr size_t grain = 16384;
+
+	//Reduce [0, count) by chunks on the job system, then fold the partial results in order
+	template<typename TResult, typename TChunk, typename TMerge>
+	TResult reduce(JobSystem& jobSystem, size_t count, const TResult& identity, TChunk&& chunk, TMerge&& merge)
+	{
+		if (count <= grain)
+			return merge(identity, chunk(size_t(0), count));
+
+		const size_t chunkCount = (count + grain - 1) / grain;
+		std::vector<TResult> partials(chunkCount, identity);
+		jobSystem.parallelFor(0, chunkCount, 1, [&](size_t first, size_t last)
+			{
+				for (size_t i = first; i < last; ++i)
+					partials[i] = chunk(i * grain, std::min(count, (i + 1) * grain));
+			});
+
+		TResult result = identity;
+		for (auto&& partial : partials)
+			result = merge(result, partial);
+		return result;
+	}
+
+	inline BoundingBox computeBoxRange(const PositionStream& points, size_t first, size_t last)
+	{
+		BoundingBox box;
+		if (first == last)
+			return box;
+#if BOUNDS_BUILDER_SSE
+		//One unaligned load per point, the fourth lane is whatever follows the position and is ignored. The very
+		//last point of a packed vec3 array has nothing after it and is read the scalar way.
+		const size_t simdLast = points.stride >= sizeof(float) * 4 || last < points.count ? last : last - 1;
+		__m128 minA = _mm_set1_ps(box.min.x), maxA = _mm_set1_ps(box.max.x);
+		__m128 minB = minA, maxB = maxA;
+		size_t i = first;
+		for (; i + 1 < simdLast; i += 2)
+		{
+			const __m128 a = _mm_loadu_ps(&points[i].x);
+			const __m128 b = _mm_loadu_ps(&points[i + 1].x);
+			minA = _mm_min_ps(minA, a);
+			maxA = _mm_max_ps(maxA, a);
+			minB = _mm_min_ps(minB, b);
+			maxB = _mm_max_ps(maxB, b);
+		}
+		for (; i < simdLast; ++i)
+		{
+			const __m128 a = _mm_loadu_ps(&points[i].x);
+			minA = _mm_min_ps(minA, a);
+			maxA = _mm_max_ps(maxA, a);
+		}
+		alignas(16) float minValues[4], maxValues[4];
+		_mm_store_ps(minValues, _mm_min_ps(minA, minB));
+		_mm_store_ps(maxValues, _mm_max_ps(maxA, maxB));
+		box = BoundingBox({ minValues[0], minValues[1], minValues[2] }, { maxValues[0], maxValues[1], maxValues[2] });
+		for (; i < last; ++i)
+			box.merge(points[i]);
+#else
+		for (size_t i = first; i < last; ++i)
+			box.merge(points[i]);
+#endif
+		return box;
+	}
+
+	//Indices of the lowest and highest point along each axis
+	struct Extremes
+	{
+		size_t minIndex[3] = { 0, 0, 0 };
+		size_t maxIndex[3] = { 0, 0, 0 };
+		float minValue[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+		float maxValue[3] = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+	};
+
+	inline Extremes mergeExtremes(const Extremes& a, const Extremes& b)
+	{
+		Extremes result = a;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (b.minValue[axis] < result.minValue[axis])
+			{
+				result.minValue[axis] = b.minValue[axis];
+				result.minIndex[axis] = b.minIndex[axis];
+			}
+			if (b.maxValue[axis] > result.maxValue[axis])
+			{
+				result.maxValue[axis] = b.maxValue[axis];
+				result.maxIndex[axis] = b.maxIndex[axis];
+			}
+		}
+		return result;
+	}
+
+	inline void growSphere(BoundingSphere& sphere, const glm::vec3& point)
+	{
+		const glm::vec3 d = point - sphere.center;
+		const float distance2 = glm::dot(d, d);
+		if (distance2 <= sphere.radius * sphere.radius)
+			return;
+
+		//New sphere spans from the far side of the old one to the point
+		const float distance = std::sqrt(distance2);
+		const float newRadius = (sphere.radius + distance) * 0.5f;
+		sphere.center += d * ((newRadius - sphere.radius) / distance);
+		sphere.radius = newRadius;
+	}
+
+	//Largest squared distance to center, used to make the final radius exact
+	inline float computeMaxDistance2(const PositionStream& points, const glm::vec3& center, JobSystem& jobSystem)
+	{
+		return reduce(jobSystem, points.count, 0.f,
+			[&](size_t first, size_t last)
+			{
+				float result = 0.f;
+				for (size_t i = first; i < last; ++i)
+				{
+					const glm::vec3 d = points[i] - center;
+					result = std::max(result, glm::dot(d, d));
+				}
+				return result;
+			},
+			[](float a, float b) { return std::max(a, b); });
+	}
+
+	struct Moments
+	{
+		glm::dvec3 sum{ 0.0 };
+		double xx = 0.0, xy = 0.0, xz = 0.0, yy = 0.0, yz = 0.0, zz = 0.0;
+	};
+
+	//Eigenvectors of a symmetric matrix by cyclic Jacobi rotations, as columns of the result
+	inline glm::dmat3 computeEigenvectors(double a[3][3])
+	{
+		double v[3][3] = { { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 }, { 0.0, 0.0, 1.0 } };
+		for (int iteration = 0; iteration < 50; ++iteration)
+		{
+			//Zero the largest off diagonal element
+			int p = 0, q = 1;
+			if (std::abs(a[0][2]) > std::abs(a[p][q])) { p = 0; q = 2; }
+			if (std::abs(a[1][2]) > std::abs(a[p][q])) { p = 1; q = 2; }
+			const double scale = std::abs(a[0][0]) + std::abs(a[1][1]) + std::abs(a[2][2]);
+			if (std::abs(a[p][q]) <= 1e-12 * scale || a[p][q] == 0.0)
+				break;
+
+			const double r = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+			const double t = r >= 0.0 ? 1.0 / (r + std::sqrt(1.0 + r * r)) : -1.0 / (-r + std::sqrt(1.0 + r * r));
+			const double c = 1.0 / std::sqrt(1.0 + t * t);
+			const double s = t * c;
+
+			//a = J^T a J and v = v J with J the rotation in the (p, q) plane
+			for (int k = 0; k < 3; ++k)
+			{
+				const double akp = a[k][p], akq = a[k][q];
+				a[k][p] = c * akp - s * akq;
+				a[k][q] = s * akp + c * akq;
+			}
+			for (int k = 0; k < 3; ++k)
+			{
+				const double apk = a[p][k], aqk = a[q][k];
+				a[p][k] = c * apk - s * aqk;
+				a[q][k] = s * apk + c * aqk;
+			}
+			for (int k = 0; k < 3; ++k)
+			{
+				const double vkp = v[k][p], vkq = v[k][q];
+				v[k][p] = c * vkp - s * vkq;
+				v[k][q] = s * vkp + c * vkq;
+			}
+		}
+
+		glm::dmat3 vectors;
+		for (int column = 0; column < 3; ++column)
+			vectors[column] = glm::dvec3(v[0][column], v[1][column], v[2][column]);
+		return vectors;
+	}
+}
+
+//Axis aligned box of the points, SIMD per point and split across the job system for large streams
+inline BoundingBox computeBoundingBox(const PositionStream& points, JobSystem& jobSystem = JobSystem::instance())
+{
+	return bounds_builder_detail::reduce(jobSystem, points.count, BoundingBox{},
+		[&](size_t first, size_t last) { return bounds_builder_detail::computeBoxRange(points, first, last); },
+		[](const BoundingBox& a, const BoundingBox& b) { return BoundingBox::merged(a, b); });
+}
+
+//Ritter's sphere started from the farthest pair of axis extremes, then shrunk and regrown refinementPasses times
+//as in Ericson's iterative version. Usually within a few percent of the minimal sphere. The radius is finally set
+//to the exact farthest point, so every point is inside whatever the rounding errors.
+inline BoundingSphere computeBoundingSphere(const PositionStream& points, JobSystem& jobSystem = JobSystem::instance(), int refinementPasses = 8)
+{
+	using namespace bounds_builder_detail;
+	BoundingSphere sphere;
+	if (points.count == 0)
+		return sphere;
+
+	const Extremes extremes = reduce(jobSystem, points.count, Extremes{},
+		[&](size_t first, size_t last)
+		{
+			Extremes result;
+			for (size_t i = first; i < last; ++i)
+			{
+				const glm::vec3& point = points[i];
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					if (point[axis] < result.minValue[axis]) { result.minValue[axis] = point[axis]; result.minIndex[axis] = i; }
+					if (point[axis] > result.maxValue[axis]) { result.maxValue[axis] = point[axis]; result.maxIndex[axis] = i; }
+				}
+			}
+			return result;
+		},
+		mergeExtremes);
+
+	float bestDistance2 = -1.f;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const glm::vec3 d = points[extremes.maxIndex[axis]] - points[extremes.minIndex[axis]];
+		if (glm::dot(d, d) > bestDistance2)
+		{
+			bestDistance2 = glm::dot(d, d);
+			sphere.center = (points[extremes.maxIndex[axis]] + points[extremes.minIndex[axis]]) * 0.5f;
+			sphere.radius = std::sqrt(bestDistance2) * 0.5f;
+		}
+	}
+
+	//Growing depends on the previous points, this part stays serial
+	for (size_t i = 0; i < points.count; ++i)
+		growSphere(sphere, points[i]);
+
+	BoundingSphere candidate = sphere;
+	size_t start = 0;
+	for (int pass = 0; pass < refinementPasses; ++pass)
+	{
+		//Shrink and grow again, starting from another point each pass so the result depends less on the order
+		candidate.radius *= 0.95f;
+		start = (start + points.count / 3 + 1) % points.count;
+		for (size_t j = 0; j < points.count; ++j)
+		{
+			const size_t i = start + j < points.count ? start + j : start + j - points.count;
+			growSphere(candidate, points[i]);
+		}
+		if (candidate.radius < sphere.radius)
+			sphere = candidate;
+	}
+
+	sphere.radius = std::sqrt(computeMaxDistance2(points, sphere.center, jobSystem));
+	return sphere;
+}
+
+//Box aligned on the principal axes of the points (eigenvectors of their covariance). Falls back to the axis
+//aligned box when that one is smaller, which happens for shapes already aligned on the world axes.
+inline OrientedBox computeOrientedBox(const PositionStream& points, JobSystem& jobSystem = JobSystem::instance())
+{
+	using namespace bounds_builder_detail;
+	OrientedBox orientedBox;
+	if (points.count == 0)
+		return orientedBox;
+
+	//Raw moments in double, the covariance is derived from them in one pass
+	const Moments moments = reduce(jobSystem, points.count, Moments{},
+		[&](size_t first, size_t last)
+		{
+			Moments result;
+			for (size_t i = first; i < last; ++i)
+			{
+				const glm::dvec3 p = points[i];
+				result.sum += p;
+				result.xx += p.x * p.x; result.xy += p.x * p.y; result.xz += p.x * p.z;
+				result.yy += p.y * p.y; result.yz += p.y * p.z; result.zz += p.z * p.z;
+			}
+			return result;
+		},
+		[](const Moments& a, const Moments& b)
+		{
+			Moments result;
+			result.sum = a.sum + b.sum;
+			result.xx = a.xx + b.xx; result.xy = a.xy + b.xy; result.xz = a.xz + b.xz;
+			result.yy = a.yy + b.yy; result.yz = a.yz + b.yz; result.zz = a.zz + b.zz;
+			return result;
+		});
+
+	const double n = static_cast<double>(points.count);
+	const glm::dvec3 mean = moments.sum / n;
+	double covariance[3][3];
+	covariance[0][0] = moments.xx / n - mean.x * mean.x;
+	covariance[1][1] = moments.yy / n - mean.y * mean.y;
+	covariance[2][2] = moments.zz / n - mean.z * mean.z;
+	covariance[0][1] = covariance[1][0] = moments.xy / n - mean.x * mean.y;
+	covariance[0][2] = covariance[2][0] = moments.xz / n - mean.x * mean.z;
+	covariance[1][2] = covariance[2][1] = moments.yz / n - mean.y * mean.z;
+
+	const glm::dmat3 eigenvectors = computeEigenvectors(covariance);
+	glm::mat3 axes;
+	axes[0] = glm::normalize(glm::vec3(eigenvectors[0]));
+	axes[1] = glm::normalize(glm::vec3(eigenvectors[1]) - axes[0] * glm::dot(axes[0], glm::vec3(eigenvectors[1])));
+	axes[2] = glm::cross(axes[0], axes[1]);
+
+	//Extent of the points along each axis is the box of the points expressed in the axes frame
+	const glm::mat3 toLocal = glm::transpose(axes);
+	const BoundingBox localBox = reduce(jobSystem, points.count, BoundingBox{},
+		[&](size_t first, size_t last)
+		{
+			BoundingBox result;
+			for (size_t i = first; i < last; ++i)
+				result.merge(toLocal * points[i]);
+			return result;
+		},
+		[](const BoundingBox& a, const BoundingBox& b) { return BoundingBox::merged(a, b); });
+
+	orientedBox.axes = axes;
+	orientedBox.center = axes * localBox.getCenter();
+	orientedBox.extents = localBox.getExtents();
+
+	const BoundingBox box = computeBoundingBox(points, jobSystem);
+	const glm::vec3 boxExtents = box.getExtents();
+	if (8.f * boxExtents.x * boxExtents.y * boxExtents.z <= orientedBox.getVolume())
+	{
+		orientedBox.axes = glm::mat3(1.0f);
+		orientedBox.center = box.getCenter();
+		orientedBox.extents = boxExtents;
+	}
+	return orientedBox;
+}
+
+inline MeshBounds computeMeshBounds(const PositionStream& points, JobSystem& jobSystem = JobSystem::instance())
+{
+	MeshBounds bounds;
+	bounds.box = computeBoundingBox(points, jobSystem);
+	bounds.sphere = computeBoundingSphere(points, jobSystem);
+	bounds.orientedBox = computeOrientedBox(points, jobSystem);
+	return bounds;
+}
+
+//Bounds of every mesh of a model, in the order of Model::meshes, and of the whole model. Kept beside the model so
+//the loader does not have to know about culling.
+struct ModelBounds
+{
+	std::vector<MeshBounds> meshes;
+	MeshBounds model;
+};
+
+template<typename TModel>
+ModelBounds computeModelBounds(const TModel& model, JobSystem& jobSystem = JobSystem::instance())
+{
+	ModelBounds bounds;
+	std::vector<glm::vec3> positions;
+	bounds.meshes.reserve(model.meshes.size());
+	for (auto&& mesh : model.meshes)
+	{
+		if (mesh.vertices.empty())
+		{
+			bounds.meshes.emplace_back();
+			continue;
+		}
+
+		const PositionStream stream(&mesh.vertices[0].Position, mesh.vertices.size(), sizeof(mesh.vertices[0]));
+		bounds.meshes.push_back(computeMeshBounds(stream, jobSystem));
+		for (size_t i = 0; i < stream.count; ++i)
+			positions.push_back(stream[i]);
+	}
+
+	if (!positions.empty())
+		bounds.model = computeMeshBounds(PositionStream(positions.data(), positions.size()), jobSystem);
+	return bounds;
+}
+#endif
@@ -0,0 +1,206 @@
+#pragma once
+
+/* Compact key formats of an animation clip and the key reduction used to build them */
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+/* Unit quaternion in 48 bits: index of its largest component (2 bits) and the three others (15 bits each).
+   The largest component is rebuilt from the unit length, its sign is made positive since q and -q are the same
+   rotation. The three others are then within [-1/sqrt(2), 1/sqrt(2)]. */
+struct PackedQuat
+{
+	uint16_t data[3];
+};
+
+/* Vector quantized on 16 bits per component against a QuantizationRange */
+struct PackedVec3
+{
+	uint16_t data[3];
+};
+
+struct QuantizationRange
+{
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 extent = glm::vec3(0.0f);
+
+	static QuantizationRange FromValues(const glm::vec3& minValue, const glm::vec3& maxValue)
+	{
+		QuantizationRange range;
+		range.min = minValue;
+		range.extent = glm::max(maxValue - minValue, glm::vec3(0.0f));
+		return range;
+	}
+
+	/* Largest difference between a value in the range and its decoded quantization */
+	float GetMaxError() const
+	{
+		return glm::length(extent) / (2.0f * 65535.0f);
+	}
+};
+
+namespace clip_compression_detail
+{
+	constexpr float smallestThreeRange = 0.70710678f;
+	constexpr float maxQuantized15 = 32767.0f;
+
+	inline uint16_t QuantizeUnit(float value, float maxQuantized)
+	{
+		return static_cast<uint16_t>(std::lround(glm::clamp(value, 0.0f, 1.0f) * maxQuantized));
+	}
+}
+
+inline PackedQuat PackQuat(const glm::quat& rotation)
+{
+	using namespace clip_compression_detail;
+	const glm::quat q = glm::normalize(rotation);
+	const float components[4] = { q.x, q.y, q.z, q.w };
+
+	int largest = 0;
+	for (int i = 1; i < 4; ++i)
+	{
+		if (std::abs(components[i]) > std::abs(components[largest]))
+			largest = i;
+	}
+	const float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+
+	uint32_t quantized[3];
+	for (int i = 0, k = 0; i < 4; ++i)
+	{
+		if (i != largest)
+			quantized[k++] = QuantizeUnit((components[i] * sign / smallestThreeRange) * 0.5f + 0.5f, maxQuantized15);
+	}
+
+	/* [largest:2][a:15][b:15][c:15], one bit left */
+	const uint64_t bits = (uint64_t(largest) << 45) | (uint64_t(quantized[0]) << 30) | (uint64_t(quantized[1]) << 15) | quantized[2];
+	PackedQuat packed;
+	packed.data[0] = static_cast<uint16_t>(bits >> 32);
+	packed.data[1] = static_cast<uint16_t>(bits >> 16);
+	packed.data[2] = static_cast<uint16_t>(bits);
+	return packed;
+}
+
+inline glm::quat UnpackQuat(const PackedQuat& packed)
+{
+	using namespace clip_compression_detail;
+	const uint64_t bits = (uint64_t(packed.data[0]) << 32) | (uint64_t(packed.data[1]) << 16) | packed.data[2];
+	const int largest = static_cast<int>(bits >> 45) & 3;
+	const uint32_t quantized[3] = { uint32_t(bits >> 30) & 0x7FFF, uint32_t(bits >> 15) & 0x7FFF, uint32_t(bits) & 0x7FFF };
+
+	float components[4];
+	float sumSquares = 0.0f;
+	for (int i = 0, k = 0; i < 4; ++i)
+	{
+		if (i == largest)
+			continue;
+		components[i] = (quantized[k++] / maxQuantized15 * 2.0f - 1.0f) * smallestThreeRange;
+		sumSquares += components[i] * components[i];
+	}
+	components[largest] = std::sqrt(std::max(0.0f, 1.0f - sumSquares));
+	return glm::normalize(glm::quat(components[3], components[0], components[1], components[2]));
+}
+
+inline PackedVec3 PackVec3(const glm::vec3& value, const QuantizationRange& range)
+{
+	PackedVec3 packed;
+	for (int i = 0; i < 3; ++i)
+	{
+		const float normalized = range.extent[i] > 0.0f ? (value[i] - range.min[i]) / range.extent[i] : 0.0f;
+		packed.data[i] = clip_compression_detail::QuantizeUnit(normalized, 65535.0f);
+	}
+	return packed;
+}
+
+inline glm::vec3 UnpackVec3(const PackedVec3& packed, const QuantizationRange& range)
+{
+	return range.min + range.extent * (glm::vec3(packed.data[0], packed.data[1], packed.data[2]) / 65535.0f);
+}
+
+/* Angle in radians between two rotations. atan2 keeps small angles exact where acos of the dot product would
+   round them to a few 1e-4. */
+inline float RotationError(const glm::quat& a, const glm::quat& b)
+{
+	const glm::quat difference = glm::conjugate(a) * b;
+	return 2.0f * std::atan2(glm::length(glm::vec3(difference.x, difference.y, difference.z)), std::abs(difference.w));
+}
+
+/* Indices of the keys to keep so that interpolating the kept ones rebuilds every key within tolerance.
+   decoded[i] is key i after quantization, the error is measured against the original values, so the tolerance
+   also covers the quantization. Greedy: each segment is extended as long as the keys it skips stay within tolerance.
+   A track whose keys all match the first one is reduced to that key. */
+template<typename TValue, typename TInterpolate, typename TError>
+std::vector<int> ReduceKeys(const std::vector<float>& times, const std::vector<TValue>& original, const std::vector<TValue>& decoded,
+	float tolerance, TInterpolate&& interpolate, TError&& error)
+{
+	const int count = static_cast<int>(times.size());
+	std::vector<int> kept;
+	if (count == 0)
+		return kept;
+
+	bool constant = true;
+	for (int k = 1; k < count && constant; ++k)
+		constant = error(decoded[0], original[k]) <= tolerance;
+	kept.push_back(0);
+	if (constant)
+		return kept;
+
+	int anchor = 0;
+	for (int candidate = 2; candidate < count; ++candidate)
+	{
+		bool fits = true;
+		for (int k = anchor + 1; k < candidate && fits; ++k)
+		{
+			const float factor = (times[k] - times[anchor]) / (times[candidate] - times[anchor]);
+			fits = error(interpolate(decoded[anchor], decoded[candidate], factor), original[k]) <= tolerance;
+		}
+		if (!fits)
+		{
+			anchor = candidate - 1;
+			kept.push_back(anchor);
+		}
+	}
+	kept.push_back(count - 1);
+	return kept;
+}
+
+struct ClipCompressionSettings
+{
+	/* Largest translation and scale error, in model units */
+	float translationTolerance = 0.01f;
+	float scaleTolerance = 0.001f;
+	/* Largest rotation error in radians. It is lowered for the joints whose rotation moves descendants far away,
+	   so that none of them moves by more than translationTolerance. */
+	float rotationTolerance = 0.002f;
+};
+
+/* Size and error of a clip once compressed, errors are measured at every original key */
+struct ClipCompressionReport
+{
+	size_t originalBytes = 0;
+	size_t compressedBytes = 0;
+	size_t originalKeys = 0;
+	size_t compressedKeys = 0;
+	float maxTranslationError = 0.0f;
+	float maxRotationError = 0.0f;
+	float maxScaleError = 0.0f;
+
+	float GetRatio() const
+	{
+		return compressedBytes ? static_cast<float>(originalBytes) / compressedBytes : 0.0f;
+	}
+
+	void Merge(const ClipCompressionReport& other)
+	{
+		originalBytes += other.originalBytes;
+		compressedBytes += other.compressedBytes;
+		originalKeys += other.originalKeys;
+		compressedKeys += other.compressedKeys;
+		maxTranslationError = std::max(maxTranslationError, other.maxTranslationError);
+		maxRotationError = std::max(maxRotationError, other.maxRotationError);
+		maxScaleError = std::max(maxScaleError, other.maxScaleError);
+	}
+};
@@ -0,0 +1,322 @@
+#ifndef CPU_SKINNING_H
+#define CPU_SKINNING_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/job_system.h>
+
+#include <vector> //std::vector
+#include <cstdint> //int32_t
+#include <cstddef> //size_t
+#include <type_traits> //std::integral_constant
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#endif
+
+//Widest kernel the instruction sets enabled at compile time allow (e.g. -mavx2, /arch:AVX2). 1 means scalar only.
+//AVX2 is needed for the 8 wide integer compares, AVX alone only has the SSE kernel.
+#if defined(__AVX2__)
+#define CPU_SKINNING_MAX_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CPU_SKINNING_MAX_WIDTH 4
+#else
+#define CPU_SKINNING_MAX_WIDTH 1
+#endif
+
+//Kernel used by skinVertices. The 8 wide one is not faster everywhere: depending on the CPU it measured from 20%
+//slower to 17% faster than the 4 wide one built with AVX2, so it is opt in with -DCPU_SKINNING_WIDTH=8 once
+//skinning_benchmark shows it wins on the target CPU.
+#ifndef CPU_SKINNING_WIDTH
+#define CPU_SKINNING_WIDTH (CPU_SKINNING_MAX_WIDTH < 4 ? CPU_SKINNING_MAX_WIDTH : 4)
+#endif
+static_assert(CPU_SKINNING_WIDTH == 1 || CPU_SKINNING_WIDTH == 4 || CPU_SKINNING_WIDTH == 8, "CPU_SKINNING_WIDTH must be 1, 4 or 8");
+static_assert(CPU_SKINNING_WIDTH <= CPU_SKINNING_MAX_WIDTH, "CPU_SKINNING_WIDTH needs an instruction set that is not enabled");
+
+//Bone influences per vertex, MAX_BONE_INFLUENCE of Mesh and anim_model.vs
+const int SKINNING_MAX_INFLUENCES = 4;
+
+//Positions and normals of vertices stored as structure of arrays, so one SIMD load fetches a component of several vertices
+struct VertexStreamsSoA
+{
+	std::vector<float> posX, posY, posZ;
+	std::vector<float> normalX, normalY, normalZ;
+
+	size_t size() const
+	{
+		return posX.size();
+	}
+
+	void resize(size_t count)
+	{
+		for (std::vector<float>* component : { &posX, &posY, &posZ, &normalX, &normalY, &normalZ })
+			component->resize(count);
+	}
+
+	glm::vec3 getPosition(size_t i) const
+	{
+		return { posX[i], posY[i], posZ[i] };
+	}
+
+	glm::vec3 getNormal(size_t i) const
+	{
+		return { normalX[i], normalY[i], normalZ[i] };
+	}
+
+	void set(size_t i, const glm::vec3& position, const glm::vec3& normal)
+	{
+		posX[i] = position.x; posY[i] = position.y; posZ[i] = position.z;
+		normalX[i] = normal.x; normalY[i] = normal.y; normalZ[i] = normal.z;
+	}
+};
+
+//Bind pose vertices and their influences, one array per influence slot
+struct SkinningInputSoA
+{
+	VertexStreamsSoA rest;
+	std::vector<int32_t> boneIds[SKINNING_MAX_INFLUENCES];
+	std::vector<float> weights[SKINNING_MAX_INFLUENCES];
+
+	size_t size() const
+	{
+		return rest.size();
+	}
+
+	void resize(size_t count)
+	{
+		rest.resize(count);
+		for (int slot = 0; slot < SKINNING_MAX_INFLUENCES; ++slot)
+		{
+			boneIds[slot].resize(count, -1);
+			weights[slot].resize(count, 0.f);
+		}
+	}
+
+	//From the vertices of a Mesh: Position, Normal, m_BoneIDs and m_Weights
+	template<typename TVertex>
+	void assign(const std::vector<TVertex>& vertices)
+	{
+		resize(vertices.size());
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			rest.set(i, vertices[i].Position, vertices[i].Normal);
+			for (int slot = 0; slot < SKINNING_MAX_INFLUENCES; ++slot)
+			{
+				boneIds[slot][i] = vertices[i].m_BoneIDs[slot];
+				weights[slot][i] = vertices[i].m_Weights[slot];
+			}
+		}
+	}
+};
+
+//One vertex with the math of anim_model.vs: influences with bone -1 are skipped, a bone outside of the palette leaves
+//the vertex in bind pose. The normal is the weighted sum of mat3(bone) * normal, not normalized.
+inline void skinVertexReference(const SkinningInputSoA& input, const glm::mat4* palette, int paletteSize, VertexStreamsSoA& out, size_t i)
+{
+	const glm::vec4 position(input.rest.getPosition(i), 1.f);
+	const glm::vec3 normal = input.rest.getNormal(i);
+	glm::vec4 totalPosition(0.f);
+	glm::vec3 totalNormal(0.f);
+	for (int slot = 0; slot < SKINNING_MAX_INFLUENCES; ++slot)
+	{
+		const int bone = input.boneIds[slot][i];
+		if (bone == -1)
+			continue;
+		if (bone >= paletteSize)
+		{
+			totalPosition = position;
+			totalNormal = normal;
+			break;
+		}
+		const float weight = input.weights[slot][i];
+		totalPosition += palette[bone] * position * weight;
+		totalNormal += glm::mat3(palette[bone]) * normal * weight;
+	}
+	out.set(i, glm::vec3(totalPosition), totalNormal);
+}
+
+//Vertices [first, last) one at a time, the reference the SIMD kernels are checked against
+inline void skinVerticesReference(const SkinningInputSoA& input, const glm::mat4* palette, int paletteSize, VertexStreamsSoA& out,
+	size_t first, size_t last)
+{
+	for (size_t i = first; i < last; ++i)
+		skinVertexReference(input, palette, paletteSize, out, i);
+}
+
+namespace cpu_skinning_detail
+{
+	template<int Width>
+	using SimdWidth = std::integral_constant<int, Width>;
+
+	//Width vertices starting at i, one per lane. Every influence reads the 12 elements of the bone matrix of each
+	//lane. Unused influences get weight 0 and bone 0, lanes with a bone outside of the palette take their bind pose
+	//at the end.
+	inline void skinBlock(SimdWidth<1>, const SkinningInputSoA& input, const float* palette, int paletteSize, VertexStreamsSoA& out, size_t i)
+	{
+		skinVertexReference(input, reinterpret_cast<const glm::mat4*>(palette), paletteSize, out, i);
+	}
+
+#if CPU_SKINNING_MAX_WIDTH >= 8
+	inline void skinBlock(SimdWidth<8>, const SkinningInputSoA& input, const float* palette, int paletteSize, VertexStreamsSoA& out, size_t i)
+	{
+		const __m256 px = _mm256_loadu_ps(&input.rest.posX[i]), py = _mm256_loadu_ps(&input.rest.posY[i]), pz = _mm256_loadu_ps(&input.rest.posZ[i]);
+		const __m256 nx = _mm256_loadu_ps(&input.rest.normalX[i]), ny = _mm256_loadu_ps(&input.rest.normalY[i]), nz = _mm256_loadu_ps(&input.rest.normalZ[i]);
+		__m256 tx = _mm256_setzero_ps(), ty = _mm256_setzero_ps(), tz = _mm256_setzero_ps();
+		__m256 ux = _mm256_setzero_ps(), uy = _mm256_setzero_ps(), uz = _mm256_setzero_ps();
+		__m256i outside = _mm256_setzero_si256();
+		const __m256i minusOne = _mm256_set1_epi32(-1), lastBone = _mm256_set1_epi32(paletteSize - 1);
+
+		for (int slot = 0; slot < SKINNING_MAX_INFLUENCES; ++slot)
+		{
+			const __m256i bone = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&input.boneIds[slot][i]));
+			const __m256i unused = _mm256_cmpeq_epi32(bone, minusOne);
+			const __m256i over = _mm256_andnot_si256(unused, _mm256_cmpgt_epi32(bone, lastBone));
+			outside = _mm256_or_si256(outside, over);
+			const __m256i used = _mm256_andnot_si256(_mm256_or_si256(over, unused), minusOne);
+			const __m256 weight = _mm256_and_ps(_mm256_loadu_ps(&input.weights[slot][i]), _mm256_castsi256_ps(used));
+
+			//Hardware gathers are slower than loading each column and transposing: lanes k and k + 4 share a
+			//register, the 4x4 transpose then works within each 128 bit half
+			alignas(32) int32_t lanes[8];
+			_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), _mm256_slli_epi32(_mm256_and_si256(bone, used), 4));
+			__m256 m[12];
+			for (int column = 0; column < 4; ++column)
+			{
+				__m256 r[4];
+				for (int k = 0; k < 4; ++k)
+					r[k] = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(palette + lanes[k] + column * 4)), _mm_loadu_ps(palette + lanes[k + 4] + column * 4), 1);
+				const __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]), t1 = _mm256_unpacklo_ps(r[2], r[3]);
+				const __m256 t2 = _mm256_unpackhi_ps(r[0], r[1]), t3 = _mm256_unpackhi_ps(r[2], r[3]);
+				m[column * 3] = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+				m[column * 3 + 1] = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+				m[column * 3 + 2] = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+			}
+
+			const __m256 x = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[0], px), _mm256_mul_ps(m[3], py)), _mm256_add_ps(_mm256_mul_ps(m[6], pz), m[9]));
+			const __m256 y = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[1], px), _mm256_mul_ps(m[4], py)), _mm256_add_ps(_mm256_mul_ps(m[7], pz), m[10]));
+			const __m256 z = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[2], px), _mm256_mul_ps(m[5], py)), _mm256_add_ps(_mm256_mul_ps(m[8], pz), m[11]));
+			tx = _mm256_add_ps(tx, _mm256_mul_ps(x, weight));
+			ty = _mm256_add_ps(ty, _mm256_mul_ps(y, weight));
+			tz = _mm256_add_ps(tz, _mm256_mul_ps(z, weight));
+
+			const __m256 a = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[0], nx), _mm256_mul_ps(m[3], ny)), _mm256_mul_ps(m[6], nz));
+			const __m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[1], nx), _mm256_mul_ps(m[4], ny)), _mm256_mul_ps(m[7], nz));
+			const __m256 c = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[2], nx), _mm256_mul_ps(m[5], ny)), _mm256_mul_ps(m[8], nz));
+			ux = _mm256_add_ps(ux, _mm256_mul_ps(a, weight));
+			uy = _mm256_add_ps(uy, _mm256_mul_ps(b, weight));
+			uz = _mm256_add_ps(uz, _mm256_mul_ps(c, weight));
+		}
+
+		const __m256 bindPose = _mm256_castsi256_ps(outside);
+		_mm256_storeu_ps(&out.posX[i], _mm256_blendv_ps(tx, px, bindPose));
+		_mm256_storeu_ps(&out.posY[i], _mm256_blendv_ps(ty, py, bindPose));
+		_mm256_storeu_ps(&out.posZ[i], _mm256_blendv_ps(tz, pz, bindPose));
+		_mm256_storeu_ps(&out.normalX[i], _mm256_blendv_ps(ux, nx, bindPose));
+		_mm256_storeu_ps(&out.normalY[i], _mm256_blendv_ps(uy, ny, bindPose));
+		_mm256_storeu_ps(&out.normalZ[i], _mm256_blendv_ps(uz, nz, bindPose));
+	}
+#endif
+
+#if CPU_SKINNING_MAX_WIDTH >= 4
+	inline __m128 select(__m128 mask, __m128 ifTrue, __m128 ifFalse)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, ifTrue), _mm_andnot_ps(mask, ifFalse));
+	}
+
+	inline void skinBlock(SimdWidth<4>, const SkinningInputSoA& input, const float* palette, int paletteSize, VertexStreamsSoA& out, size_t i)
+	{
+		const __m128 px = _mm_loadu_ps(&input.rest.posX[i]), py = _mm_loadu_ps(&input.rest.posY[i]), pz = _mm_loadu_ps(&input.rest.posZ[i]);
+		const __m128 nx = _mm_loadu_ps(&input.rest.normalX[i]), ny = _mm_loadu_ps(&input.rest.normalY[i]), nz = _mm_loadu_ps(&input.rest.normalZ[i]);
+		__m128 tx = _mm_setzero_ps(), ty = _mm_setzero_ps(), tz = _mm_setzero_ps();
+		__m128 ux = _mm_setzero_ps(), uy = _mm_setzero_ps(), uz = _mm_setzero_ps();
+		__m128i outside = _mm_setzero_si128();
+		const __m128i minusOne = _mm_set1_epi32(-1), lastBone = _mm_set1_epi32(paletteSize - 1);
+
+		for (int slot = 0; slot < SKINNING_MAX_INFLUENCES; ++slot)
+		{
+			const __m128i bone = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&input.boneIds[slot][i]));
+			const __m128i unused = _mm_cmpeq_epi32(bone, minusOne);
+			const __m128i over = _mm_andnot_si128(unused, _mm_cmpgt_epi32(bone, lastBone));
+			outside = _mm_or_si128(outside, over);
+			const __m128i used = _mm_andnot_si128(_mm_or_si128(over, unused), minusOne);
+			const __m128 weight = _mm_and_ps(_mm_loadu_ps(&input.weights[slot][i]), _mm_castsi128_ps(used));
+
+			//No gather before AVX2, the four matrices are read lane by lane
+			alignas(16) int32_t lanes[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(lanes), _mm_slli_epi32(_mm_and_si128(bone, used), 4));
+			const float* m0 = palette + lanes[0];
+			const float* m1 = palette + lanes[1];
+			const float* m2 = palette + lanes[2];
+			const float* m3 = palette + lanes[3];
+			__m128 m[12];
+			for (int column = 0; column < 4; ++column)
+			{
+				//Column of the four matrices, transposed so each register holds one element for the four lanes
+				__m128 r0 = _mm_loadu_ps(m0 + column * 4), r1 = _mm_loadu_ps(m1 + column * 4), r2 = _mm_loadu_ps(m2 + column * 4), r3 = _mm_loadu_ps(m3 + column * 4);
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+				m[column * 3] = r0;
+				m[column * 3 + 1] = r1;
+				m[column * 3 + 2] = r2;
+			}
+
+			const __m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], px), _mm_mul_ps(m[3], py)), _mm_add_ps(_mm_mul_ps(m[6], pz), m[9]));
+			const __m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[1], px), _mm_mul_ps(m[4], py)), _mm_add_ps(_mm_mul_ps(m[7], pz), m[10]));
+			const __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[2], px), _mm_mul_ps(m[5], py)), _mm_add_ps(_mm_mul_ps(m[8], pz), m[11]));
+			tx = _mm_add_ps(tx, _mm_mul_ps(x, weight));
+			ty = _mm_add_ps(ty, _mm_mul_ps(y, weight));
+			tz = _mm_add_ps(tz, _mm_mul_ps(z, weight));
+
+			const __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], nx), _mm_mul_ps(m[3], ny)), _mm_mul_ps(m[6], nz));
+			const __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[1], nx), _mm_mul_ps(m[4], ny)), _mm_mul_ps(m[7], nz));
+			const __m128 c = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[2], nx), _mm_mul_ps(m[5], ny)), _mm_mul_ps(m[8], nz));
+			ux = _mm_add_ps(ux, _mm_mul_ps(a, weight));
+			uy = _mm_add_ps(uy, _mm_mul_ps(b, weight));
+			uz = _mm_add_ps(uz, _mm_mul_ps(c, weight));
+		}
+
+		const __m128 bindPose = _mm_castsi128_ps(outside);
+		_mm_storeu_ps(&out.posX[i], select(bindPose, px, tx));
+		_mm_storeu_ps(&out.posY[i], select(bindPose, py, ty));
+		_mm_storeu_ps(&out.posZ[i], select(bindPose, pz, tz));
+		_mm_storeu_ps(&out.normalX[i], select(bindPose, nx, ux));
+		_mm_storeu_ps(&out.normalY[i], select(bindPose, ny, uy));
+		_mm_storeu_ps(&out.normalZ[i], select(bindPose, nz, uz));
+	}
+#endif
+}
+
+//skinVertices with the kernel of the given width, up to CPU_SKINNING_MAX_WIDTH. Lets a benchmark compare them.
+template<int Width>
+inline void skinVerticesWidth(const SkinningInputSoA& input, const glm::mat4* palette, int paletteSize, VertexStreamsSoA& out,
+	size_t first, size_t last)
+{
+	static_assert(sizeof(glm::mat4) == 16 * sizeof(float), "mat4 must be tightly packed");
+	static_assert(Width <= CPU_SKINNING_MAX_WIDTH, "kernel not compiled, its instruction set is not enabled");
+	size_t i = first;
+	for (; i + Width <= last; i += Width)
+		cpu_skinning_detail::skinBlock(cpu_skinning_detail::SimdWidth<Width>(), input, &palette[0][0][0], paletteSize, out, i);
+	for (; i < last; ++i)
+		skinVertexReference(input, palette, paletteSize, out, i);
+}
+
+//Vertices [first, last) of input skinned by palette into out, which must be as large as input.
+//Same result as skinVerticesReference up to the rounding of the sums.
+inline void skinVertices(const SkinningInputSoA& input, const glm::mat4* palette, int paletteSize, VertexStreamsSoA& out,
+	size_t first, size_t last)
+{
+	skinVerticesWidth<CPU_SKINNING_WIDTH>(input, palette, paletteSize, out, first, last);
+}
+
+//Every vertex, in chunks of grain vertices spread over the job system
+inline void skinVertices(JobSystem& jobSystem, const SkinningInputSoA& input, const glm::mat4* palette, int paletteSize, VertexStreamsSoA& out,
+	size_t grain = 16384)
+{
+	out.resize(input.size());
+	//Chunks start on a SIMD block so only the very end goes through the scalar path
+	grain = (grain + CPU_SKINNING_WIDTH - 1) / CPU_SKINNING_WIDTH * CPU_SKINNING_WIDTH;
+	jobSystem.parallelFor(0, input.size(), grain, [&](size_t begin, size_t end)
+		{
+			skinVertices(input, palette, paletteSize, out, begin, end);
+		});
+}
+#endif
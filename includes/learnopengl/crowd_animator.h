@@ -0,0 +1,363 @@
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include <glm/glm.hpp>
+#include <learnopengl/animation.h>
+#include <learnopengl/affine_transform.h>
+#include <learnopengl/baked_animation.h>
+#include <learnopengl/job_system.h>
+
+const int ANIMATION_LOD_LEVELS = 4;
+
+/* Level of detail of the characters of a CrowdAnimator, chosen by their distance to the view position. Level 0 is
+   evaluated every frame with all its joints. Further levels are evaluated every updateIntervals[level] frames and hold
+   their pose in between. From reducedJointsLevel, joints whose parent spans less than leafSpanRatio of the skeleton
+   in the bind pose (fingers, face) are not sampled and keep their bind transform. At the last level, characters with
+   a baked clip copy their palette from the baked texture instead of being evaluated. */
+struct AnimationLodSettings
+{
+	/* distances where levels 1, 2 and 3 start */
+	float distances[ANIMATION_LOD_LEVELS - 1] = { 8.0f, 16.0f, 32.0f };
+	int updateIntervals[ANIMATION_LOD_LEVELS] = { 1, 2, 4, 8 };
+	int reducedJointsLevel = 1;
+	float leafSpanRatio = 0.1f;
+	/* wall time of the evaluations of a frame, 0 for no limit. Characters past it are deferred to the next frames,
+	   the most overdue ones first, then the closest. */
+	double budgetMilliseconds = 0.0;
+};
+
+/* Timing of the last CrowdAnimator::UpdateAnimations */
+struct CrowdUpdateStats
+{
+	unsigned int characters = 0;
+	/* characters whose pose was evaluated, copied from a baked clip, held from a previous frame, or due but over budget */
+	unsigned int evaluated = 0;
+	unsigned int baked = 0;
+	unsigned int held = 0;
+	unsigned int deferred = 0;
+	unsigned int levels[ANIMATION_LOD_LEVELS] = {};
+	double milliseconds = 0.0;
+
+	double GetCharactersPerMillisecond() const
+	{
+		return milliseconds > 0.0 ? evaluated / milliseconds : 0.0;
+	}
+};
+
+/* Many Animator instances in contiguous storage. Each character keeps its own time and key cursors, the final bone
+   matrices of all of them live in one array. UpdateAnimations evaluates the poses in chunks on the job system:
+   keys are sampled into component arrays, composed four joints at a time by the SSE kernel of affine_transform.h,
+   then the hierarchy is resolved with the SSE affine products, straight into the mat4 palette.
+   With a view position, the update follows the AnimationLodSettings instead of evaluating every character. */
+class CrowdAnimator
+{
+public:
+	explicit CrowdAnimator(JobSystem& jobSystem = JobSystem::instance(), const AnimationLodSettings& lodSettings = AnimationLodSettings())
+		: m_JobSystem(jobSystem), m_LodSettings(lodSettings)
+	{
+	}
+
+	/* Index of the new character. The palettes may move, get them again after adding characters. */
+	int AddCharacter(const Animation* animation, float startTime = 0.0f, float speed = 1.0f)
+	{
+		Character character;
+		character.animation = animation;
+		character.time = std::fmod(std::max(startTime, 0.0f), animation->GetDuration());
+		character.speed = speed;
+		character.cursorOffset = static_cast<uint32_t>(m_Cursors.size());
+		character.paletteOffset = static_cast<uint32_t>(m_FinalBoneMatrices.size());
+		// as many matrices as the skeleton writes, bones past them are left in the bind pose by the shaders
+		character.paletteSize = static_cast<uint32_t>(std::max(1, animation->GetSkeleton().GetPaletteSize()));
+
+		m_Cursors.resize(m_Cursors.size() + animation->GetBoneCount());
+		m_FinalBoneMatrices.resize(m_FinalBoneMatrices.size() + character.paletteSize, glm::mat4(1.0f));
+		if (m_LeafJoints.find(animation) == m_LeafJoints.end())
+			m_LeafJoints[animation] = FindLeafJoints(animation->GetSkeleton());
+		m_Characters.push_back(character);
+		return static_cast<int>(m_Characters.size()) - 1;
+	}
+
+	/* World position of the character, its distance to the view position picks its level of detail */
+	void SetPosition(int character, const glm::vec3& position) { m_Characters[character].position = position; }
+
+	/* Clip of baked, baked from the animation of the character, played at the last level of detail */
+	void SetBakedClip(int character, const BakedAnimationTexture* baked, int clip)
+	{
+		m_Characters[character].baked = baked;
+		m_Characters[character].bakedClip = clip;
+	}
+
+	void SetLodSettings(const AnimationLodSettings& settings)
+	{
+		m_LodSettings = settings;
+		for (auto& leafJoints : m_LeafJoints)
+			leafJoints.second = FindLeafJoints(leafJoints.first->GetSkeleton());
+	}
+
+	const AnimationLodSettings& GetLodSettings() const { return m_LodSettings; }
+
+	/* Advances every character by dt seconds and evaluates its pose. grain is the number of characters per job. */
+	void UpdateAnimations(float dt, size_t grain = 16)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		m_JobSystem.parallelFor(0, m_Characters.size(), grain, [this, dt](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; ++i)
+				{
+					Character& character = m_Characters[i];
+					AdvanceTime(character, dt);
+					CalculateBoneTransforms(character, false);
+					character.framesSinceUpdate = 0;
+					character.posed = true;
+				}
+			});
+		const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		m_Stats = CrowdUpdateStats();
+		m_Stats.characters = m_Stats.evaluated = m_Stats.levels[0] = static_cast<unsigned int>(m_Characters.size());
+		m_Stats.milliseconds = elapsed.count();
+	}
+
+	/* Same with level of detail, viewPosition usually the camera. Every character advances, only the ones due at
+	   their level are posed. */
+	void UpdateAnimations(float dt, const glm::vec3& viewPosition, size_t grain = 16)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		m_Stats = CrowdUpdateStats();
+		m_Stats.characters = static_cast<unsigned int>(m_Characters.size());
+		m_Due.clear();
+		m_BakedDue.clear();
+		++m_Frame;
+
+		for (size_t i = 0; i < m_Characters.size(); ++i)
+		{
+			Character& character = m_Characters[i];
+			AdvanceTime(character, dt);
+			character.framesSinceUpdate = std::min(character.framesSinceUpdate + 1, 1 << 20);
+
+			const float distance = glm::distance(character.position, viewPosition);
+			int level = 0;
+			while (level < ANIMATION_LOD_LEVELS - 1 && distance >= m_LodSettings.distances[level])
+				++level;
+			character.level = level;
+			++m_Stats.levels[level];
+
+			// the phase spreads the characters of a level over the frames of its interval, the ones held back by the
+			// budget or coming from a slower level catch up as soon as they are overdue
+			const int interval = std::max(1, m_LodSettings.updateIntervals[level]);
+			const bool due = !character.posed || character.framesSinceUpdate > interval || (m_Frame + i) % interval == 0;
+			if (!due)
+				++m_Stats.held;
+			else if (level == ANIMATION_LOD_LEVELS - 1 && character.baked)
+				m_BakedDue.push_back(static_cast<uint32_t>(i));
+			else
+				m_Due.push_back(static_cast<uint32_t>(i));
+		}
+
+		if (m_LodSettings.budgetMilliseconds > 0.0 && m_MillisecondsPerCharacter > 0.0)
+		{
+			const size_t affordable = std::max<size_t>(1, static_cast<size_t>(m_LodSettings.budgetMilliseconds / m_MillisecondsPerCharacter));
+			if (m_Due.size() > affordable)
+			{
+				std::nth_element(m_Due.begin(), m_Due.begin() + affordable, m_Due.end(), [this, &viewPosition](uint32_t a, uint32_t b)
+					{
+						const float overdueA = GetOverdue(m_Characters[a]), overdueB = GetOverdue(m_Characters[b]);
+						if (overdueA != overdueB)
+							return overdueA > overdueB;
+						return glm::distance(m_Characters[a].position, viewPosition) < glm::distance(m_Characters[b].position, viewPosition);
+					});
+				m_Stats.deferred = static_cast<unsigned int>(m_Due.size() - affordable);
+				m_Due.resize(affordable);
+			}
+		}
+
+		const auto evaluationStart = std::chrono::steady_clock::now();
+		m_JobSystem.parallelFor(0, m_Due.size(), grain, [this](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; ++i)
+				{
+					Character& character = m_Characters[m_Due[i]];
+					CalculateBoneTransforms(character, character.level >= m_LodSettings.reducedJointsLevel);
+					character.framesSinceUpdate = 0;
+					character.posed = true;
+				}
+			});
+		const std::chrono::duration<double, std::milli> evaluation = std::chrono::steady_clock::now() - evaluationStart;
+		if (!m_Due.empty())
+		{
+			// smoothed, one slow frame must not starve the next ones
+			const double measured = evaluation.count() / m_Due.size();
+			m_MillisecondsPerCharacter = m_MillisecondsPerCharacter > 0.0 ? 0.9 * m_MillisecondsPerCharacter + 0.1 * measured : measured;
+		}
+
+		// a copy of a few hundred floats, not worth a budget
+		m_JobSystem.parallelFor(0, m_BakedDue.size(), grain * 4, [this](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; ++i)
+				{
+					Character& character = m_Characters[m_BakedDue[i]];
+					CopyBakedPalette(character);
+					character.framesSinceUpdate = 0;
+					character.posed = true;
+				}
+			});
+
+		const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		m_Stats.evaluated = static_cast<unsigned int>(m_Due.size());
+		m_Stats.baked = static_cast<unsigned int>(m_BakedDue.size());
+		m_Stats.milliseconds = elapsed.count();
+	}
+
+	int GetCharacterCount() const { return static_cast<int>(m_Characters.size()); }
+	float GetTime(int character) const { return m_Characters[character].time; }
+	int GetLevel(int character) const { return m_Characters[character].level; }
+	const Animation* GetAnimation(int character) const { return m_Characters[character].animation; }
+
+	/* Final bone matrices of a character, GetPaletteSize of them */
+	const glm::mat4* GetFinalBoneMatrices(int character) const { return &m_FinalBoneMatrices[m_Characters[character].paletteOffset]; }
+	int GetPaletteSize(int character) const { return static_cast<int>(m_Characters[character].paletteSize); }
+
+	const CrowdUpdateStats& GetStats() const { return m_Stats; }
+
+private:
+	struct Character
+	{
+		const Animation* animation = nullptr;
+		float time = 0.0f;
+		float speed = 1.0f;
+		uint32_t cursorOffset = 0;
+		uint32_t paletteOffset = 0;
+		uint32_t paletteSize = 0;
+		glm::vec3 position = glm::vec3(0.0f);
+		const BakedAnimationTexture* baked = nullptr;
+		int bakedClip = 0;
+		int level = 0;
+		int framesSinceUpdate = 0;
+		bool posed = false;
+	};
+
+	/* Per thread buffers of the pose being evaluated, sized to the largest skeleton seen */
+	struct Scratch
+	{
+		TRSArrays locals;
+		std::vector<glm::mat4x3> localMatrices;
+		std::vector<glm::mat4> globalMatrices;
+	};
+
+	void AdvanceTime(Character& character, float dt)
+	{
+		character.time += character.animation->GetTicksPerSecond() * dt * character.speed;
+		character.time = std::fmod(character.time, character.animation->GetDuration());
+		if (character.time < 0.0f)
+			character.time += character.animation->GetDuration();
+	}
+
+	/* Frames past the interval of its level, relative to it */
+	float GetOverdue(const Character& character) const
+	{
+		if (!character.posed)
+			return 1e30f;
+		return static_cast<float>(character.framesSinceUpdate) / std::max(1, m_LodSettings.updateIntervals[character.level]);
+	}
+
+	/* Joints whose parent spans less than leafSpanRatio of the whole skeleton. Their descendants span even less, so
+	   a skipped joint never has an animated child. */
+	std::vector<uint8_t> FindLeafJoints(const Skeleton& skeleton) const
+	{
+		const std::vector<float> spans = skeleton.ComputeBindSpans();
+		const float extent = spans.empty() ? 0.0f : *std::max_element(spans.begin(), spans.end());
+		std::vector<uint8_t> leafJoints(skeleton.GetJointCount(), 0);
+		for (int joint = 0; joint < skeleton.GetJointCount(); ++joint)
+		{
+			const int parent = skeleton.parents[joint];
+			leafJoints[joint] = parent >= 0 && spans[parent] < m_LodSettings.leafSpanRatio * extent;
+		}
+		return leafJoints;
+	}
+
+	/* The frame of the baked clip closest to the time of the character */
+	void CopyBakedPalette(Character& character)
+	{
+		const BakedAnimationTexture& baked = *character.baked;
+		const BakedClip& clip = baked.GetClip(character.bakedClip);
+		const float ticksPerSecond = character.animation->GetTicksPerSecond() > 0 ? character.animation->GetTicksPerSecond() : 25.0f;
+		// the last frame is the end of the clip, the same pose as the first one, so the loop wraps like the mod of the shader
+		const int loopFrames = std::max(1, clip.frameCount - 1);
+		const int frame = static_cast<int>(std::lround(character.time / ticksPerSecond * clip.framesPerSecond)) % loopFrames;
+		glm::mat4* palette = &m_FinalBoneMatrices[character.paletteOffset];
+		const int bones = std::min(baked.GetPaletteSize(), static_cast<int>(character.paletteSize));
+		for (int bone = 0; bone < bones; ++bone)
+		{
+			const glm::vec4& r0 = baked.GetTexel(character.bakedClip, frame, bone, 0);
+			const glm::vec4& r1 = baked.GetTexel(character.bakedClip, frame, bone, 1);
+			const glm::vec4& r2 = baked.GetTexel(character.bakedClip, frame, bone, 2);
+			palette[bone] = glm::mat4(r0.x, r1.x, r2.x, 0.0f, r0.y, r1.y, r2.y, 0.0f, r0.z, r1.z, r2.z, 0.0f, r0.w, r1.w, r2.w, 1.0f);
+		}
+	}
+
+	/* reduced skips the leaf joints, they keep their bind transform like joints without channel */
+	void CalculateBoneTransforms(Character& character, bool reduced)
+	{
+		static thread_local Scratch scratch;
+		const Animation& animation = *character.animation;
+		const Skeleton& skeleton = animation.GetSkeleton();
+		const int jointCount = skeleton.GetJointCount();
+		if (static_cast<int>(scratch.localMatrices.size()) < jointCount)
+		{
+			scratch.locals.resize(jointCount);
+			scratch.localMatrices.resize(jointCount);
+			scratch.globalMatrices.resize(jointCount);
+		}
+		// the map is only written by AddCharacter and SetLodSettings, never during an update
+		const uint8_t* leafJoints = reduced ? m_LeafJoints.find(character.animation)->second.data() : nullptr;
+
+		BoneCursor* cursors = &m_Cursors[character.cursorOffset];
+		for (int joint = 0; joint < jointCount; ++joint)
+		{
+			const int channel = skeleton.jointChannels[joint];
+			if (channel < 0 || (leafJoints && leafJoints[joint]))
+				continue;
+			glm::vec3 position, scale;
+			glm::quat rotation;
+			animation.GetBone(channel).SampleTRS(character.time, cursors[channel], position, rotation, scale);
+			scratch.locals.setPosition(joint, position);
+			scratch.locals.setRotation(joint, rotation);
+			scratch.locals.setScale(joint, scale);
+		}
+		composeAffineBatch(scratch.locals, 0, jointCount, scratch.localMatrices.data());
+
+		glm::mat4* palette = &m_FinalBoneMatrices[character.paletteOffset];
+		for (int joint = 0; joint < jointCount; ++joint)
+		{
+			const int parent = skeleton.parents[joint];
+			glm::mat4& global = scratch.globalMatrices[joint];
+			// joints without channel composed whatever the buffer held, their bind transform replaces it
+			if (skeleton.jointChannels[joint] >= 0 && !(leafJoints && leafJoints[joint]))
+				global = parent >= 0 ? multiplyAffine(scratch.globalMatrices[parent], scratch.localMatrices[joint]) : toMat4(scratch.localMatrices[joint]);
+			else
+				global = parent >= 0 ? multiplyAffine(scratch.globalMatrices[parent], skeleton.bindLocals[joint]) : skeleton.bindLocals[joint];
+
+			const int index = skeleton.paletteIndices[joint];
+			if (index >= 0)
+				palette[index] = multiplyAffine(global, skeleton.offsets[joint]);
+		}
+	}
+
+	JobSystem& m_JobSystem;
+	AnimationLodSettings m_LodSettings;
+	std::vector<Character> m_Characters;
+	std::vector<BoneCursor> m_Cursors;
+	std::vector<glm::mat4> m_FinalBoneMatrices;
+	/* joints skipped at the reduced levels, per animation */
+	std::unordered_map<const Animation*, std::vector<uint8_t>> m_LeafJoints;
+	/* characters evaluated or copied from their baked clip this frame */
+	std::vector<uint32_t> m_Due;
+	std::vector<uint32_t> m_BakedDue;
+	uint64_t m_Frame = 0;
+	double m_MillisecondsPerCharacter = 0.0;
+	CrowdUpdateStats m_Stats;
+};
@@ -0,0 +1,123 @@
+#ifndef DIRTY_TRANSFORM_LIST_H
+#define DIRTY_TRANSFORM_LIST_H
+
+#include <learnopengl/entity.h>
+
+#include <vector> //std::vector
+#include <algorithm> //std::find, std::remove_if
+
+//Told once per update about every entity whose world matrix and bounds changed
+class TransformChangeListener
+{
+public:
+	virtual ~TransformChangeListener() = default;
+	virtual void onTransformsChanged(const std::vector<Entity*>& changed) = 0;
+};
+
+//Incremental counterpart of Entity::updateSelfAndChild. The transforms of the tracked entities report themselves
+//when they become dirty, so update() only walks the moved subtrees and their ancestors: a static scene costs nothing.
+//Detach an entity before destroying it.
+class DirtyTransformList : public TransformDirtyListener
+{
+public:
+	//Track root and all its descendants, children added later are tracked too
+	void attach(Entity& root)
+	{
+		root.transform.setListener(this, &root);
+		for (auto&& child : root.children)
+			attach(*child);
+	}
+
+	void detach(Entity& root)
+	{
+		m_dirtyRoots.erase(std::remove_if(m_dirtyRoots.begin(), m_dirtyRoots.end(), [&root](Entity* entity)
+			{
+				for (Entity* node = entity; node; node = node->parent)
+				{
+					if (node == &root)
+						return true;
+				}
+				return false;
+			}), m_dirtyRoots.end());
+		detachNodes(root);
+	}
+
+	void addListener(TransformChangeListener& listener)
+	{
+		m_listeners.push_back(&listener);
+	}
+
+	void removeListener(TransformChangeListener& listener)
+	{
+		m_listeners.erase(std::find(m_listeners.begin(), m_listeners.end(), &listener));
+	}
+
+	void onTransformDirty(Entity& entity) override
+	{
+		m_dirtyRoots.push_back(&entity);
+	}
+
+	//Returns the number of entities updated
+	size_t update()
+	{
+		m_changed.clear();
+		for (Entity* entity : m_dirtyRoots)
+		{
+			//Already updated with the subtree of a dirty ancestor enqueued earlier, or will be with one enqueued later
+			if (!entity->transform.isDirty() || hasDirtyAncestor(*entity))
+				continue;
+
+			entity->forceUpdateSelfAndChild([this](Entity& updated) { m_changed.push_back(&updated); });
+			refitAncestors(*entity);
+		}
+		m_dirtyRoots.clear();
+
+		if (!m_changed.empty())
+		{
+			for (TransformChangeListener* listener : m_listeners)
+				listener->onTransformsChanged(m_changed);
+		}
+		return m_changed.size();
+	}
+
+	bool empty() const
+	{
+		return m_dirtyRoots.empty();
+	}
+
+private:
+	std::vector<Entity*> m_dirtyRoots;
+	std::vector<Entity*> m_changed;
+	std::vector<TransformChangeListener*> m_listeners;
+
+	static bool hasDirtyAncestor(const Entity& entity)
+	{
+		for (const Entity* node = entity.parent; node; node = node->parent)
+		{
+			if (node->transform.isDirty())
+				return true;
+		}
+		return false;
+	}
+
+	//The subtree bounds of the ancestors include the moved subtree. Stop as soon as one is unchanged,
+	//the ones above it are then unchanged as well.
+	static void refitAncestors(Entity& entity)
+	{
+		for (Entity* node = entity.parent; node; node = node->parent)
+		{
+			const BoundingBox previous = node->subtreeBounds;
+			node->computeSubtreeBounds();
+			if (previous.min == node->subtreeBounds.min && previous.max == node->subtreeBounds.max)
+				break;
+		}
+	}
+
+	static void detachNodes(Entity& root)
+	{
+		root.transform.setListener(nullptr, nullptr);
+		for (auto&& child : root.children)
+			detachNodes(*child);
+	}
+};
+#endif
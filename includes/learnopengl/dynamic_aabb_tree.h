@@ -0,0 +1,487 @@
+#ifndef DYNAMIC_AABB_TREE_H
+#define DYNAMIC_AABB_TREE_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/entity.h>
+#include <learnopengl/bounding_box.h>
+#include <learnopengl/dirty_transform_list.h>
+
+#include <vector> //std::vector
+#include <cstdint> //int32_t
+#include <cassert> //assert
+
+//Incremental bounding volume hierarchy over moving boxes (same design as the Box2D dynamic tree).
+//Leaves store a fattened box, so small movements do not touch the tree at all; larger ones
+//remove and reinsert the leaf in O(log n). The tree is kept balanced with AVL style rotations.
+class DynamicAABBTree
+{
+public:
+	static constexpr int32_t nullNode = -1;
+
+	//Margin added around every leaf box, in world units
+	explicit DynamicAABBTree(float fatMargin = 0.5f)
+		: m_fatMargin{ fatMargin }
+	{}
+
+	//Returns the proxy id used by the other calls
+	int32_t createProxy(const BoundingBox& box, void* userData)
+	{
+		const int32_t proxy = allocateNode();
+		m_nodes[proxy].box = BoundingBox(box.min - glm::vec3(m_fatMargin), box.max + glm::vec3(m_fatMargin));
+		m_nodes[proxy].userData = userData;
+		m_nodes[proxy].height = 0;
+		insertLeaf(proxy);
+		return proxy;
+	}
+
+	void destroyProxy(int32_t proxy)
+	{
+		assert(isLeaf(proxy));
+		removeLeaf(proxy);
+		freeNode(proxy);
+	}
+
+	//Update the box of a proxy. displacement is the expected movement until the next call, the fat box
+	//is extended in that direction to predict it. Returns true if the tree had to be modified.
+	bool moveProxy(int32_t proxy, const BoundingBox& box, const glm::vec3& displacement = glm::vec3(0.f))
+	{
+		assert(isLeaf(proxy));
+		if (m_nodes[proxy].box.contains(box))
+			return false;
+
+		removeLeaf(proxy);
+
+		BoundingBox fatBox(box.min - glm::vec3(m_fatMargin), box.max + glm::vec3(m_fatMargin));
+		fatBox.min += glm::min(displacement * 2.f, glm::vec3(0.f));
+		fatBox.max += glm::max(displacement * 2.f, glm::vec3(0.f));
+		m_nodes[proxy].box = fatBox;
+
+		insertLeaf(proxy);
+		return true;
+	}
+
+	void* getUserData(int32_t proxy) const
+	{
+		return m_nodes[proxy].userData;
+	}
+
+	const BoundingBox& getFatBox(int32_t proxy) const
+	{
+		return m_nodes[proxy].box;
+	}
+
+	//callback(proxy, userData) for every leaf touching the frustum. Fully inside subtrees are reported
+	//without testing their nodes, fully outside ones are skipped, so the cost follows what is visible.
+	template<typename TCallback>
+	void queryFrustum(const Frustum& frustum, TCallback&& callback) const
+	{
+		if (m_root == nullNode)
+			return;
+
+		//Local stack so queries can run concurrently from several jobs
+		std::vector<int32_t> stack{ m_root };
+		while (!stack.empty())
+		{
+			const int32_t nodeId = stack.back();
+			stack.pop_back();
+			const Node& node = m_nodes[nodeId];
+
+			const FrustumTest test = testFrustum(frustum, node.box);
+			if (test == FrustumTest::outside)
+				continue;
+
+			if (test == FrustumTest::inside)
+				reportSubtree(nodeId, callback);
+			else if (node.isLeaf())
+				callback(nodeId, node.userData);
+			else
+			{
+				stack.push_back(node.child1);
+				stack.push_back(node.child2);
+			}
+		}
+	}
+
+	//callback(proxy, userData) for every leaf whose fat box overlaps the sphere
+	template<typename TCallback>
+	void querySphere(const glm::vec3& center, float radius, TCallback&& callback) const
+	{
+		query([&](const BoundingBox& box) { return box.overlapsSphere(center, radius); }, callback);
+	}
+
+	//callback(proxy, userData) for every leaf whose fat box overlaps box
+	template<typename TCallback>
+	void queryBox(const BoundingBox& box, TCallback&& callback) const
+	{
+		query([&](const BoundingBox& nodeBox) { return nodeBox.overlaps(box); }, callback);
+	}
+
+	//Walk the leaves hit by the ray, nearest boxes are not guaranteed to come first.
+	//callback(proxy, userData, tEnter) returns the new maximum distance: the hit distance to only look for
+	//closer hits, maxDistance to keep all of them, 0 to stop.
+	template<typename TCallback>
+	void rayCast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, TCallback&& callback) const
+	{
+		if (m_root == nullNode)
+			return;
+
+		const glm::vec3 invDir = 1.f / direction;
+		std::vector<int32_t> stack{ m_root };
+		while (!stack.empty())
+		{
+			const int32_t nodeId = stack.back();
+			stack.pop_back();
+			const Node& node = m_nodes[nodeId];
+
+			float tEnter;
+			if (!node.box.intersectsRay(origin, invDir, maxDistance, tEnter))
+				continue;
+
+			if (node.isLeaf())
+			{
+				maxDistance = callback(nodeId, node.userData, tEnter);
+				if (maxDistance <= 0.f)
+					return;
+			}
+			else
+			{
+				stack.push_back(node.child1);
+				stack.push_back(node.child2);
+			}
+		}
+	}
+
+	int32_t getHeight() const
+	{
+		return m_root == nullNode ? 0 : m_nodes[m_root].height;
+	}
+
+	size_t getProxyCount() const
+	{
+		return m_proxyCount;
+	}
+
+private:
+	struct Node
+	{
+		BoundingBox box;
+		void* userData = nullptr;
+		int32_t parent = nullNode; //next free node when in the free list
+		int32_t child1 = nullNode;
+		int32_t child2 = nullNode;
+		int32_t height = -1; //leaf = 0, free node = -1
+
+		bool isLeaf() const
+		{
+			return child1 == nullNode;
+		}
+	};
+
+	std::vector<Node> m_nodes;
+	int32_t m_root = nullNode;
+	int32_t m_freeList = nullNode;
+	size_t m_proxyCount = 0;
+	float m_fatMargin;
+
+	bool isLeaf(int32_t nodeId) const
+	{
+		return nodeId >= 0 && static_cast<size_t>(nodeId) < m_nodes.size() && m_nodes[nodeId].height == 0;
+	}
+
+	int32_t allocateNode()
+	{
+		int32_t nodeId;
+		if (m_freeList != nullNode)
+		{
+			nodeId = m_freeList;
+			m_freeList = m_nodes[nodeId].parent;
+			m_nodes[nodeId] = Node{};
+		}
+		else
+		{
+			nodeId = static_cast<int32_t>(m_nodes.size());
+			m_nodes.emplace_back();
+		}
+		return nodeId;
+	}
+
+	void freeNode(int32_t nodeId)
+	{
+		m_nodes[nodeId].parent = m_freeList;
+		m_nodes[nodeId].height = -1;
+		m_freeList = nodeId;
+	}
+
+	template<typename TOverlap, typename TCallback>
+	void query(TOverlap&& overlaps, TCallback&& callback) const
+	{
+		if (m_root == nullNode)
+			return;
+
+		std::vector<int32_t> stack{ m_root };
+		while (!stack.empty())
+		{
+			const int32_t nodeId = stack.back();
+			stack.pop_back();
+			const Node& node = m_nodes[nodeId];
+			if (!overlaps(node.box))
+				continue;
+
+			if (node.isLeaf())
+				callback(nodeId, node.userData);
+			else
+			{
+				stack.push_back(node.child1);
+				stack.push_back(node.child2);
+			}
+		}
+	}
+
+	template<typename TCallback>
+	void reportSubtree(int32_t nodeId, TCallback& callback) const
+	{
+		const Node& node = m_nodes[nodeId];
+		if (node.isLeaf())
+		{
+			callback(nodeId, node.userData);
+			return;
+		}
+		reportSubtree(node.child1, callback);
+		reportSubtree(node.child2, callback);
+	}
+
+	//Descend along the sibling that increases the total surface area the least
+	void insertLeaf(int32_t leaf)
+	{
+		++m_proxyCount;
+		if (m_root == nullNode)
+		{
+			m_root = leaf;
+			m_nodes[leaf].parent = nullNode;
+			return;
+		}
+
+		const BoundingBox leafBox = m_nodes[leaf].box;
+		int32_t index = m_root;
+		while (!m_nodes[index].isLeaf())
+		{
+			const Node& node = m_nodes[index];
+			const float area = node.box.getHalfSurfaceArea();
+			const float combinedArea = BoundingBox::merged(node.box, leafBox).getHalfSurfaceArea();
+
+			//Cost of creating a new parent for this node and the new leaf
+			const float cost = 2.f * combinedArea;
+			//Minimum cost of pushing the leaf further down the tree
+			const float inheritanceCost = 2.f * (combinedArea - area);
+
+			const float cost1 = descentCost(node.child1, leafBox, inheritanceCost);
+			const float cost2 = descentCost(node.child2, leafBox, inheritanceCost);
+
+			if (cost < cost1 && cost < cost2)
+				break;
+
+			index = cost1 < cost2 ? node.child1 : node.child2;
+		}
+
+		//Create a new parent holding the sibling and the leaf
+		const int32_t sibling = index;
+		const int32_t oldParent = m_nodes[sibling].parent;
+		const int32_t newParent = allocateNode();
+		m_nodes[newParent].parent = oldParent;
+		m_nodes[newParent].box = BoundingBox::merged(leafBox, m_nodes[sibling].box);
+		m_nodes[newParent].height = m_nodes[sibling].height + 1;
+		m_nodes[newParent].child1 = sibling;
+		m_nodes[newParent].child2 = leaf;
+		m_nodes[sibling].parent = newParent;
+		m_nodes[leaf].parent = newParent;
+
+		if (oldParent != nullNode)
+		{
+			if (m_nodes[oldParent].child1 == sibling)
+				m_nodes[oldParent].child1 = newParent;
+			else
+				m_nodes[oldParent].child2 = newParent;
+		}
+		else
+		{
+			m_root = newParent;
+		}
+
+		refit(m_nodes[leaf].parent);
+	}
+
+	float descentCost(int32_t child, const BoundingBox& leafBox, float inheritanceCost) const
+	{
+		const BoundingBox box = BoundingBox::merged(leafBox, m_nodes[child].box);
+		if (m_nodes[child].isLeaf())
+			return box.getHalfSurfaceArea() + inheritanceCost;
+		return (box.getHalfSurfaceArea() - m_nodes[child].box.getHalfSurfaceArea()) + inheritanceCost;
+	}
+
+	void removeLeaf(int32_t leaf)
+	{
+		--m_proxyCount;
+		if (leaf == m_root)
+		{
+			m_root = nullNode;
+			return;
+		}
+
+		const int32_t parent = m_nodes[leaf].parent;
+		const int32_t grandParent = m_nodes[parent].parent;
+		const int32_t sibling = m_nodes[parent].child1 == leaf ? m_nodes[parent].child2 : m_nodes[parent].child1;
+
+		if (grandParent != nullNode)
+		{
+			//Destroy parent and connect sibling to grandParent
+			if (m_nodes[grandParent].child1 == parent)
+				m_nodes[grandParent].child1 = sibling;
+			else
+				m_nodes[grandParent].child2 = sibling;
+			m_nodes[sibling].parent = grandParent;
+			freeNode(parent);
+
+			refit(grandParent);
+		}
+		else
+		{
+			m_root = sibling;
+			m_nodes[sibling].parent = nullNode;
+			freeNode(parent);
+		}
+	}
+
+	//Walk back up to the root fixing heights and boxes, rebalancing on the way
+	void refit(int32_t index)
+	{
+		while (index != nullNode)
+		{
+			index = balance(index);
+
+			Node& node = m_nodes[index];
+			node.height = 1 + std::max(m_nodes[node.child1].height, m_nodes[node.child2].height);
+			node.box = BoundingBox::merged(m_nodes[node.child1].box, m_nodes[node.child2].box);
+
+			index = node.parent;
+		}
+	}
+
+	//Rotate A up if one of its subtrees is more than one level taller than the other. Returns the new subtree root.
+	int32_t balance(int32_t iA)
+	{
+		Node& A = m_nodes[iA];
+		if (A.isLeaf() || A.height < 2)
+			return iA;
+
+		const int32_t iB = A.child1;
+		const int32_t iC = A.child2;
+		const int32_t heightDiff = m_nodes[iC].height - m_nodes[iB].height;
+
+		if (heightDiff > 1)
+			return rotateUp(iA, iC, iB);
+		if (heightDiff < -1)
+			return rotateUp(iA, iB, iC);
+		return iA;
+	}
+
+	//Promote the tall child iHigh of iA in place of iA, iA keeps iLow and the shortest grandchild
+	int32_t rotateUp(int32_t iA, int32_t iHigh, int32_t iLow)
+	{
+		Node& A = m_nodes[iA];
+		Node& H = m_nodes[iHigh];
+		const int32_t iF = H.child1;
+		const int32_t iG = H.child2;
+
+		//Swap A and H
+		H.child1 = iA;
+		H.parent = A.parent;
+		A.parent = iHigh;
+
+		if (H.parent != nullNode)
+		{
+			if (m_nodes[H.parent].child1 == iA)
+				m_nodes[H.parent].child1 = iHigh;
+			else
+				m_nodes[H.parent].child2 = iHigh;
+		}
+		else
+		{
+			m_root = iHigh;
+		}
+
+		//Keep the taller grandchild under H, give the other one to A
+		const bool keepF = m_nodes[iF].height > m_nodes[iG].height;
+		const int32_t iKeep = keepF ? iF : iG;
+		const int32_t iGive = keepF ? iG : iF;
+
+		H.child2 = iKeep;
+		if (A.child1 == iHigh)
+			A.child1 = iGive;
+		else
+			A.child2 = iGive;
+		m_nodes[iGive].parent = iA;
+
+		A.box = BoundingBox::merged(m_nodes[iLow].box, m_nodes[iGive].box);
+		A.height = 1 + std::max(m_nodes[iLow].height, m_nodes[iGive].height);
+		H.box = BoundingBox::merged(A.box, m_nodes[iKeep].box);
+		H.height = 1 + std::max(A.height, m_nodes[iKeep].height);
+
+		return iHigh;
+	}
+};
+
+//World space box of an entity, the same as Entity::getGlobalAABB in min/max form
+inline BoundingBox getEntityWorldBox(Entity& entity)
+{
+	const AABB globalAABB = entity.getGlobalAABB();
+	return BoundingBox::fromCenterExtents(globalAABB.center, globalAABB.extents);
+}
+
+//Register root and all its descendants in tree. Their proxy ids are stored in Entity::spatialProxy.
+inline void insertEntityTree(DynamicAABBTree& tree, Entity& root)
+{
+	root.spatialProxy = tree.createProxy(getEntityWorldBox(root), &root);
+	for (auto&& child : root.children)
+		insertEntityTree(tree, *child);
+}
+
+//Bring the proxies of root and its descendants up to date after their transforms changed
+inline void updateEntityTree(DynamicAABBTree& tree, Entity& root)
+{
+	tree.moveProxy(root.spatialProxy, getEntityWorldBox(root));
+	for (auto&& child : root.children)
+		updateEntityTree(tree, *child);
+}
+
+//Moves only the proxies of the entities a DirtyTransformList reports, instead of updateEntityTree on the whole scene
+class EntityTreeSync : public TransformChangeListener
+{
+public:
+	EntityTreeSync(DynamicAABBTree& tree) : m_tree{ tree } {}
+
+	void onTransformsChanged(const std::vector<Entity*>& changed) override
+	{
+		for (Entity* entity : changed)
+		{
+			if (entity->spatialProxy >= 0)
+				m_tree.moveProxy(entity->spatialProxy, entity->worldBounds);
+		}
+	}
+
+private:
+	DynamicAABBTree& m_tree;
+};
+
+//Draw the entities of tree touching the frustum, the spatial counterpart of Entity::drawSelfAndChild
+inline void drawVisibleEntities(const DynamicAABBTree& tree, const Frustum& frustum, Shader& ourShader, unsigned int& display)
+{
+	tree.queryFrustum(frustum, [&](int32_t, void* userData)
+		{
+			Entity& entity = *static_cast<Entity*>(userData);
+			ourShader.setMat4("model", entity.transform.getModelMatrix());
+			entity.pModel->Draw(ourShader);
+			display++;
+		});
+}
+#endif
@@ -5,64 +5,111 @@
 #include <list> //std::list
 #include <array> //std::array
 #include <memory> //std::unique_ptr
+#include <cstdint> //uint8_t
+
+#include <learnopengl/bounding_box.h>
+#include <learnopengl/bounds_builder.h>
+#include <learnopengl/affine_transform.h>
+
+class Entity;
+class LodChain;
+
+//Told when the transform of an entity goes from clean to dirty, see DirtyTransformList
+class TransformDirtyListener
+{
+public:
+	virtual ~TransformDirtyListener() = default;
+	virtual void onTransformDirty(Entity& entity) = 0;
+};
 
 class Transform
 {
 protected:
 	//Local space information
 	glm::vec3 m_pos = { 0.0f, 0.0f, 0.0f };
-	glm::vec3 m_eulerRot = { 0.0f, 0.0f, 0.0f }; //In degrees
+	glm::quat m_rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
 	glm::vec3 m_scale = { 1.0f, 1.0f, 1.0f };
 
-	//Global space information concatenate in matrix
-	glm::mat4 m_modelMatrix = glm::mat4(1.0f);
+	//Global space information concatenate in an affine matrix, the last row (0, 0, 0, 1) is implied
+	glm::mat4x3 m_modelMatrix = glm::mat4x3(1.0f);
 
 	//Dirty flag
 	bool m_isDirty = true;
 
+	//Optional, receives owner the first time the transform becomes dirty after an update
+	TransformDirtyListener* m_listener = nullptr;
+	Entity* m_owner = nullptr;
+
 protected:
-	glm::mat4 getLocalModelMatrix()
+	glm::mat4x3 getLocalModelMatrix() const
 	{
-		const glm::mat4 transformX = glm::rotate(glm::mat4(1.0f), glm::radians(m_eulerRot.x), glm::vec3(1.0f, 0.0f, 0.0f));
-		const glm::mat4 transformY = glm::rotate(glm::mat4(1.0f), glm::radians(m_eulerRot.y), glm::vec3(0.0f, 1.0f, 0.0f));
-		const glm::mat4 transformZ = glm::rotate(glm::mat4(1.0f), glm::radians(m_eulerRot.z), glm::vec3(0.0f, 0.0f, 1.0f));
-
-		// Y * X * Z
-		const glm::mat4 rotationMatrix = transformY * transformX * transformZ;
+		return composeAffine(m_pos, m_rotation, m_scale);
+	}
 
-		// translation * rotation * scale (also know as TRS matrix)
-		return glm::translate(glm::mat4(1.0f), m_pos) * rotationMatrix * glm::scale(glm::mat4(1.0f), m_scale);
+	void markDirty()
+	{
+		if (!m_isDirty && m_listener)
+			m_listener->onTransformDirty(*m_owner);
+		m_isDirty = true;
 	}
 public:
 
+	//A transform already dirty is reported at once, it would not be otherwise until its next update
+	void setListener(TransformDirtyListener* listener, Entity* owner)
+	{
+		m_listener = listener;
+		m_owner = owner;
+		if (m_isDirty && m_listener)
+			m_listener->onTransformDirty(*m_owner);
+	}
+
+	TransformDirtyListener* getListener() const
+	{
+		return m_listener;
+	}
+
 	void computeModelMatrix()
 	{
 		m_modelMatrix = getLocalModelMatrix();
 		m_isDirty = false;
 	}
 
-	void computeModelMatrix(const glm::mat4& parentGlobalModelMatrix)
+	void computeModelMatrix(const glm::mat4x3& parentGlobalModelMatrix)
 	{
-		m_modelMatrix = parentGlobalModelMatrix * getLocalModelMatrix();
+		m_modelMatrix = multiplyAffine(parentGlobalModelMatrix, getLocalModelMatrix());
+		m_isDirty = false;
+	}
+
+	//Model matrix saved along the local transform, e.g. in a scene file. It must match the current parent.
+	void restoreModelMatrix(const glm::mat4x3& savedModelMatrix)
+	{
+		m_modelMatrix = savedModelMatrix;
 		m_isDirty = false;
 	}
 
 	void setLocalPosition(const glm::vec3& newPosition)
 	{
 		m_pos = newPosition;
-		m_isDirty = true;
+		markDirty();
 	}
 
+	//Euler angles in degrees, applied in the Y * X * Z order. Converted once here, not at every update.
 	void setLocalRotation(const glm::vec3& newRotation)
 	{
-		m_eulerRot = newRotation;
-		m_isDirty = true;
+		m_rotation = eulerDegreesToQuat(newRotation);
+		markDirty();
+	}
+
+	void setLocalRotation(const glm::quat& newRotation)
+	{
+		m_rotation = glm::normalize(newRotation);
+		markDirty();
 	}
 
 	void setLocalScale(const glm::vec3& newScale)
 	{
 		m_scale = newScale;
-		m_isDirty = true;
+		markDirty();
 	}
 
 	const glm::vec3& getGlobalPosition() const
@@ -75,9 +122,15 @@ public:
 		return m_pos;
 	}
 
-	const glm::vec3& getLocalRotation() const
+	//Euler angles in degrees recovered from the quaternion
+	glm::vec3 getLocalRotation() const
+	{
+		return quatToEulerDegrees(m_rotation);
+	}
+
+	const glm::quat& getLocalOrientation() const
 	{
-		return m_eulerRot;
+		return m_rotation;
 	}
 
 	const glm::vec3& getLocalScale() const
@@ -85,23 +138,29 @@ public:
 		return m_scale;
 	}
 
-	const glm::mat4& getModelMatrix() const
+	//Expanded to 4x4 for the shaders and the code expecting one, prefer getAffineMatrix otherwise
+	glm::mat4 getModelMatrix() const
+	{
+		return glm::mat4(m_modelMatrix);
+	}
+
+	const glm::mat4x3& getAffineMatrix() const
 	{
 		return m_modelMatrix;
 	}
 
-	glm::vec3 getRight() const
+	const glm::vec3& getRight() const
 	{
 		return m_modelMatrix[0];
 	}
 
 
-	glm::vec3 getUp() const
+	const glm::vec3& getUp() const
 	{
 		return m_modelMatrix[1];
 	}
 
-	glm::vec3 getBackward() const
+	const glm::vec3& getBackward() const
 	{
 		return m_modelMatrix[2];
 	}
@@ -150,8 +209,72 @@ struct Frustum
 
 	Plane farFace;
 	Plane nearFace;
+
+	static constexpr int planeCount = 6;
+
+	//Planes in test order, the ones which reject the most come first. Bit i of a plane mask refers to getPlane(i).
+	const Plane& getPlane(int index) const
+	{
+		const Plane* planes[planeCount] = { &leftFace, &rightFace, &topFace, &bottomFace, &nearFace, &farFace };
+		return *planes[index];
+	}
 };
 
+enum class FrustumTest
+{
+	outside,
+	intersect,
+	inside
+};
+
+constexpr uint8_t allFrustumPlanes = 0x3F;
+
+//Classify a box against the planes of planeMask. The planes the box is fully in front of are removed from
+//planeMask, so the children of a node only test the planes their parent still straddles. lastRejectPlane
+//is tested first (plane coherency) and receives the plane that rejected the box, if any.
+inline FrustumTest testFrustum(const Frustum& frustum, const BoundingBox& box, uint8_t& planeMask, uint8_t& lastRejectPlane)
+{
+	const glm::vec3 center = box.getCenter();
+	const glm::vec3 extents = box.getExtents();
+
+	auto isOutside = [&](int index)
+	{
+		const Plane& plane = frustum.getPlane(index);
+		const float r = extents.x * std::abs(plane.normal.x) + extents.y * std::abs(plane.normal.y) +
+			extents.z * std::abs(plane.normal.z);
+		const float distance = plane.getSignedDistanceToPlane(center);
+		if (distance < -r)
+			return true;
+		//Fully in front, no descendant can cross this plane
+		if (distance >= r)
+			planeMask &= ~(1u << index);
+		return false;
+	};
+
+	if ((planeMask & (1u << lastRejectPlane)) && isOutside(lastRejectPlane))
+		return FrustumTest::outside;
+
+	for (int i = 0; i < Frustum::planeCount; ++i)
+	{
+		if (i == lastRejectPlane || !(planeMask & (1u << i)))
+			continue;
+
+		if (isOutside(i))
+		{
+			lastRejectPlane = static_cast<uint8_t>(i);
+			return FrustumTest::outside;
+		}
+	}
+	return planeMask ? FrustumTest::intersect : FrustumTest::inside;
+}
+
+inline FrustumTest testFrustum(const Frustum& frustum, const BoundingBox& box)
+{
+	uint8_t planeMask = allFrustumPlanes;
+	uint8_t lastRejectPlane = 0;
+	return testFrustum(frustum, box, planeMask, lastRejectPlane);
+}
+
 struct BoundingVolume
 {
 	virtual bool isOnFrustum(const Frustum& camFrustum, const Transform& transform) const = 0;
@@ -189,13 +312,12 @@ struct Sphere : public BoundingVolume
 		const glm::vec3 globalScale = transform.getGlobalScale();
 
 		//Get our global center with process it with the global model matrix of our transform
-		const glm::vec3 globalCenter{ transform.getModelMatrix() * glm::vec4(center, 1.f) };
+		const glm::vec3 globalCenter{ transform.getAffineMatrix() * glm::vec4(center, 1.f) };
 
 		//To wrap correctly our shape, we need the maximum scale scalar.
 		const float maxScale = std::max(std::max(globalScale.x, globalScale.y), globalScale.z);
 
-		//Max scale is assuming for the diameter. So, we need the half to apply it to our radius
-		Sphere globalSphere(globalCenter, radius * (maxScale * 0.5f));
+		Sphere globalSphere(globalCenter, radius * maxScale);
 
 		//Check Firstly the result that have the most chance to failure to avoid to call all functions.
 		return (globalSphere.isOnOrForwardPlane(camFrustum.leftFace) &&
@@ -226,7 +348,7 @@ struct SquareAABB : public BoundingVolume
 	bool isOnFrustum(const Frustum& camFrustum, const Transform& transform) const final
 	{
 		//Get global scale thanks to our transform
-		const glm::vec3 globalCenter{ transform.getModelMatrix() * glm::vec4(center, 1.f) };
+		const glm::vec3 globalCenter{ transform.getAffineMatrix() * glm::vec4(center, 1.f) };
 
 		// Scaled orientation
 		const glm::vec3 right = transform.getRight() * extent;
@@ -296,7 +418,7 @@ struct AABB : public BoundingVolume
 	bool isOnFrustum(const Frustum& camFrustum, const Transform& transform) const final
 	{
 		//Get global scale thanks to our transform
-		const glm::vec3 globalCenter{ transform.getModelMatrix() * glm::vec4(center, 1.f) };
+		const glm::vec3 globalCenter{ transform.getAffineMatrix() * glm::vec4(center, 1.f) };
 
 		// Scaled orientation
 		const glm::vec3 right = transform.getRight() * extents.x;
@@ -344,43 +466,47 @@ Frustum createFrustumFromCamera(const Camera& cam, float aspect, float fovY, flo
 
 AABB generateAABB(const Model& model)
 {
-	glm::vec3 minAABB = glm::vec3(std::numeric_limits<float>::max());
-	glm::vec3 maxAABB = glm::vec3(std::numeric_limits<float>::min());
+	BoundingBox box;
 	for (auto&& mesh : model.meshes)
 	{
-		for (auto&& vertex : mesh.vertices)
-		{
-			minAABB.x = std::min(minAABB.x, vertex.Position.x);
-			minAABB.y = std::min(minAABB.y, vertex.Position.y);
-			minAABB.z = std::min(minAABB.z, vertex.Position.z);
-
-			maxAABB.x = std::max(maxAABB.x, vertex.Position.x);
-			maxAABB.y = std::max(maxAABB.y, vertex.Position.y);
-			maxAABB.z = std::max(maxAABB.z, vertex.Position.z);
-		}
+		if (!mesh.vertices.empty())
+			box.merge(computeBoundingBox(PositionStream(&mesh.vertices[0].Position, mesh.vertices.size(), sizeof(Vertex))));
 	}
-	return AABB(minAABB, maxAABB);
+	if (!box.isValid())
+		return AABB(glm::vec3(0.f), glm::vec3(0.f));
+	return AABB(box.min, box.max);
 }
 
 Sphere generateSphereBV(const Model& model)
 {
-	glm::vec3 minAABB = glm::vec3(std::numeric_limits<float>::max());
-	glm::vec3 maxAABB = glm::vec3(std::numeric_limits<float>::min());
+	//Sphere of each mesh read in place, merged into one, then shrunk to the farthest vertex of every mesh
+	std::vector<PositionStream> streams;
+	BoundingSphere sphere;
 	for (auto&& mesh : model.meshes)
 	{
-		for (auto&& vertex : mesh.vertices)
-		{
-			minAABB.x = std::min(minAABB.x, vertex.Position.x);
-			minAABB.y = std::min(minAABB.y, vertex.Position.y);
-			minAABB.z = std::min(minAABB.z, vertex.Position.z);
+		if (mesh.vertices.empty())
+			continue;
 
-			maxAABB.x = std::max(maxAABB.x, vertex.Position.x);
-			maxAABB.y = std::max(maxAABB.y, vertex.Position.y);
-			maxAABB.z = std::max(maxAABB.z, vertex.Position.z);
+		streams.emplace_back(&mesh.vertices[0].Position, mesh.vertices.size(), sizeof(Vertex));
+		const BoundingSphere meshSphere = computeBoundingSphere(streams.back());
+		const glm::vec3 d = meshSphere.center - sphere.center;
+		const float distance = glm::length(d);
+		if (!sphere.isValid() || distance + sphere.radius <= meshSphere.radius)
+			sphere = meshSphere;
+		else if (distance + meshSphere.radius > sphere.radius)
+		{
+			const float newRadius = (distance + sphere.radius + meshSphere.radius) * 0.5f;
+			sphere.center += d * ((newRadius - sphere.radius) / distance);
+			sphere.radius = newRadius;
 		}
 	}
+	if (!sphere.isValid())
+		return Sphere(glm::vec3(0.f), 0.f);
 
-	return Sphere((maxAABB + minAABB) * 0.5f, glm::length(minAABB - maxAABB));
+	float radius2 = 0.f;
+	for (auto&& stream : streams)
+		radius2 = std::max(radius2, bounds_builder_detail::computeMaxDistance2(stream, sphere.center, JobSystem::instance()));
+	return Sphere(sphere.center, std::sqrt(radius2));
 }
 
 class Entity
@@ -396,6 +522,20 @@ public:
 	Model* pModel = nullptr;
 	std::unique_ptr<AABB> boundingVolume;
 
+	//Optional models of lower detail, level 0 is pModel. See lod_selection.h, the level drawn last frame is kept by
+	//each RenderList since views differ.
+	const LodChain* pLods = nullptr;
+
+	//Proxy in a DynamicAABBTree, -1 if not registered
+	int spatialProxy = -1;
+
+	//World space box of this entity and of its whole subtree, refreshed by the update functions
+	BoundingBox worldBounds;
+	BoundingBox subtreeBounds;
+
+	//Plane that rejected this node the last time it was culled, tested first next frame
+	mutable uint8_t lastRejectPlane = 0;
+
 
 	// constructor, expects a filepath to a 3D model.
 	Entity(Model& model) : pModel{ &model }
@@ -404,10 +544,16 @@ public:
 		//boundingVolume = std::make_unique<Sphere>(generateSphereBV(model));
 	}
 
+	//Bounds already known, e.g. loaded with the scene, skips the pass over the vertices
+	Entity(Model& model, const AABB& modelBounds) : pModel{ &model }
+	{
+		boundingVolume = std::make_unique<AABB>(modelBounds);
+	}
+
 	AABB getGlobalAABB()
 	{
 		//Get global scale thanks to our transform
-		const glm::vec3 globalCenter{ transform.getModelMatrix() * glm::vec4(boundingVolume->center, 1.f) };
+		const glm::vec3 globalCenter{ transform.getAffineMatrix() * glm::vec4(boundingVolume->center, 1.f) };
 
 		// Scaled orientation
 		const glm::vec3 right = transform.getRight() * boundingVolume->extents.x;
@@ -435,51 +581,114 @@ public:
 	{
 		children.emplace_back(std::make_unique<Entity>(args...));
 		children.back()->parent = this;
+		//A child added to a tracked scene is tracked as well
+		if (transform.getListener())
+			children.back()->transform.setListener(transform.getListener(), children.back().get());
 	}
 
-	//Update transform if it was changed
-	void updateSelfAndChild()
+	//Update transform if it was changed. Returns true if something moved in the subtree.
+	bool updateSelfAndChild()
 	{
 		if (transform.isDirty()) {
 			forceUpdateSelfAndChild();
-			return;
+			return true;
 		}
-			
+
+		bool hasChanged = false;
 		for (auto&& child : children)
 		{
-			child->updateSelfAndChild();
+			hasChanged |= child->updateSelfAndChild();
 		}
+
+		//A moved descendant changes the subtree bounds of all its ancestors
+		if (hasChanged)
+			computeSubtreeBounds();
+		return hasChanged;
 	}
 
 	//Force update of transform even if local space don't change
 	void forceUpdateSelfAndChild()
+	{
+		forceUpdateSelfAndChild([](Entity&) {});
+	}
+
+	//Same, onUpdated(Entity&) is called for every entity of the subtree once its matrix and bounds are final
+	template<typename TVisitor>
+	void forceUpdateSelfAndChild(TVisitor&& onUpdated)
 	{
 		if (parent)
-			transform.computeModelMatrix(parent->transform.getModelMatrix());
+			transform.computeModelMatrix(parent->transform.getAffineMatrix());
 		else
 			transform.computeModelMatrix();
 
 		for (auto&& child : children)
 		{
-			child->forceUpdateSelfAndChild();
+			child->forceUpdateSelfAndChild(onUpdated);
 		}
-	}
 
+		const AABB globalAABB = getGlobalAABB();
+		worldBounds = BoundingBox::fromCenterExtents(globalAABB.center, globalAABB.extents);
+		computeSubtreeBounds();
+		onUpdated(*this);
+	}
 
-	void drawSelfAndChild(const Frustum& frustum, Shader& ourShader, unsigned int& display, unsigned int& total)
+	void computeSubtreeBounds()
 	{
-		if (boundingVolume->isOnFrustum(frustum, transform))
+		subtreeBounds = worldBounds;
+		for (auto&& child : children)
 		{
-			ourShader.setMat4("model", transform.getModelMatrix());
-			pModel->Draw(ourShader);
-			display++;
+			subtreeBounds.merge(child->subtreeBounds);
 		}
+	}
+
+	//Hierarchical culling: whole subtrees outside the frustum are rejected with one test, subtrees inside
+	//are accepted without any, and the others only test the planes their parent straddles.
+	//visitor(const Entity&) is called for every visible entity, total counts the visited nodes.
+	template<typename TVisitor>
+	void cullSelfAndChild(const Frustum& frustum, TVisitor&& visitor, unsigned int& total, uint8_t planeMask = allFrustumPlanes) const
+	{
 		total++;
+		const FrustumTest subtreeTest = testFrustum(frustum, subtreeBounds, planeMask, lastRejectPlane);
+		if (subtreeTest == FrustumTest::outside)
+			return;
+
+		if (subtreeTest == FrustumTest::inside)
+		{
+			visitSelfAndChild(visitor, total);
+			return;
+		}
 
+		//Own box with the planes the subtree still straddles
+		uint8_t selfPlaneMask = planeMask;
+		if (testFrustum(frustum, worldBounds, selfPlaneMask, lastRejectPlane) != FrustumTest::outside)
+			visitor(*this);
+
+		for (auto&& child : children)
+		{
+			child->cullSelfAndChild(frustum, visitor, total, planeMask);
+		}
+	}
+
+	template<typename TVisitor>
+	void visitSelfAndChild(TVisitor&& visitor, unsigned int& total) const
+	{
+		visitor(*this);
 		for (auto&& child : children)
 		{
-			child->drawSelfAndChild(frustum, ourShader, display, total);
+			total++;
+			child->visitSelfAndChild(visitor, total);
 		}
 	}
+
+
+	void drawSelfAndChild(const Frustum& frustum, Shader& ourShader, unsigned int& display, unsigned int& total)
+	{
+		cullSelfAndChild(frustum, [&](const Entity& entity)
+			{
+				ourShader.setMat4("model", entity.transform.getModelMatrix());
+				entity.pModel->Draw(ourShader);
+				display++;
+			}, total);
+	}
 };
 #endif
@@ -0,0 +1,304 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader_c.h>
+#include <learnopengl/entity.h>
+
+#include <vector> //std::vector
+#include <cstdint> //uint32_t
+#include <algorithm> //std::max
+
+//Instance as seen by the shaders, std430 layout. The bounds are the world AABB of the instance.
+struct GpuInstance
+{
+	glm::mat4 model = glm::mat4(1.0f);
+	glm::vec4 boundsCenter = glm::vec4(0.f);
+	glm::vec4 boundsExtents = glm::vec4(0.f);
+	uint32_t drawId = 0;
+	uint32_t padding[3] = { 0, 0, 0 };
+};
+
+//Layout expected by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+	uint32_t count = 0;
+	uint32_t instanceCount = 0;
+	uint32_t firstIndex = 0;
+	int32_t baseVertex = 0;
+	uint32_t baseInstance = 0;
+};
+
+//GPU driven culling: the instances live in a shader storage buffer and a compute pass tests each of them against
+//the frustum and a hierarchical depth buffer (Hi-Z) built from the previous frame. Survivors are appended with
+//atomics to the indirect draw commands, so the CPU never reads nor writes per instance visibility.
+//
+//Each draw group is a mesh range of the bound VAO with room for `capacity` visible instances, visible instances
+//past it are dropped and its instance count clamped by the compute pass. The index of a
+//visible instance is fed to the vertex shader through an instanced attribute (see setupVisibleInstanceAttribute)
+//and the baseInstance of the command, which works without GL 4.6 draw parameters.
+//
+//Per frame: cull(), draw the groups with draw(), then buildHiZ() with the depth of that frame for the next one.
+class GpuCuller
+{
+public:
+	GpuCuller(const char* hiZBuildPath, const char* cullPath)
+		: m_hiZBuild(hiZBuildPath), m_cull(cullPath)
+	{
+		glGenBuffers(1, &m_instanceBuffer);
+		glGenBuffers(1, &m_commandBuffer);
+		glGenBuffers(1, &m_commandTemplateBuffer);
+		glGenBuffers(1, &m_visibleBuffer);
+		glGenBuffers(1, &m_capacityBuffer);
+	}
+
+	~GpuCuller()
+	{
+		glDeleteBuffers(1, &m_instanceBuffer);
+		glDeleteBuffers(1, &m_commandBuffer);
+		glDeleteBuffers(1, &m_commandTemplateBuffer);
+		glDeleteBuffers(1, &m_visibleBuffer);
+		glDeleteBuffers(1, &m_capacityBuffer);
+		glDeleteTextures(1, &m_hiZ);
+		glDeleteProgram(m_hiZBuild.ID);
+		glDeleteProgram(m_cull.ID);
+	}
+
+	GpuCuller(const GpuCuller&) = delete;
+	GpuCuller& operator=(const GpuCuller&) = delete;
+
+	//Register a range of the index buffer drawn with room for capacity visible instances. Returns the draw id.
+	uint32_t addDrawGroup(uint32_t indexCount, uint32_t firstIndex, int32_t baseVertex, uint32_t capacity)
+	{
+		DrawElementsIndirectCommand command;
+		command.count = indexCount;
+		command.firstIndex = firstIndex;
+		command.baseVertex = baseVertex;
+		command.baseInstance = m_visibleCapacity;
+		m_commands.push_back(command);
+		m_capacities.push_back(capacity);
+		m_visibleCapacity += capacity;
+		m_groupsDirty = true;
+		return static_cast<uint32_t>(m_commands.size() - 1);
+	}
+
+	//Upload every instance. Call again only when they change, the buffer stays on the GPU.
+	void setInstances(const std::vector<GpuInstance>& instances)
+	{
+		m_instanceCount = static_cast<uint32_t>(instances.size());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, instances.size() * sizeof(GpuInstance), instances.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	//Update a range of instances, e.g. the ones that moved this frame
+	void updateInstances(uint32_t first, const GpuInstance* instances, uint32_t count)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(GpuInstance), count * sizeof(GpuInstance), instances);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	//Bind the visible instance indices as an unsigned integer attribute advancing once per instance. The VAO
+	//used to draw the groups must be bound.
+	void setupVisibleInstanceAttribute(GLuint location)
+	{
+		uploadGroups();
+		glBindBuffer(GL_ARRAY_BUFFER, m_visibleBuffer);
+		glEnableVertexAttribArray(location);
+		glVertexAttribIPointer(location, 1, GL_UNSIGNED_INT, sizeof(uint32_t), (void*)0);
+		glVertexAttribDivisor(location, 1);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	//Test every instance and fill the indirect commands. Hi-Z is only used once buildHiZ has been called.
+	void cull(const Frustum& frustum)
+	{
+		uploadGroups();
+
+		//Reset the instance counts without a round trip through the CPU
+		const GLsizeiptr commandsSize = m_commands.size() * sizeof(DrawElementsIndirectCommand);
+		glBindBuffer(GL_COPY_READ_BUFFER, m_commandTemplateBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_commandBuffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, commandsSize);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		glm::vec4 planes[Frustum::planeCount];
+		for (int i = 0; i < Frustum::planeCount; ++i)
+		{
+			const Plane& plane = frustum.getPlane(i);
+			planes[i] = glm::vec4(plane.normal, -plane.distance);
+		}
+
+		m_cull.use();
+		glUniform4fv(glGetUniformLocation(m_cull.ID, "frustumPlanes"), Frustum::planeCount, &planes[0][0]);
+		glUniform1ui(glGetUniformLocation(m_cull.ID, "instanceCount"), m_instanceCount);
+		m_cull.setBool("useHiZ", m_hiZValid);
+		m_cull.setMat4("hiZViewProjection", m_hiZViewProjection);
+		m_cull.setVec2("hiZSize", glm::vec2(m_hiZWidth, m_hiZHeight));
+		m_cull.setInt("hiZLevels", m_hiZLevels);
+		m_cull.setInt("hiZ", 0);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, m_hiZ);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_instanceBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_commandBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_visibleBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_capacityBuffer);
+		glDispatchCompute((m_instanceCount + cullGroupSize - 1) / cullGroupSize, 1, 1);
+
+		//The commands and the visible indices are consumed by the next draw
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	//Draw every group with one call. The VAO set up with setupVisibleInstanceAttribute and the shader must be bound.
+	void draw() const
+	{
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, static_cast<GLsizei>(m_commands.size()), 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+	//Build the Hi-Z pyramid from the depth texture of the frame just drawn with viewProjection. The texture must
+	//be complete without mipmaps (GL_NEAREST filtering) and its compare mode disabled.
+	void buildHiZ(GLuint depthTexture, int width, int height, const glm::mat4& viewProjection)
+	{
+		if (width != m_hiZWidth || height != m_hiZHeight)
+			allocateHiZ(width, height);
+
+		m_hiZBuild.use();
+		m_hiZBuild.setInt("source", 0);
+		glActiveTexture(GL_TEXTURE0);
+
+		int sourceWidth = width, sourceHeight = height;
+		for (int level = 0; level < m_hiZLevels; ++level)
+		{
+			//The first level is a copy of the depth buffer, the next ones keep the farthest depth of their footprint
+			const int levelWidth = level == 0 ? width : std::max(1, sourceWidth / 2);
+			const int levelHeight = level == 0 ? height : std::max(1, sourceHeight / 2);
+
+			glBindTexture(GL_TEXTURE_2D, level == 0 ? depthTexture : m_hiZ);
+			m_hiZBuild.setInt("sourceLevel", level == 0 ? 0 : level - 1);
+			m_hiZBuild.setBool("reduce", level != 0);
+			glUniform2i(glGetUniformLocation(m_hiZBuild.ID, "sourceSize"), sourceWidth, sourceHeight);
+			glUniform2i(glGetUniformLocation(m_hiZBuild.ID, "destinationSize"), levelWidth, levelHeight);
+			glBindImageTexture(0, m_hiZ, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+			glDispatchCompute((levelWidth + hiZGroupSize - 1) / hiZGroupSize, (levelHeight + hiZGroupSize - 1) / hiZGroupSize, 1);
+			glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+			sourceWidth = levelWidth;
+			sourceHeight = levelHeight;
+		}
+
+		m_hiZViewProjection = viewProjection;
+		m_hiZValid = true;
+	}
+
+	//Forget the Hi-Z, e.g. after a camera cut where the previous frame says nothing about the new one
+	void invalidateHiZ()
+	{
+		m_hiZValid = false;
+	}
+
+	//Read back the visible count of every group. Stalls the pipeline, only meant for statistics and debugging.
+	std::vector<uint32_t> readVisibleCounts() const
+	{
+		std::vector<DrawElementsIndirectCommand> commands(m_commands.size());
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+		glGetBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+		std::vector<uint32_t> counts;
+		for (auto&& command : commands)
+			counts.push_back(command.instanceCount);
+		return counts;
+	}
+
+	uint32_t getInstanceCount() const
+	{
+		return m_instanceCount;
+	}
+
+	uint32_t getDrawGroupCount() const
+	{
+		return static_cast<uint32_t>(m_commands.size());
+	}
+
+	GLuint getHiZTexture() const
+	{
+		return m_hiZ;
+	}
+
+	int getHiZLevels() const
+	{
+		return m_hiZLevels;
+	}
+
+private:
+	static constexpr uint32_t cullGroupSize = 64;
+	static constexpr int hiZGroupSize = 8;
+
+	ComputeShader m_hiZBuild;
+	ComputeShader m_cull;
+
+	std::vector<DrawElementsIndirectCommand> m_commands;
+	std::vector<uint32_t> m_capacities;
+	uint32_t m_visibleCapacity = 0;
+	uint32_t m_instanceCount = 0;
+	bool m_groupsDirty = false;
+
+	GLuint m_instanceBuffer = 0;
+	GLuint m_commandBuffer = 0;
+	GLuint m_commandTemplateBuffer = 0;
+	GLuint m_visibleBuffer = 0;
+	GLuint m_capacityBuffer = 0;
+
+	GLuint m_hiZ = 0;
+	int m_hiZWidth = 0;
+	int m_hiZHeight = 0;
+	int m_hiZLevels = 0;
+	glm::mat4 m_hiZViewProjection = glm::mat4(1.0f);
+	bool m_hiZValid = false;
+
+	void uploadGroups()
+	{
+		if (!m_groupsDirty)
+			return;
+
+		const GLsizeiptr commandsSize = m_commands.size() * sizeof(DrawElementsIndirectCommand);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_commandTemplateBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, commandsSize, m_commands.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_commandBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, commandsSize, m_commands.data(), GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_visibleBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, std::max<GLsizeiptr>(1, m_visibleCapacity) * sizeof(uint32_t), nullptr, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_capacityBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, m_capacities.size() * sizeof(uint32_t), m_capacities.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		m_groupsDirty = false;
+	}
+
+	void allocateHiZ(int width, int height)
+	{
+		glDeleteTextures(1, &m_hiZ);
+		m_hiZWidth = width;
+		m_hiZHeight = height;
+		m_hiZLevels = 1;
+		for (int size = std::max(width, height); size > 1; size /= 2)
+			++m_hiZLevels;
+
+		glGenTextures(1, &m_hiZ);
+		glBindTexture(GL_TEXTURE_2D, m_hiZ);
+		glTexStorage2D(GL_TEXTURE_2D, m_hiZLevels, GL_R32F, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		m_hiZValid = false;
+	}
+};
+#endif
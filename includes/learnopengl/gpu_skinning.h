@@ -0,0 +1,230 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/shader_c.h>
+#include <learnopengl/model_animation.h>
+#include <learnopengl/mesh_textures.h>
+#include <learnopengl/bone_palette_buffer.h>
+
+/* Vertex written by the skinning pass, the start of the Vertex of Mesh: static shaders read it at locations 0 to 2 */
+struct SkinnedVertex
+{
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 texCoords;
+};
+
+/* What a pass needs to draw one skinned mesh of one instance with an ordinary static shader */
+struct SkinnedMeshDraw
+{
+	GLuint VAO = 0;
+	GLsizei indexCount = 0;
+	Mesh* mesh = nullptr;
+};
+
+/* Skins the meshes of animated models once per frame with a compute shader, into vertex buffers of their own. The
+   shadow pass, the depth prepass and the main pass then draw them with the shaders of static meshes instead of
+   skinning every vertex again in each of them.
+
+   The compute shader reads the palette range bound by BonePaletteBuffer::Bind at binding 0, the rest vertices at 1,
+   the bone influences at 2 and writes the SkinnedVertex array at 3 (see skinning.cs of the crowd demo). The rest
+   vertices, influences and indices of a mesh are uploaded once and shared by every instance of its model.
+
+   Per frame: write the palettes, Skin every instance, Finish, then draw as many passes as needed. */
+class GpuSkinner
+{
+public:
+	explicit GpuSkinner(const char* skinningPath)
+		: m_Skinning(skinningPath)
+	{
+	}
+
+	~GpuSkinner()
+	{
+		for (const Instance& instance : m_Instances)
+		{
+			for (const Output& output : instance.outputs)
+			{
+				glDeleteVertexArrays(1, &output.VAO);
+				glDeleteBuffers(1, &output.vertexBuffer);
+			}
+		}
+		for (const auto& source : m_Sources)
+		{
+			const GLuint buffers[] = { source.second->restBuffer, source.second->influenceBuffer, source.second->indexBuffer };
+			glDeleteBuffers(3, buffers);
+		}
+		glDeleteProgram(m_Skinning.ID);
+	}
+
+	GpuSkinner(const GpuSkinner&) = delete;
+	GpuSkinner& operator=(const GpuSkinner&) = delete;
+
+	/* Output buffers for every mesh of model, returns the index of the instance */
+	int AddInstance(Model& model)
+	{
+		Instance instance;
+		for (Mesh& mesh : model.meshes)
+		{
+			const Source& source = GetSource(mesh);
+			Output output;
+			output.mesh = &mesh;
+			output.source = &source;
+			glGenBuffers(1, &output.vertexBuffer);
+			glBindBuffer(GL_ARRAY_BUFFER, output.vertexBuffer);
+			glBufferData(GL_ARRAY_BUFFER, source.vertexCount * sizeof(SkinnedVertex), nullptr, GL_DYNAMIC_COPY);
+
+			glGenVertexArrays(1, &output.VAO);
+			glBindVertexArray(output.VAO);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, position));
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, normal));
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, texCoords));
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, source.indexBuffer);
+			glBindVertexArray(0);
+			instance.outputs.push_back(output);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		m_Instances.push_back(std::move(instance));
+		return static_cast<int>(m_Instances.size()) - 1;
+	}
+
+	/* Skins every mesh of instance with the palette range written in palettes */
+	void Skin(int instance, const BonePaletteBuffer& palettes, const BonePaletteRange& range)
+	{
+		m_Skinning.use();
+		palettes.Bind(range);
+		for (const Output& output : m_Instances[instance].outputs)
+		{
+			glUniform1ui(glGetUniformLocation(m_Skinning.ID, "vertexCount"), output.source->vertexCount);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, output.source->restBuffer);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, output.source->influenceBuffer);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, output.vertexBuffer);
+			glDispatchCompute((output.source->vertexCount + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+			m_SkinnedVertices += output.source->vertexCount;
+		}
+	}
+
+	/* The vertices skinned since the last Finish are read as vertex attributes from now on */
+	void Finish()
+	{
+		glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+		m_LastSkinnedVertices = m_SkinnedVertices;
+		m_SkinnedVertices = 0;
+	}
+
+	/* Draws every mesh of instance with shader, which must be in use with its model, view and projection set */
+	void Draw(int instance, Shader& shader, bool bindTextures = true) const
+	{
+		for (const Output& output : m_Instances[instance].outputs)
+		{
+			if (bindTextures)
+				bindMeshTextures(*output.mesh, shader);
+			glBindVertexArray(output.VAO);
+			glDrawElements(GL_TRIANGLES, output.source->indexCount, GL_UNSIGNED_INT, 0);
+		}
+		glBindVertexArray(0);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	/* The meshes of an instance for passes that draw them their own way */
+	std::vector<SkinnedMeshDraw> GetDraws(int instance) const
+	{
+		std::vector<SkinnedMeshDraw> draws;
+		for (const Output& output : m_Instances[instance].outputs)
+			draws.push_back({ output.VAO, output.source->indexCount, output.mesh });
+		return draws;
+	}
+
+	int GetInstanceCount() const { return static_cast<int>(m_Instances.size()); }
+	/* Vertices skinned between the last two Finish */
+	unsigned int GetSkinnedVertexCount() const { return m_LastSkinnedVertices; }
+
+	static constexpr GLuint GROUP_SIZE = 64;
+
+private:
+	/* Rest pose of a mesh as the compute shader reads it. Like SkinnedVertex, it is read as a float array: in a
+	   std430 struct a vec3 would be aligned to 16 bytes. */
+	struct RestVertex
+	{
+		glm::vec3 position;
+		glm::vec3 normal;
+		glm::vec2 texCoords;
+	};
+
+	struct Influence
+	{
+		glm::ivec4 boneIds;
+		glm::vec4 weights;
+	};
+
+	struct Source
+	{
+		GLuint restBuffer = 0;
+		GLuint influenceBuffer = 0;
+		GLuint indexBuffer = 0;
+		GLuint vertexCount = 0;
+		GLsizei indexCount = 0;
+	};
+
+	struct Output
+	{
+		Mesh* mesh = nullptr;
+		const Source* source = nullptr;
+		GLuint vertexBuffer = 0;
+		GLuint VAO = 0;
+	};
+
+	struct Instance
+	{
+		std::vector<Output> outputs;
+	};
+
+	const Source& GetSource(const Mesh& mesh)
+	{
+		std::unique_ptr<Source>& source = m_Sources[&mesh];
+		if (source)
+			return *source;
+
+		source = std::make_unique<Source>();
+		std::vector<RestVertex> rest(mesh.vertices.size());
+		std::vector<Influence> influences(mesh.vertices.size());
+		for (size_t i = 0; i < mesh.vertices.size(); ++i)
+		{
+			const Vertex& vertex = mesh.vertices[i];
+			rest[i] = { vertex.Position, vertex.Normal, vertex.TexCoords };
+			influences[i].boneIds = glm::ivec4(vertex.m_BoneIDs[0], vertex.m_BoneIDs[1], vertex.m_BoneIDs[2], vertex.m_BoneIDs[3]);
+			influences[i].weights = glm::vec4(vertex.m_Weights[0], vertex.m_Weights[1], vertex.m_Weights[2], vertex.m_Weights[3]);
+		}
+		source->vertexCount = static_cast<GLuint>(mesh.vertices.size());
+		source->indexCount = static_cast<GLsizei>(mesh.indices.size());
+
+		glGenBuffers(1, &source->restBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, source->restBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, rest.size() * sizeof(RestVertex), rest.data(), GL_STATIC_DRAW);
+		glGenBuffers(1, &source->influenceBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, source->influenceBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, influences.size() * sizeof(Influence), influences.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		// the index buffer of Mesh is not reachable, the skinned VAOs get their own copy
+		glGenBuffers(1, &source->indexBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, source->indexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, mesh.indices.size() * sizeof(unsigned int), mesh.indices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return *source;
+	}
+
+	ComputeShader m_Skinning;
+	std::unordered_map<const Mesh*, std::unique_ptr<Source>> m_Sources;
+	std::vector<Instance> m_Instances;
+	unsigned int m_SkinnedVertices = 0;
+	unsigned int m_LastSkinnedVertices = 0;
+};
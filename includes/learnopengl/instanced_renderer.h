@@ -0,0 +1,202 @@
+#ifndef INSTANCED_RENDERER_H
+#define INSTANCED_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/entity.h>
+#include <learnopengl/render_list.h>
+#include <learnopengl/mesh_culling.h>
+#include <learnopengl/mesh_textures.h>
+
+#include <vector> //std::vector
+#include <unordered_set> //std::unordered_set
+#include <algorithm> //std::max
+
+//Draws the packets of a RenderList with one glDrawElementsInstanced per model and mesh, the automatic version of
+//what 10.3.asteroids_instanced does by hand. Packets are already sorted by model, so every run of the same model
+//is a group. The world matrices of a frame go to a single instance buffer as 3x4 affine matrices, read by the
+//vertex shader as "layout (location = 7) in mat4x3 instanceMatrix" and expanded with mat4(instanceMatrix).
+//Locations 0 to 6 are the vertex attributes of Mesh.
+class InstancedRenderer
+{
+public:
+	explicit InstancedRenderer(GLuint instanceMatrixLocation = 7)
+		: m_location{ instanceMatrixLocation }
+	{
+		glGenBuffers(1, &m_instanceVBO);
+	}
+
+	~InstancedRenderer()
+	{
+		glDeleteBuffers(1, &m_instanceVBO);
+	}
+
+	InstancedRenderer(const InstancedRenderer&) = delete;
+	InstancedRenderer& operator=(const InstancedRenderer&) = delete;
+
+	//Must be called from the thread owning the GL context, after renderList.build()
+	void submit(const RenderList& renderList, Shader& shader)
+	{
+		prepare(renderList.getPackets(), nullptr, nullptr);
+		drawBatches(shader);
+	}
+
+	//Same, the meshes of a model with several of them are also tested against frustum for every instance.
+	//Instances rejected for a mesh are left out of its draw.
+	void submit(const RenderList& renderList, const Frustum& frustum, Shader& shader, MeshCullingStats& meshStats)
+	{
+		prepare(renderList.getPackets(), &frustum, &meshStats);
+		drawBatches(shader);
+	}
+
+	//Draw calls issued by the last submit
+	unsigned int getDrawCallCount() const
+	{
+		return static_cast<unsigned int>(m_batches.size());
+	}
+
+	unsigned int getInstanceCount() const
+	{
+		return static_cast<unsigned int>(m_instances.size());
+	}
+
+private:
+	//A mesh drawn for the instances [first, first + count) of the instance buffer
+	struct Batch
+	{
+		Mesh* mesh;
+		GLuint first;
+		GLsizei count;
+	};
+
+	GLuint m_location;
+	GLuint m_instanceVBO = 0;
+	size_t m_capacity = 0;
+	std::vector<glm::mat4x3> m_instances;
+	std::vector<Batch> m_batches;
+	//VAOs whose instance attributes are already enabled with their divisor
+	std::unordered_set<GLuint> m_preparedVAOs;
+
+	void prepare(const std::vector<DrawPacket>& packets, const Frustum* frustum, MeshCullingStats* meshStats)
+	{
+		m_instances.clear();
+		m_batches.clear();
+
+		for (size_t groupBegin = 0; groupBegin < packets.size();)
+		{
+			Model& model = *packets[groupBegin].pModel;
+			size_t groupEnd = groupBegin + 1;
+			while (groupEnd < packets.size() && packets[groupEnd].pModel == &model)
+				++groupEnd;
+
+			if (frustum && model.meshes.size() > 1)
+				prepareCulledGroup(model, packets, groupBegin, groupEnd, *frustum, *meshStats);
+			else
+				prepareGroup(model, packets, groupBegin, groupEnd, meshStats);
+			groupBegin = groupEnd;
+		}
+
+		upload();
+	}
+
+	//Every mesh of the model draws the same instances
+	void prepareGroup(Model& model, const std::vector<DrawPacket>& packets, size_t groupBegin, size_t groupEnd, MeshCullingStats* meshStats)
+	{
+		const GLuint first = static_cast<GLuint>(m_instances.size());
+		for (size_t i = groupBegin; i < groupEnd; ++i)
+			m_instances.push_back(toAffine(packets[i].modelMatrix));
+
+		const GLsizei count = static_cast<GLsizei>(groupEnd - groupBegin);
+		for (Mesh& mesh : model.meshes)
+		{
+			m_batches.push_back({ &mesh, first, count });
+			if (meshStats)
+			{
+				meshStats->meshesTested += count;
+				meshStats->trianglesDrawn += static_cast<unsigned int>(mesh.indices.size() / 3) * count;
+			}
+		}
+	}
+
+	//Each mesh gets its own list of the instances it is visible in
+	void prepareCulledGroup(Model& model, const std::vector<DrawPacket>& packets, size_t groupBegin, size_t groupEnd,
+		const Frustum& frustum, MeshCullingStats& meshStats)
+	{
+		const ModelBounds& bounds = ModelBoundsCache::instance().get(model);
+		for (size_t meshIndex = 0; meshIndex < model.meshes.size(); ++meshIndex)
+		{
+			Mesh& mesh = model.meshes[meshIndex];
+			const unsigned int triangles = static_cast<unsigned int>(mesh.indices.size() / 3);
+			const GLuint first = static_cast<GLuint>(m_instances.size());
+			for (size_t i = groupBegin; i < groupEnd; ++i)
+			{
+				++meshStats.meshesTested;
+				if (!isOrientedBoxOnFrustum(frustum, bounds.meshes[meshIndex].orientedBox, packets[i].modelMatrix))
+				{
+					++meshStats.meshesRejected;
+					meshStats.trianglesRejected += triangles;
+					continue;
+				}
+				m_instances.push_back(toAffine(packets[i].modelMatrix));
+				meshStats.trianglesDrawn += triangles;
+			}
+
+			const GLsizei count = static_cast<GLsizei>(m_instances.size() - first);
+			if (count)
+				m_batches.push_back({ &mesh, first, count });
+		}
+	}
+
+	//The buffer is orphaned every frame so the driver does not wait for the draws of the previous one
+	void upload()
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, m_instanceVBO);
+		const size_t size = m_instances.size() * sizeof(glm::mat4x3);
+		if (size > m_capacity)
+			m_capacity = std::max(size, m_capacity * 2);
+		glBufferData(GL_ARRAY_BUFFER, m_capacity, nullptr, GL_STREAM_DRAW);
+		if (size)
+			glBufferSubData(GL_ARRAY_BUFFER, 0, size, m_instances.data());
+	}
+
+	void drawBatches(Shader& shader)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, m_instanceVBO);
+		const Mesh* boundMesh = nullptr;
+		for (const Batch& batch : m_batches)
+		{
+			if (batch.mesh != boundMesh)
+			{
+				bindMeshTextures(*batch.mesh, shader);
+				glBindVertexArray(batch.mesh->VAO);
+				enableInstanceAttributes(batch.mesh->VAO);
+				boundMesh = batch.mesh;
+			}
+
+			//Without base instance (GL 4.2) the attributes are pointed at the first instance of the batch
+			for (GLuint column = 0; column < 4; ++column)
+			{
+				glVertexAttribPointer(m_location + column, 3, GL_FLOAT, GL_FALSE, sizeof(glm::mat4x3),
+					(void*)(batch.first * sizeof(glm::mat4x3) + column * sizeof(glm::vec3)));
+			}
+			glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(batch.mesh->indices.size()), GL_UNSIGNED_INT, 0, batch.count);
+		}
+
+		glBindVertexArray(0);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	void enableInstanceAttributes(GLuint VAO)
+	{
+		if (!m_preparedVAOs.insert(VAO).second)
+			return;
+
+		for (GLuint column = 0; column < 4; ++column)
+		{
+			glEnableVertexAttribArray(m_location + column);
+			glVertexAttribDivisor(m_location + column, 1);
+		}
+	}
+};
+#endif
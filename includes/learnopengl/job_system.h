@@ -0,0 +1,317 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <vector> //std::vector
+#include <deque> //std::deque
+#include <thread> //std::thread
+#include <mutex> //std::mutex
+#include <condition_variable> //std::condition_variable
+#include <atomic> //std::atomic
+#include <functional> //std::function
+#include <memory> //std::unique_ptr
+#include <algorithm> //std::min
+
+class JobSystem;
+
+//Dependency counter. Every job run with it increments it, every finished job decrements it.
+//Continuations registered with JobSystem::runAfter are launched when it reaches zero.
+class JobCounter
+{
+public:
+	JobCounter() = default;
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool isDone() const
+	{
+		return m_count.load(std::memory_order_acquire) == 0;
+	}
+
+private:
+	friend class JobSystem;
+
+	struct Continuation
+	{
+		std::function<void()> task;
+		JobCounter* counter;
+	};
+
+	std::atomic<int> m_count{ 0 };
+	mutable std::mutex m_mutex;
+	std::vector<Continuation> m_continuations;
+};
+
+//Pool of worker threads with one deque per worker. Owners push and pop at the back, idle workers steal from the front.
+//Jobs that must touch the GL context go to a separate queue only drained by the main thread (see pumpMainThread).
+class JobSystem
+{
+public:
+	//By default leave one core to the main thread, which also helps while waiting
+	explicit JobSystem(unsigned int workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1)
+		: m_mainThreadId{ std::this_thread::get_id() }
+	{
+		//Last queue receives the jobs pushed from threads outside the pool
+		for (unsigned int i = 0; i < workerCount + 1; ++i)
+			m_queues.emplace_back(std::make_unique<WorkQueue>());
+
+		m_workers.reserve(workerCount);
+		for (unsigned int i = 0; i < workerCount; ++i)
+			m_workers.emplace_back(&JobSystem::workerLoop, this, i);
+	}
+
+	~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+			m_stop = true;
+		}
+		m_wake.notify_all();
+		for (auto&& worker : m_workers)
+			worker.join();
+	}
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	//Pool shared by the whole runtime. Created by the first call, which defines the main thread.
+	static JobSystem& instance()
+	{
+		static JobSystem jobSystem;
+		return jobSystem;
+	}
+
+	void run(std::function<void()> task, JobCounter* counter = nullptr)
+	{
+		if (counter)
+			counter->m_count.fetch_add(1, std::memory_order_relaxed);
+		push(Job{ std::move(task), counter });
+	}
+
+	//Run task once every job tracked by dependency is finished
+	void runAfter(JobCounter& dependency, std::function<void()> task, JobCounter* counter = nullptr)
+	{
+		if (counter)
+			counter->m_count.fetch_add(1, std::memory_order_relaxed);
+
+		{
+			std::lock_guard<std::mutex> lock(dependency.m_mutex);
+			if (!dependency.isDone())
+			{
+				dependency.m_continuations.push_back({ std::move(task), counter });
+				return;
+			}
+		}
+		push(Job{ std::move(task), counter });
+	}
+
+	//Queue a job that has to run on the thread owning the GL context
+	void runOnMainThread(std::function<void()> task, JobCounter* counter = nullptr)
+	{
+		if (counter)
+			counter->m_count.fetch_add(1, std::memory_order_relaxed);
+
+		std::lock_guard<std::mutex> lock(m_mainMutex);
+		m_mainQueue.push_back(Job{ std::move(task), counter });
+	}
+
+	//Execute the GL affinity jobs queued so far. Call it once per frame from the main thread.
+	unsigned int pumpMainThread()
+	{
+		unsigned int executed = 0;
+		Job job;
+		while (popMainThreadJob(job))
+		{
+			execute(job);
+			++executed;
+		}
+		return executed;
+	}
+
+	//Block until counter reaches zero. The caller executes pending jobs meanwhile instead of sleeping.
+	void wait(const JobCounter& counter)
+	{
+		const bool isMainThread = std::this_thread::get_id() == m_mainThreadId;
+		while (!counter.isDone())
+		{
+			Job job;
+			if (tryGetJob(currentQueueIndex(), job) || (isMainThread && popMainThreadJob(job)))
+				execute(job);
+			else
+				std::this_thread::yield();
+		}
+		//Synchronize with the finishing thread before the caller is allowed to destroy the counter
+		std::lock_guard<std::mutex> lock(counter.m_mutex);
+	}
+
+	//Call task(begin, end) over [first, last) in chunks of at most grain elements and wait for all of them
+	template<typename TTask>
+	void parallelFor(size_t first, size_t last, size_t grain, TTask&& task)
+	{
+		if (first >= last)
+			return;
+
+		grain = std::max<size_t>(grain, 1);
+		if (last - first <= grain)
+		{
+			task(first, last);
+			return;
+		}
+
+		JobCounter counter;
+		for (size_t begin = first; begin < last; begin += grain)
+		{
+			const size_t end = std::min(begin + grain, last);
+			run([&task, begin, end]() { task(begin, end); }, &counter);
+		}
+		wait(counter);
+	}
+
+	unsigned int getWorkerCount() const
+	{
+		return static_cast<unsigned int>(m_workers.size());
+	}
+
+	//Number of threads that can execute a parallelFor chunk: the workers and the waiting caller
+	unsigned int getConcurrency() const
+	{
+		return getWorkerCount() + 1;
+	}
+
+private:
+	struct Job
+	{
+		std::function<void()> task;
+		JobCounter* counter = nullptr;
+	};
+
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	std::vector<std::unique_ptr<WorkQueue>> m_queues;
+	std::vector<std::thread> m_workers;
+	std::thread::id m_mainThreadId;
+
+	std::mutex m_mainMutex;
+	std::deque<Job> m_mainQueue;
+
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wake;
+	std::atomic<int> m_pendingJobs{ 0 };
+	bool m_stop = false;
+
+	//Index of the queue owned by the calling thread, or of the shared queue for foreign threads
+	size_t currentQueueIndex() const
+	{
+		return t_owner == this ? t_workerIndex : m_queues.size() - 1;
+	}
+
+	void push(Job&& job)
+	{
+		WorkQueue& queue = *m_queues[currentQueueIndex()];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.jobs.push_back(std::move(job));
+		}
+		m_pendingJobs.fetch_add(1, std::memory_order_release);
+
+		//Take the lock so a worker between its check and its wait cannot miss the notification
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+		}
+		m_wake.notify_one();
+	}
+
+	//Own queue first (LIFO, still hot in cache), then steal the oldest job of the others (FIFO)
+	bool tryGetJob(size_t ownIndex, Job& job)
+	{
+		{
+			WorkQueue& own = *m_queues[ownIndex];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.jobs.empty())
+			{
+				job = std::move(own.jobs.back());
+				own.jobs.pop_back();
+				m_pendingJobs.fetch_sub(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+
+		for (size_t offset = 1; offset < m_queues.size(); ++offset)
+		{
+			WorkQueue& victim = *m_queues[(ownIndex + offset) % m_queues.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.jobs.empty())
+			{
+				job = std::move(victim.jobs.front());
+				victim.jobs.pop_front();
+				m_pendingJobs.fetch_sub(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool popMainThreadJob(Job& job)
+	{
+		std::lock_guard<std::mutex> lock(m_mainMutex);
+		if (m_mainQueue.empty())
+			return false;
+
+		job = std::move(m_mainQueue.front());
+		m_mainQueue.pop_front();
+		return true;
+	}
+
+	void execute(Job& job)
+	{
+		job.task();
+		if (job.counter)
+			finish(*job.counter);
+	}
+
+	void finish(JobCounter& counter)
+	{
+		//Held while reaching zero so wait() cannot return and destroy the counter under our feet
+		std::vector<JobCounter::Continuation> continuations;
+		{
+			std::lock_guard<std::mutex> lock(counter.m_mutex);
+			if (counter.m_count.fetch_sub(1, std::memory_order_acq_rel) != 1)
+				return;
+			continuations.swap(counter.m_continuations);
+		}
+		//counter may be destroyed by its waiter from here, only use the local copy
+		for (auto&& continuation : continuations)
+			push(Job{ std::move(continuation.task), continuation.counter });
+	}
+
+	void workerLoop(unsigned int index)
+	{
+		t_owner = this;
+		t_workerIndex = index;
+
+		while (true)
+		{
+			Job job;
+			if (tryGetJob(index, job))
+			{
+				execute(job);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(m_sleepMutex);
+			m_wake.wait(lock, [this]() { return m_stop || m_pendingJobs.load(std::memory_order_acquire) > 0; });
+			if (m_stop)
+				return;
+		}
+	}
+
+	static thread_local JobSystem* t_owner;
+	static thread_local size_t t_workerIndex;
+};
+
+inline thread_local JobSystem* JobSystem::t_owner = nullptr;
+inline thread_local size_t JobSystem::t_workerIndex = 0;
+#endif
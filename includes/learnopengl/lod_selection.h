@@ -0,0 +1,204 @@
+#ifndef LOD_SELECTION_H
+#define LOD_SELECTION_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/entity.h>
+
+#include <vector> //std::vector
+#include <unordered_map> //std::unordered_map
+#include <cmath> //std::tan, std::floor
+#include <cassert> //assert
+#include <cstdint> //uint8_t, uint64_t
+#include <algorithm> //std::max
+#include <type_traits> //std::decay
+
+//One representation of a LOD chain. geometricError is the largest distance (in model units) between this level
+//and the full detail surface, 0 for the full detail level itself.
+struct LodLevel
+{
+	Model* model = nullptr;
+	float geometricError = 0.f;
+	unsigned int triangleCount = 0;
+};
+
+inline unsigned int countTriangles(const Model& model)
+{
+	unsigned int triangles = 0;
+	for (auto&& mesh : model.meshes)
+		triangles += static_cast<unsigned int>(mesh.indices.size() / 3);
+	return triangles;
+}
+
+//Models of decreasing detail, shared by every entity using them. Level 0 is the full detail model, entities draw
+//their own pModel for it.
+class LodChain
+{
+public:
+	//Levels are added from the finest to the coarsest, so their error must not decrease
+	void addLevel(Model& model, float geometricError)
+	{
+		assert(m_levels.empty() || geometricError >= m_levels.back().geometricError);
+		m_levels.push_back({ &model, geometricError, countTriangles(model) });
+	}
+
+	unsigned int getLevelCount() const
+	{
+		return static_cast<unsigned int>(m_levels.size());
+	}
+
+	const LodLevel& getLevel(unsigned int level) const
+	{
+		return m_levels[level];
+	}
+
+private:
+	std::vector<LodLevel> m_levels;
+};
+
+//Global LOD budget of a view
+struct LodSettings
+{
+	//Largest error allowed on screen, in pixels
+	float maxPixelError = 1.f;
+	//A coarser level is only taken once its error is below (1 - hysteresis) * maxPixelError, so an entity
+	//standing around a switch distance does not flip between two levels every frame
+	float hysteresis = 0.25f;
+	//Pixels covered by one unit at distance one: viewport height / (2 * tan(fovY / 2))
+	float projectionScale = 0.f;
+
+	void setProjection(float fovY, float viewportHeight)
+	{
+		projectionScale = viewportHeight / (2.f * std::tan(fovY * 0.5f));
+	}
+
+	bool isEnabled() const
+	{
+		return projectionScale > 0.f;
+	}
+};
+
+//LOD selection of a frame, triangles are counted at full detail for the saved ones
+struct LodStats
+{
+	unsigned int entities = 0;
+	unsigned int entitiesReduced = 0;
+	unsigned int trianglesDrawn = 0;
+	unsigned int trianglesSaved = 0;
+
+	void reset()
+	{
+		*this = LodStats{};
+	}
+
+	void merge(const LodStats& other)
+	{
+		entities += other.entities;
+		entitiesReduced += other.entitiesReduced;
+		trianglesDrawn += other.trianglesDrawn;
+		trianglesSaved += other.trianglesSaved;
+	}
+};
+
+//Error in pixels of geometricError seen on a sphere at viewPos. The nearest point of the sphere is used so the error
+//is never underestimated, inside the sphere it is treated as being at distance near.
+inline float computeScreenSpaceError(float geometricError, const glm::vec3& center, float radius, const glm::vec3& viewPos,
+	const LodSettings& settings, float near = 0.1f)
+{
+	const float distance = std::max(glm::distance(center, viewPos) - radius, near);
+	return geometricError * settings.projectionScale / distance;
+}
+
+//Coarsest level within the budget. Levels coarser than currentLevel must fit the stricter hysteresis budget.
+inline unsigned int selectLodLevel(const LodChain& chain, float worldScale, const glm::vec3& center, float radius, const glm::vec3& viewPos,
+	const LodSettings& settings, unsigned int currentLevel)
+{
+	for (unsigned int level = chain.getLevelCount() - 1; level > 0; --level)
+	{
+		const float budget = level > currentLevel ? settings.maxPixelError * (1.f - settings.hysteresis) : settings.maxPixelError;
+		const float error = computeScreenSpaceError(chain.getLevel(level).geometricError * worldScale, center, radius, viewPos, settings);
+		if (error <= budget)
+			return level;
+	}
+	return 0;
+}
+
+//Model to draw for entity seen from viewPos. lodLevel is the level drawn last frame in this view, the level chosen
+//is written back to it. Entities without LOD chain, or with LOD disabled, draw their own model.
+inline Model* selectEntityLod(const Entity& entity, const glm::vec3& viewPos, const LodSettings& settings, uint8_t& lodLevel, LodStats& stats)
+{
+	if (!entity.pLods || !settings.isEnabled() || entity.pLods->getLevelCount() == 0)
+		return entity.pModel;
+
+	const LodChain& chain = *entity.pLods;
+	const glm::vec3 scale = entity.transform.getGlobalScale();
+	const float worldScale = std::max(scale.x, std::max(scale.y, scale.z));
+	const unsigned int level = selectLodLevel(chain, worldScale, entity.worldBounds.getCenter(), glm::length(entity.worldBounds.getExtents()),
+		viewPos, settings, std::min<unsigned int>(lodLevel, chain.getLevelCount() - 1));
+	lodLevel = static_cast<uint8_t>(level);
+
+	const LodLevel& selected = chain.getLevel(level);
+	++stats.entities;
+	stats.trianglesDrawn += selected.triangleCount;
+	if (level > 0)
+	{
+		++stats.entitiesReduced;
+		stats.trianglesSaved += chain.getLevel(0).triangleCount - std::min(selected.triangleCount, chain.getLevel(0).triangleCount);
+	}
+	return level == 0 ? entity.pModel : selected.model;
+}
+
+//Turn model, usually a copy of the full detail one, into a coarser level by vertex clustering: the vertices falling in
+//the same cell of a grid of cellSize are merged at their average position, the other attributes are those of the
+//first one, and the triangles collapsed by the merge are dropped. Returns the farthest a vertex moved, the geometric
+//error to give to LodChain::addLevel. Cheap and robust but seams of texture coordinates are not preserved, meant for
+//far levels.
+template<typename TModel>
+float simplifyByClustering(TModel& model, float cellSize)
+{
+	using TMesh = typename std::decay<decltype(model.meshes[0])>::type;
+	float error = 0.f;
+	for (auto&& mesh : model.meshes)
+	{
+		//21 bits per axis, enough for 2 million cells across
+		std::unordered_map<uint64_t, unsigned int> cells;
+		std::vector<unsigned int> remap(mesh.vertices.size());
+		decltype(mesh.vertices) vertices;
+		std::vector<glm::vec3> positionSums;
+		std::vector<unsigned int> cellCounts;
+		for (size_t i = 0; i < mesh.vertices.size(); ++i)
+		{
+			const glm::vec3 cell = glm::floor(mesh.vertices[i].Position / cellSize);
+			const uint64_t key = (uint64_t(int64_t(cell.x) & 0x1FFFFF) << 42) | (uint64_t(int64_t(cell.y) & 0x1FFFFF) << 21) | uint64_t(int64_t(cell.z) & 0x1FFFFF);
+			const auto inserted = cells.emplace(key, static_cast<unsigned int>(vertices.size()));
+			if (inserted.second)
+			{
+				vertices.push_back(mesh.vertices[i]);
+				positionSums.push_back(glm::vec3(0.f));
+				cellCounts.push_back(0);
+			}
+			remap[i] = inserted.first->second;
+			positionSums[remap[i]] += mesh.vertices[i].Position;
+			++cellCounts[remap[i]];
+		}
+
+		for (size_t i = 0; i < vertices.size(); ++i)
+			vertices[i].Position = positionSums[i] / static_cast<float>(cellCounts[i]);
+		for (size_t i = 0; i < mesh.vertices.size(); ++i)
+			error = std::max(error, glm::distance(mesh.vertices[i].Position, vertices[remap[i]].Position));
+
+		decltype(mesh.indices) indices;
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+		{
+			const unsigned int a = remap[mesh.indices[i]], b = remap[mesh.indices[i + 1]], c = remap[mesh.indices[i + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+			indices.push_back(a);
+			indices.push_back(b);
+			indices.push_back(c);
+		}
+		mesh = TMesh{ std::move(vertices), std::move(indices), mesh.textures };
+	}
+	return error;
+}
+#endif
@@ -0,0 +1,145 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string> //std::string
+#include <cstddef> //size_t
+#include <cstdint> //uint8_t
+#include <utility> //std::swap
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//Read only view of a whole file mapped in memory. Pages are loaded by the OS on first access, so opening
+//a large file costs the same as a small one. isOpen() is false if the file is missing or empty.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+
+	explicit MappedFile(const std::string& path)
+	{
+		open(path);
+	}
+
+	~MappedFile()
+	{
+		close();
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	MappedFile(MappedFile&& other) noexcept
+	{
+		swap(other);
+	}
+
+	MappedFile& operator=(MappedFile&& other) noexcept
+	{
+		MappedFile moved(std::move(other));
+		swap(moved);
+		return *this;
+	}
+
+	bool open(const std::string& path)
+	{
+		close();
+#ifdef _WIN32
+		m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (m_file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+		{
+			close();
+			return false;
+		}
+		m_size = static_cast<size_t>(size.QuadPart);
+
+		m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_mapping)
+			m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+		const int file = ::open(path.c_str(), O_RDONLY);
+		if (file < 0)
+			return false;
+
+		struct stat status;
+		if (fstat(file, &status) == 0 && status.st_size > 0)
+		{
+			m_size = static_cast<size_t>(status.st_size);
+			void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+			if (data != MAP_FAILED)
+				m_data = static_cast<const uint8_t*>(data);
+		}
+		//The mapping stays valid once the descriptor is closed
+		::close(file);
+#endif
+		if (!m_data)
+			close();
+		return isOpen();
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (m_data)
+			UnmapViewOfFile(m_data);
+		if (m_mapping)
+			CloseHandle(m_mapping);
+		if (m_file != INVALID_HANDLE_VALUE)
+			CloseHandle(m_file);
+		m_mapping = nullptr;
+		m_file = INVALID_HANDLE_VALUE;
+#else
+		if (m_data)
+			munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+		m_data = nullptr;
+		m_size = 0;
+	}
+
+	bool isOpen() const
+	{
+		return m_data != nullptr;
+	}
+
+	const uint8_t* data() const
+	{
+		return m_data;
+	}
+
+	size_t size() const
+	{
+		return m_size;
+	}
+
+private:
+	const uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+#ifdef _WIN32
+	HANDLE m_file = INVALID_HANDLE_VALUE;
+	HANDLE m_mapping = nullptr;
+#endif
+
+	void swap(MappedFile& other)
+	{
+		std::swap(m_data, other.m_data);
+		std::swap(m_size, other.m_size);
+#ifdef _WIN32
+		std::swap(m_file, other.m_file);
+		std::swap(m_mapping, other.m_mapping);
+#endif
+	}
+};
+#endif
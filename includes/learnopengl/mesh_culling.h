@@ -0,0 +1,130 @@
+#ifndef MESH_CULLING_H
+#define MESH_CULLING_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/entity.h>
+#include <learnopengl/bounds_builder.h>
+#include <learnopengl/job_system.h>
+
+#include <unordered_map> //std::unordered_map
+#include <memory> //std::unique_ptr
+#include <mutex> //std::mutex
+#include <utility> //std::move
+
+//What the mesh level culling rejected, accumulate over a frame and reset() before the next one
+struct MeshCullingStats
+{
+	unsigned int meshesTested = 0;
+	unsigned int meshesRejected = 0;
+	unsigned int trianglesDrawn = 0;
+	unsigned int trianglesRejected = 0;
+
+	void reset()
+	{
+		*this = MeshCullingStats{};
+	}
+};
+
+//Oriented box of a mesh moved by modelMatrix against the frustum. Scale and shear are folded in the half axes.
+inline bool isOrientedBoxOnFrustum(const Frustum& frustum, const OrientedBox& box, const glm::mat4& modelMatrix)
+{
+	const glm::vec3 center{ modelMatrix * glm::vec4(box.center, 1.f) };
+	const glm::mat3 linear{ modelMatrix };
+	const glm::vec3 halfAxes[3] = { linear * (box.axes[0] * box.extents.x), linear * (box.axes[1] * box.extents.y), linear * (box.axes[2] * box.extents.z) };
+
+	for (int i = 0; i < Frustum::planeCount; ++i)
+	{
+		const Plane& plane = frustum.getPlane(i);
+		const float radius = std::abs(glm::dot(plane.normal, halfAxes[0])) + std::abs(glm::dot(plane.normal, halfAxes[1])) +
+			std::abs(glm::dot(plane.normal, halfAxes[2]));
+		if (plane.getSignedDistanceToPlane(center) < -radius)
+			return false;
+	}
+	return true;
+}
+
+//World space box of one mesh, the axis aligned box around its moved oriented box
+inline BoundingBox getMeshWorldBox(const MeshBounds& bounds, const glm::mat4& modelMatrix)
+{
+	OrientedBox worldBox;
+	worldBox.center = glm::vec3(modelMatrix * glm::vec4(bounds.orientedBox.center, 1.f));
+	worldBox.axes = glm::mat3(modelMatrix) * bounds.orientedBox.axes;
+	worldBox.extents = bounds.orientedBox.extents;
+	//The axes carry the scale now, their enclosing box stays correct even if they are not unit vectors
+	return worldBox.getEnclosingBox();
+}
+
+//Bounds of the meshes of every model, computed the first time a model is drawn. Models are shared by many entities,
+//so this is done once per model and not per entity.
+class ModelBoundsCache
+{
+public:
+	static ModelBoundsCache& instance()
+	{
+		static ModelBoundsCache cache;
+		return cache;
+	}
+
+	//The bounds are computed without holding the lock: waiting on the job system runs other jobs on this thread,
+	//which may call get() too. Two threads missing the same model both compute it, the first one stored is kept.
+	const ModelBounds& get(const Model& model, JobSystem& jobSystem = JobSystem::instance())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			const auto found = m_bounds.find(&model);
+			if (found != m_bounds.end())
+				return *found->second;
+		}
+
+		std::unique_ptr<ModelBounds> bounds = std::make_unique<ModelBounds>(computeModelBounds(model, jobSystem));
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return *m_bounds.emplace(&model, std::move(bounds)).first->second;
+	}
+
+	//Call when the vertices of a model change or before it is destroyed
+	void invalidate(const Model& model)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bounds.erase(&model);
+	}
+
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bounds.clear();
+	}
+
+private:
+	std::mutex m_mutex;
+	std::unordered_map<const Model*, std::unique_ptr<ModelBounds>> m_bounds;
+};
+
+//Same as Model::Draw but each mesh is tested against the frustum first. The "model" uniform must already be set.
+//A model with a single mesh is drawn as is: the entity has just passed the same test with the same bounds.
+inline unsigned int drawModelCulled(Model& model, const glm::mat4& modelMatrix, const Frustum& frustum, Shader& shader,
+	MeshCullingStats& stats, ModelBoundsCache& cache = ModelBoundsCache::instance())
+{
+	const ModelBounds& bounds = cache.get(model);
+	const bool testMeshes = model.meshes.size() > 1;
+
+	unsigned int drawn = 0;
+	for (size_t i = 0; i < model.meshes.size(); ++i)
+	{
+		Mesh& mesh = model.meshes[i];
+		const unsigned int triangles = static_cast<unsigned int>(mesh.indices.size() / 3);
+		++stats.meshesTested;
+		if (testMeshes && !isOrientedBoxOnFrustum(frustum, bounds.meshes[i].orientedBox, modelMatrix))
+		{
+			++stats.meshesRejected;
+			stats.trianglesRejected += triangles;
+			continue;
+		}
+
+		mesh.Draw(shader);
+		stats.trianglesDrawn += triangles;
+		++drawn;
+	}
+	return drawn;
+}
+#endif
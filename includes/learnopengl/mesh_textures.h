@@ -0,0 +1,35 @@
+#ifndef MESH_TEXTURES_H
+#define MESH_TEXTURES_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/mesh.h>
+
+#include <string> //std::string
+
+//Textures of a mesh bound with the same uniform names as Mesh::Draw (texture_diffuse1, texture_specular1...)
+inline void bindMeshTextures(const Mesh& mesh, Shader& shader)
+{
+	unsigned int diffuseNr = 1;
+	unsigned int specularNr = 1;
+	unsigned int normalNr = 1;
+	unsigned int heightNr = 1;
+	for (unsigned int i = 0; i < mesh.textures.size(); i++)
+	{
+		glActiveTexture(GL_TEXTURE0 + i);
+		std::string number;
+		const std::string& name = mesh.textures[i].type;
+		if (name == "texture_diffuse")
+			number = std::to_string(diffuseNr++);
+		else if (name == "texture_specular")
+			number = std::to_string(specularNr++);
+		else if (name == "texture_normal")
+			number = std::to_string(normalNr++);
+		else if (name == "texture_height")
+			number = std::to_string(heightNr++);
+
+		glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+		glBindTexture(GL_TEXTURE_2D, mesh.textures[i].id);
+	}
+}
+#endif
@@ -0,0 +1,313 @@
+#ifndef OCCLUSION_CULLING_H
+#define OCCLUSION_CULLING_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/bounding_box.h>
+
+#include <vector> //std::vector
+#include <array> //std::array
+#include <chrono> //std::chrono::steady_clock
+#include <algorithm> //std::min, std::max, std::fill
+#include <cmath> //std::floor, std::ceil
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_CULLING_SSE 1
+#else
+#define OCCLUSION_CULLING_SSE 0
+#endif
+
+struct OcclusionStats
+{
+	unsigned int occluders = 0;
+	unsigned int occluderTriangles = 0;
+	unsigned int tested = 0;
+	unsigned int occluded = 0;
+	unsigned int visible = 0;
+	double rasterizeMs = 0.0;
+	double testMs = 0.0;
+};
+
+//Simplified mesh used as occluder. Should be inside the real geometry, so it never hides more than it.
+struct OccluderMesh
+{
+	std::vector<glm::vec3> vertices;
+	std::vector<unsigned int> indices;
+
+	//Closed box, handy for walls and buildings
+	static OccluderMesh fromBox(const BoundingBox& box)
+	{
+		OccluderMesh mesh;
+		for (int i = 0; i < 8; ++i)
+			mesh.vertices.push_back({ i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z });
+		mesh.indices = { 0, 2, 1, 1, 2, 3,  4, 5, 6, 5, 7, 6,  0, 1, 4, 1, 5, 4,
+			2, 6, 3, 3, 6, 7,  0, 4, 2, 2, 4, 6,  1, 3, 5, 3, 7, 5 };
+		return mesh;
+	}
+};
+
+//CPU occlusion culling: occluders are rasterized in a small depth buffer, then the boxes of the objects are
+//tested against it before being submitted. Everything runs on the CPU, no GL call is made.
+//Depth is the NDC z remapped to [0, 1] and the buffer keeps the nearest occluder of each pixel.
+//A coarse buffer with the farthest depth of each 8x8 tile lets most tests finish without reading pixels.
+class OcclusionCuller
+{
+public:
+	static constexpr int tileSize = 8;
+
+	explicit OcclusionCuller(int width = 320, int height = 192)
+		: m_width{ (width + tileSize - 1) / tileSize * tileSize },
+		m_height{ (height + tileSize - 1) / tileSize * tileSize },
+		m_tilesX{ m_width / tileSize },
+		m_tilesY{ m_height / tileSize },
+		m_depth(static_cast<size_t>(m_width) * m_height, 1.f),
+		m_tileMaxDepth(static_cast<size_t>(m_tilesX) * m_tilesY, 1.f)
+	{}
+
+	//Clear the buffers for a new frame seen through viewProjection
+	void beginFrame(const glm::mat4& viewProjection)
+	{
+		m_viewProjection = viewProjection;
+		std::fill(m_depth.begin(), m_depth.end(), 1.f);
+		std::fill(m_tileMaxDepth.begin(), m_tileMaxDepth.end(), 1.f);
+		m_stats = OcclusionStats{};
+		m_tilesDirty = false;
+	}
+
+	void rasterizeOccluder(const OccluderMesh& mesh, const glm::mat4& modelMatrix)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		const glm::mat4 mvp = m_viewProjection * modelMatrix;
+
+		m_clipVertices.resize(mesh.vertices.size());
+		for (size_t i = 0; i < mesh.vertices.size(); ++i)
+			m_clipVertices[i] = mvp * glm::vec4(mesh.vertices[i], 1.f);
+
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+		{
+			rasterizeTriangle(m_clipVertices[mesh.indices[i]], m_clipVertices[mesh.indices[i + 1]], m_clipVertices[mesh.indices[i + 2]]);
+			++m_stats.occluderTriangles;
+		}
+
+		++m_stats.occluders;
+		m_tilesDirty = true;
+		m_stats.rasterizeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	//False only if the box is certainly hidden behind the occluders
+	bool isVisible(const BoundingBox& worldBox)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		if (m_tilesDirty)
+			updateTileMaxDepth();
+
+		const bool visible = testBox(worldBox);
+		++m_stats.tested;
+		++(visible ? m_stats.visible : m_stats.occluded);
+		m_stats.testMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		return visible;
+	}
+
+	const OcclusionStats& getStats() const
+	{
+		return m_stats;
+	}
+
+	int getWidth() const
+	{
+		return m_width;
+	}
+
+	int getHeight() const
+	{
+		return m_height;
+	}
+
+	//Row major, bottom row first like a GL depth texture
+	const std::vector<float>& getDepthBuffer() const
+	{
+		return m_depth;
+	}
+
+private:
+	int m_width;
+	int m_height;
+	int m_tilesX;
+	int m_tilesY;
+	std::vector<float> m_depth;
+	std::vector<float> m_tileMaxDepth;
+	std::vector<glm::vec4> m_clipVertices;
+	glm::mat4 m_viewProjection = glm::mat4(1.0f);
+	OcclusionStats m_stats;
+	bool m_tilesDirty = false;
+
+	//Clip space w under which a vertex is considered behind the eye
+	static constexpr float nearW = 1e-5f;
+
+	glm::vec3 toScreen(const glm::vec4& clip) const
+	{
+		const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		return { (ndc.x * 0.5f + 0.5f) * m_width, (ndc.y * 0.5f + 0.5f) * m_height, ndc.z * 0.5f + 0.5f };
+	}
+
+	void rasterizeTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2)
+	{
+		//Clipping against the near plane would be needed to draw it, dropping the occluder is always safe
+		if (c0.w <= nearW || c1.w <= nearW || c2.w <= nearW)
+			return;
+
+		glm::vec3 v0 = toScreen(c0);
+		glm::vec3 v1 = toScreen(c1);
+		glm::vec3 v2 = toScreen(c2);
+
+		float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+		if (area == 0.f)
+			return;
+		//Both windings are rasterized, the buffer only keeps the nearest depth anyway
+		if (area < 0.f)
+		{
+			std::swap(v1, v2);
+			area = -area;
+		}
+
+		const int minX = std::max(0, static_cast<int>(std::floor(std::min(std::min(v0.x, v1.x), v2.x))));
+		const int maxX = std::min(m_width - 1, static_cast<int>(std::ceil(std::max(std::max(v0.x, v1.x), v2.x))));
+		const int minY = std::max(0, static_cast<int>(std::floor(std::min(std::min(v0.y, v1.y), v2.y))));
+		const int maxY = std::min(m_height - 1, static_cast<int>(std::ceil(std::max(std::max(v0.y, v1.y), v2.y))));
+		if (minX > maxX || minY > maxY)
+			return;
+
+		//Edge functions e(x, y) = a * x + b * y + c, positive inside. Depth is affine in screen space.
+		const float invArea = 1.f / area;
+		const std::array<float, 3> a = { v1.y - v2.y, v2.y - v0.y, v0.y - v1.y };
+		const std::array<float, 3> b = { v2.x - v1.x, v0.x - v2.x, v1.x - v0.x };
+		const std::array<float, 3> c = { v1.x * v2.y - v2.x * v1.y, v2.x * v0.y - v0.x * v2.y, v0.x * v1.y - v1.x * v0.y };
+		const float zA = (a[0] * v0.z + a[1] * v1.z + a[2] * v2.z) * invArea;
+		const float zB = (b[0] * v0.z + b[1] * v1.z + b[2] * v2.z) * invArea;
+		const float zC = (c[0] * v0.z + c[1] * v1.z + c[2] * v2.z) * invArea;
+
+		for (int y = minY; y <= maxY; ++y)
+		{
+			const float py = y + 0.5f;
+			float* row = &m_depth[static_cast<size_t>(y) * m_width];
+			int x = minX;
+#if OCCLUSION_CULLING_SSE
+			const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+			const __m128 zero = _mm_setzero_ps();
+			for (; x + 3 <= maxX; x += 4)
+			{
+				const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets);
+				__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				for (int e = 0; e < 3; ++e)
+				{
+					const __m128 edge = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[e]), px), _mm_set1_ps(b[e] * py + c[e]));
+					inside = _mm_and_ps(inside, _mm_cmpge_ps(edge, zero));
+				}
+				if (_mm_movemask_ps(inside) == 0)
+					continue;
+
+				const __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zA), px), _mm_set1_ps(zB * py + zC));
+				const __m128 previous = _mm_loadu_ps(row + x);
+				const __m128 nearest = _mm_min_ps(previous, z);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, previous)));
+			}
+#endif
+			for (; x <= maxX; ++x)
+			{
+				const float px = x + 0.5f;
+				if (a[0] * px + b[0] * py + c[0] < 0.f || a[1] * px + b[1] * py + c[1] < 0.f || a[2] * px + b[2] * py + c[2] < 0.f)
+					continue;
+				row[x] = std::min(row[x], zA * px + zB * py + zC);
+			}
+		}
+	}
+
+	void updateTileMaxDepth()
+	{
+		for (int ty = 0; ty < m_tilesY; ++ty)
+		{
+			for (int tx = 0; tx < m_tilesX; ++tx)
+			{
+				float maxDepth = 0.f;
+				for (int y = ty * tileSize; y < (ty + 1) * tileSize; ++y)
+				{
+					const float* row = &m_depth[static_cast<size_t>(y) * m_width + tx * tileSize];
+					for (int x = 0; x < tileSize; ++x)
+						maxDepth = std::max(maxDepth, row[x]);
+				}
+				m_tileMaxDepth[static_cast<size_t>(ty) * m_tilesX + tx] = maxDepth;
+			}
+		}
+		m_tilesDirty = false;
+	}
+
+	bool testBox(const BoundingBox& worldBox) const
+	{
+		//Screen rectangle and nearest depth of the box
+		glm::vec2 screenMin(std::numeric_limits<float>::max());
+		glm::vec2 screenMax(std::numeric_limits<float>::lowest());
+		float nearestDepth = 1.f;
+		for (int i = 0; i < 8; ++i)
+		{
+			const glm::vec3 corner{ i & 1 ? worldBox.max.x : worldBox.min.x, i & 2 ? worldBox.max.y : worldBox.min.y, i & 4 ? worldBox.max.z : worldBox.min.z };
+			const glm::vec4 clip = m_viewProjection * glm::vec4(corner, 1.f);
+			//Crossing the near plane, the camera is probably inside it
+			if (clip.w <= nearW)
+				return true;
+
+			const glm::vec3 screen = toScreen(clip);
+			screenMin = glm::min(screenMin, glm::vec2(screen));
+			screenMax = glm::max(screenMax, glm::vec2(screen));
+			nearestDepth = std::min(nearestDepth, screen.z);
+		}
+
+		const int minX = std::max(0, static_cast<int>(std::floor(screenMin.x)));
+		const int maxX = std::min(m_width - 1, static_cast<int>(std::floor(screenMax.x)));
+		const int minY = std::max(0, static_cast<int>(std::floor(screenMin.y)));
+		const int maxY = std::min(m_height - 1, static_cast<int>(std::floor(screenMax.y)));
+		//Outside of the screen, that is the job of frustum culling
+		if (minX > maxX || minY > maxY)
+			return true;
+
+		for (int ty = minY / tileSize; ty <= maxY / tileSize; ++ty)
+		{
+			for (int tx = minX / tileSize; tx <= maxX / tileSize; ++tx)
+			{
+				//Every occluder pixel of the tile is in front of the box
+				if (m_tileMaxDepth[static_cast<size_t>(ty) * m_tilesX + tx] < nearestDepth)
+					continue;
+
+				const int x0 = std::max(minX, tx * tileSize), x1 = std::min(maxX, tx * tileSize + tileSize - 1);
+				const int y0 = std::max(minY, ty * tileSize), y1 = std::min(maxY, ty * tileSize + tileSize - 1);
+				if (isAnyPixelBehind(x0, x1, y0, y1, nearestDepth))
+					return true;
+			}
+		}
+		return false;
+	}
+
+	bool isAnyPixelBehind(int x0, int x1, int y0, int y1, float depth) const
+	{
+		for (int y = y0; y <= y1; ++y)
+		{
+			const float* row = &m_depth[static_cast<size_t>(y) * m_width];
+			int x = x0;
+#if OCCLUSION_CULLING_SSE
+			const __m128 boxDepth = _mm_set1_ps(depth);
+			for (; x + 3 <= x1; x += 4)
+			{
+				if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), boxDepth)))
+					return true;
+			}
+#endif
+			for (; x <= x1; ++x)
+			{
+				if (row[x] >= depth)
+					return true;
+			}
+		}
+		return false;
+	}
+};
+#endif
@@ -0,0 +1,275 @@
+#ifndef RENDER_LIST_H
+#define RENDER_LIST_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/entity.h>
+#include <learnopengl/job_system.h>
+#include <learnopengl/mesh_culling.h>
+#include <learnopengl/lod_selection.h>
+
+#include <vector> //std::vector
+#include <algorithm> //std::sort, std::remove_if
+#include <unordered_map> //std::unordered_map
+#include <cstdint> //uint64_t
+#include <utility> //std::pair
+
+//Everything the GL thread needs to issue one draw. Built on worker threads, consumed on the context thread.
+struct DrawPacket
+{
+	uint64_t sortKey = 0;
+	Model* pModel = nullptr;
+	glm::mat4 modelMatrix = glm::mat4(1.0f);
+};
+
+//Packets emitted for one subtree during the build phase. A subtree is built by a single job, so no locking is needed.
+struct DrawCommandBuffer
+{
+	std::vector<DrawPacket> packets;
+	unsigned int total = 0;
+	LodStats lodStats;
+	//LOD level chosen for each entity with a chain, stored by the list once the jobs are done
+	std::vector<std::pair<const Entity*, uint8_t>> lodLevels;
+
+	void clear()
+	{
+		packets.clear();
+		total = 0;
+		lodStats.reset();
+		lodLevels.clear();
+	}
+};
+
+//Splits a frame in a parallel "build" phase (culling, sort keys, uniform packing) that never touches GL,
+//and a serial "submit" phase that runs on the thread owning the context.
+//Each model drawn gets a sort id that it keeps between frames. A model destroyed while the list lives must be
+//passed to forgetModel first, otherwise a new model allocated at its address inherits its id and its packets.
+//The LOD level drawn last frame by each entity is kept per list, so lists of different views (a second camera, a
+//shadow pass) keep their own hysteresis. Entities destroyed while the list lives go to forgetEntity.
+class RenderList
+{
+public:
+	explicit RenderList(JobSystem& jobSystem = JobSystem::instance())
+		: m_jobSystem{ jobSystem }
+	{}
+
+	//Build phase: can be called from any thread, but must not overlap with submit()
+	void build(const Entity& root, const Frustum& frustum, const glm::vec3& viewPos)
+	{
+		m_frustum = frustum;
+		m_splitBuffer.clear();
+		collectWorkItems(root, frustum, viewPos);
+
+		if (m_buffers.size() < m_workItems.size())
+			m_buffers.resize(m_workItems.size());
+		for (size_t i = 0; i < m_workItems.size(); ++i)
+			m_buffers[i].clear();
+
+		m_jobSystem.parallelFor(0, m_workItems.size(), 1, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; ++i)
+					buildSubtree(*m_workItems[i], frustum, viewPos, m_buffers[i]);
+			});
+
+		merge();
+	}
+
+	//Submit phase: must be called from the thread owning the GL context
+	void submit(Shader& shader)
+	{
+		const GLint modelLocation = glGetUniformLocation(shader.ID, "model");
+		for (auto&& packet : m_merged)
+		{
+			glUniformMatrix4fv(modelLocation, 1, GL_FALSE, &packet.modelMatrix[0][0]);
+			packet.pModel->Draw(shader);
+		}
+	}
+
+	//Same as submit, the meshes of each packet are also tested against the frustum of the last build
+	void submit(Shader& shader, MeshCullingStats& meshStats)
+	{
+		const GLint modelLocation = glGetUniformLocation(shader.ID, "model");
+		for (auto&& packet : m_merged)
+		{
+			glUniformMatrix4fv(modelLocation, 1, GL_FALSE, &packet.modelMatrix[0][0]);
+			drawModelCulled(*packet.pModel, packet.modelMatrix, m_frustum, shader, meshStats);
+		}
+	}
+
+	//Drop the sort id of a model about to be destroyed, and the packets of the last build that draw it.
+	//Must not overlap with build() or submit().
+	void forgetModel(const Model& model)
+	{
+		m_modelIds.erase(&model);
+		m_merged.erase(std::remove_if(m_merged.begin(), m_merged.end(), [&](const DrawPacket& packet)
+			{
+				return packet.pModel == &model;
+			}), m_merged.end());
+	}
+
+	//Drop the LOD level kept for an entity about to be destroyed
+	void forgetEntity(const Entity& entity)
+	{
+		m_lodLevels.erase(&entity);
+	}
+
+	//Forget every model and entity and the packets of the last build, e.g. when a scene is unloaded
+	void clear()
+	{
+		m_modelIds.clear();
+		m_nextModelId = 0;
+		m_merged.clear();
+		m_lodLevels.clear();
+	}
+
+	//LOD of the entities with a LodChain is selected during build, disabled until a projection is set
+	void setLodSettings(const LodSettings& settings)
+	{
+		m_lodSettings = settings;
+	}
+
+	const LodStats& getLodStats() const
+	{
+		return m_lodStats;
+	}
+
+	const std::vector<DrawPacket>& getPackets() const
+	{
+		return m_merged;
+	}
+
+	unsigned int getDisplayCount() const
+	{
+		return static_cast<unsigned int>(m_merged.size());
+	}
+
+	unsigned int getTotalCount() const
+	{
+		return m_total;
+	}
+
+private:
+	JobSystem& m_jobSystem;
+	Frustum m_frustum;
+	DrawCommandBuffer m_splitBuffer;
+	std::vector<DrawCommandBuffer> m_buffers;
+	std::vector<const Entity*> m_workItems;
+	std::vector<DrawPacket> m_merged;
+	std::unordered_map<const Model*, uint64_t> m_modelIds;
+	uint64_t m_nextModelId = 0;
+	//Only read during the parallel part of build, written by merge()
+	std::unordered_map<const Entity*, uint8_t> m_lodLevels;
+	unsigned int m_total = 0;
+	LodSettings m_lodSettings;
+	LodStats m_lodStats;
+
+	//Expand the tree breadth first until there are enough disjoint subtrees to keep every worker busy.
+	//Interior nodes met during the expansion are culled by the calling thread into the split buffer.
+	void collectWorkItems(const Entity& root, const Frustum& frustum, const glm::vec3& viewPos)
+	{
+		//A few items per thread so stealing can even out unbalanced subtrees
+		const size_t targetItems = static_cast<size_t>(m_jobSystem.getConcurrency()) * 4;
+
+		m_workItems.clear();
+		m_workItems.push_back(&root);
+
+		std::vector<const Entity*> nextLevel;
+		bool expanded = true;
+		while (expanded && m_workItems.size() < targetItems)
+		{
+			expanded = false;
+			nextLevel.clear();
+			for (const Entity* node : m_workItems)
+			{
+				//Leaves stay a work item on their own
+				if (node->children.empty())
+				{
+					nextLevel.push_back(node);
+					continue;
+				}
+
+				buildNode(*node, frustum, viewPos, m_splitBuffer);
+				for (auto&& child : node->children)
+					nextLevel.push_back(child.get());
+				expanded = true;
+			}
+			m_workItems.swap(nextLevel);
+		}
+	}
+
+	void buildSubtree(const Entity& entity, const Frustum& frustum, const glm::vec3& viewPos, DrawCommandBuffer& buffer) const
+	{
+		entity.cullSelfAndChild(frustum, [&](const Entity& visible) { emitPacket(visible, viewPos, buffer); }, buffer.total);
+	}
+
+	//Nodes above the split level: only their own box is tested, their children are work items
+	void buildNode(const Entity& entity, const Frustum& frustum, const glm::vec3& viewPos, DrawCommandBuffer& buffer) const
+	{
+		++buffer.total;
+		if (testFrustum(frustum, entity.worldBounds) != FrustumTest::outside)
+			emitPacket(entity, viewPos, buffer);
+	}
+
+	void emitPacket(const Entity& entity, const glm::vec3& viewPos, DrawCommandBuffer& buffer) const
+	{
+		if (!entity.pModel)
+			return;
+
+		DrawPacket packet;
+		const auto lastLevel = m_lodLevels.find(&entity);
+		uint8_t lodLevel = lastLevel == m_lodLevels.end() ? 0 : lastLevel->second;
+		packet.pModel = selectEntityLod(entity, viewPos, m_lodSettings, lodLevel, buffer.lodStats);
+		if (entity.pLods && m_lodSettings.isEnabled())
+			buffer.lodLevels.push_back({ &entity, lodLevel });
+		packet.modelMatrix = entity.transform.getModelMatrix();
+		//Depth part of the key, model part is patched in merge() once ids are known
+		packet.sortKey = computeDepthKey(glm::distance(viewPos, glm::vec3(packet.modelMatrix[3])));
+		buffer.packets.push_back(packet);
+	}
+
+	//Front to back ordering inside a model batch. 24 bits quantized, 1 cm steps up to ~167 km.
+	static uint64_t computeDepthKey(float distance)
+	{
+		const float quantized = std::min(distance * 100.f, static_cast<float>((1u << 24) - 1u));
+		return static_cast<uint64_t>(std::max(quantized, 0.f));
+	}
+
+	void merge()
+	{
+		m_merged.clear();
+		m_total = 0;
+		m_lodStats.reset();
+
+		size_t packetCount = m_splitBuffer.packets.size();
+		for (size_t i = 0; i < m_workItems.size(); ++i)
+			packetCount += m_buffers[i].packets.size();
+		m_merged.reserve(packetCount);
+
+		for (size_t i = 0; i <= m_workItems.size(); ++i)
+		{
+			const DrawCommandBuffer& buffer = i == 0 ? m_splitBuffer : m_buffers[i - 1];
+			m_total += buffer.total;
+			m_lodStats.merge(buffer.lodStats);
+			for (auto&& [entity, level] : buffer.lodLevels)
+				m_lodLevels[entity] = level;
+			for (auto&& packet : buffer.packets)
+			{
+				//Models keep the id of their first appearance so the key is stable between frames. Ids are not
+				//reused after forgetModel, the next one is taken instead.
+				const auto it = m_modelIds.emplace(packet.pModel, m_nextModelId).first;
+				if (it->second == m_nextModelId)
+					++m_nextModelId;
+				m_merged.push_back(packet);
+				m_merged.back().sortKey |= it->second << 24;
+			}
+		}
+
+		//Group by model first to keep the state changes low, then front to back
+		std::sort(m_merged.begin(), m_merged.end(), [](const DrawPacket& a, const DrawPacket& b)
+			{
+				return a.sortKey < b.sortKey;
+			});
+	}
+};
+#endif
@@ -0,0 +1,412 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <learnopengl/entity.h>
+#include <learnopengl/bounding_box.h>
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/transform_store.h>
+
+#include <vector> //std::vector
+#include <string> //std::string
+#include <string_view> //std::string_view
+#include <unordered_map> //std::unordered_map
+#include <memory> //std::unique_ptr
+#include <fstream> //std::ofstream
+#include <cstdint> //uint32_t, uint64_t
+#include <cstring> //std::memcmp
+#include <algorithm> //std::min, std::max
+#include <type_traits> //std::is_trivially_copyable
+
+//Binary scene file, little endian, used in place once memory mapped:
+//  SceneFileHeader
+//  SceneNodeRecord[nodeCount]   depth first order, a parent is always before its children and the subtree
+//                               of node i is [i, subtreeEnd)
+//  SceneModelRecord[modelCount] asset id of each model (its path) and the bounds of its vertices
+//  char[stringsSize]            asset ids, not null terminated
+//Every array starts on a 16 bytes boundary.
+
+constexpr uint32_t sceneFileVersion = 1;
+constexpr uint32_t sceneNoParent = ~0u;
+constexpr uint32_t sceneNoModel = ~0u;
+
+struct SceneFileHeader
+{
+	char magic[4] = { 'L', 'O', 'G', 'S' };
+	uint32_t version = sceneFileVersion;
+	uint32_t nodeCount = 0;
+	uint32_t modelCount = 0;
+	uint64_t nodesOffset = 0;
+	uint64_t modelsOffset = 0;
+	uint64_t stringsOffset = 0;
+	uint64_t stringsSize = 0;
+};
+
+struct SceneNodeRecord
+{
+	uint32_t parent = sceneNoParent;
+	uint32_t subtreeEnd = 0;
+	uint32_t model = sceneNoModel;
+	uint32_t depth = 0;
+
+	//Local transform
+	glm::vec3 position;
+	glm::quat rotation;
+	glm::vec3 scale;
+
+	//World space, valid without any update
+	glm::mat4x3 modelMatrix;
+	BoundingBox worldBounds;
+	BoundingBox subtreeBounds;
+};
+
+struct SceneModelRecord
+{
+	uint32_t idOffset = 0;
+	uint32_t idSize = 0;
+	BoundingBox bounds;
+};
+
+static_assert(std::is_trivially_copyable<SceneNodeRecord>::value && sizeof(SceneNodeRecord) == 152, "SceneNodeRecord layout is part of the file format");
+static_assert(std::is_trivially_copyable<SceneModelRecord>::value && sizeof(SceneModelRecord) == 32, "SceneModelRecord layout is part of the file format");
+static_assert(sizeof(SceneFileHeader) == 48, "SceneFileHeader layout is part of the file format");
+
+namespace scene_file_detail
+{
+	inline uint64_t alignOffset(uint64_t offset)
+	{
+		return (offset + 15) & ~uint64_t(15);
+	}
+
+	inline void writePadding(std::ofstream& stream, uint64_t& offset)
+	{
+		static const char zeros[16] = {};
+		const uint64_t aligned = alignOffset(offset);
+		stream.write(zeros, static_cast<std::streamsize>(aligned - offset));
+		offset = aligned;
+	}
+
+	template<typename T>
+	void writeArray(std::ofstream& stream, uint64_t& offset, const T* data, size_t count)
+	{
+		stream.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(sizeof(T) * count));
+		offset += sizeof(T) * count;
+	}
+
+	inline uint32_t flattenNode(const Entity& entity, uint32_t parent, uint32_t depth, std::vector<SceneNodeRecord>& nodes,
+		const std::unordered_map<const Model*, uint32_t>& modelIndices)
+	{
+		const uint32_t index = static_cast<uint32_t>(nodes.size());
+		SceneNodeRecord node;
+		node.parent = parent;
+		node.depth = depth;
+		const auto model = modelIndices.find(entity.pModel);
+		node.model = model == modelIndices.end() ? sceneNoModel : model->second;
+		node.position = entity.transform.getLocalPosition();
+		node.rotation = entity.transform.getLocalOrientation();
+		node.scale = entity.transform.getLocalScale();
+		node.modelMatrix = entity.transform.getAffineMatrix();
+		node.worldBounds = entity.worldBounds;
+		node.subtreeBounds = entity.subtreeBounds;
+		nodes.push_back(node);
+
+		for (auto&& child : entity.children)
+			flattenNode(*child, index, depth + 1, nodes, modelIndices);
+
+		nodes[index].subtreeEnd = static_cast<uint32_t>(nodes.size());
+		return index;
+	}
+}
+
+//Save root and its descendants. root must be up to date (updateSelfAndChild or a DirtyTransformList) since the
+//world matrices and bounds are stored as is. modelIds gives the asset id of each model, entities whose model
+//is not in it are saved without model. Returns false if the file can not be written.
+inline bool writeSceneFile(const std::string& path, const Entity& root, const std::unordered_map<const Model*, std::string>& modelIds)
+{
+	using namespace scene_file_detail;
+
+	std::vector<SceneModelRecord> models;
+	std::string strings;
+	std::unordered_map<const Model*, uint32_t> modelIndices;
+	for (auto&& [model, id] : modelIds)
+	{
+		modelIndices[model] = static_cast<uint32_t>(models.size());
+		SceneModelRecord record;
+		record.idOffset = static_cast<uint32_t>(strings.size());
+		record.idSize = static_cast<uint32_t>(id.size());
+		const AABB bounds = generateAABB(*model);
+		record.bounds = BoundingBox::fromCenterExtents(bounds.center, bounds.extents);
+		models.push_back(record);
+		strings += id;
+	}
+
+	std::vector<SceneNodeRecord> nodes;
+	flattenNode(root, sceneNoParent, 0, nodes, modelIndices);
+
+	SceneFileHeader header;
+	header.nodeCount = static_cast<uint32_t>(nodes.size());
+	header.modelCount = static_cast<uint32_t>(models.size());
+	header.nodesOffset = alignOffset(sizeof(SceneFileHeader));
+	header.modelsOffset = alignOffset(header.nodesOffset + sizeof(SceneNodeRecord) * nodes.size());
+	header.stringsOffset = alignOffset(header.modelsOffset + sizeof(SceneModelRecord) * models.size());
+	header.stringsSize = strings.size();
+
+	std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+	if (!stream)
+		return false;
+
+	uint64_t offset = 0;
+	writeArray(stream, offset, &header, 1);
+	writePadding(stream, offset);
+	writeArray(stream, offset, nodes.data(), nodes.size());
+	writePadding(stream, offset);
+	writeArray(stream, offset, models.data(), models.size());
+	writePadding(stream, offset);
+	writeArray(stream, offset, strings.data(), strings.size());
+	return static_cast<bool>(stream);
+}
+
+//Memory mapped scene file. Opening only checks the header, the nodes are read in place with no parsing
+//nor allocation, so the cost does not depend on the size of the scene. The records are checked by validate,
+//which instantiateSceneFile and loadSceneTransforms call first; cull and getModelId are safe without it.
+class SceneFile
+{
+public:
+	SceneFile() = default;
+
+	explicit SceneFile(const std::string& path)
+	{
+		open(path);
+	}
+
+	//False if the file is missing, truncated or of another version
+	bool open(const std::string& path)
+	{
+		m_header = nullptr;
+		if (!m_file.open(path) || m_file.size() < sizeof(SceneFileHeader))
+			return false;
+
+		const SceneFileHeader* header = reinterpret_cast<const SceneFileHeader*>(m_file.data());
+		const SceneFileHeader expected;
+		if (std::memcmp(header->magic, expected.magic, sizeof(expected.magic)) != 0 || header->version != sceneFileVersion ||
+			!fits(header->nodesOffset, sizeof(SceneNodeRecord) * uint64_t(header->nodeCount)) ||
+			!fits(header->modelsOffset, sizeof(SceneModelRecord) * uint64_t(header->modelCount)) ||
+			!fits(header->stringsOffset, header->stringsSize))
+		{
+			m_file.close();
+			return false;
+		}
+
+		m_header = header;
+		return true;
+	}
+
+	bool isOpen() const
+	{
+		return m_header != nullptr;
+	}
+
+	uint32_t getNodeCount() const
+	{
+		return m_header->nodeCount;
+	}
+
+	const SceneNodeRecord* getNodes() const
+	{
+		return reinterpret_cast<const SceneNodeRecord*>(m_file.data() + m_header->nodesOffset);
+	}
+
+	const SceneNodeRecord& getNode(uint32_t index) const
+	{
+		return getNodes()[index];
+	}
+
+	uint32_t getModelCount() const
+	{
+		return m_header->modelCount;
+	}
+
+	//Empty if model or its string range is out of the file
+	std::string_view getModelId(uint32_t model) const
+	{
+		if (model >= getModelCount())
+			return std::string_view();
+		const SceneModelRecord& record = getModelRecord(model);
+		if (uint64_t(record.idOffset) + record.idSize > m_header->stringsSize)
+			return std::string_view();
+		return std::string_view(reinterpret_cast<const char*>(m_file.data() + m_header->stringsOffset) + record.idOffset, record.idSize);
+	}
+
+	const BoundingBox& getModelBounds(uint32_t model) const
+	{
+		return getModelRecord(model).bounds;
+	}
+
+	//True if every record is consistent: the first node is the only root, a parent comes before its children and
+	//its subtree holds theirs, subtrees end within the nodes, models and asset ids are within their arrays.
+	//Reads every record once.
+	bool validate() const
+	{
+		if (!isOpen())
+			return false;
+
+		const SceneNodeRecord* nodes = getNodes();
+		const uint32_t count = getNodeCount();
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const SceneNodeRecord& node = nodes[i];
+			if (node.subtreeEnd <= i || node.subtreeEnd > count)
+				return false;
+			if (node.model != sceneNoModel && node.model >= getModelCount())
+				return false;
+			if ((i == 0) != (node.parent == sceneNoParent))
+				return false;
+			if (i != 0 && (node.parent >= i || nodes[node.parent].subtreeEnd < node.subtreeEnd))
+				return false;
+		}
+		if (count != 0 && nodes[0].subtreeEnd != count)
+			return false;
+
+		for (uint32_t model = 0; model < getModelCount(); ++model)
+		{
+			const SceneModelRecord& record = getModelRecord(model);
+			if (uint64_t(record.idOffset) + record.idSize > m_header->stringsSize)
+				return false;
+		}
+		return true;
+	}
+
+	//Hierarchical frustum culling straight on the mapped nodes, the counterpart of Entity::cullSelfAndChild.
+	//visitor(uint32_t index, const SceneNodeRecord&) is called for every visible node. A subtree end out of
+	//(i, nodeCount] is clamped into it, a corrupt file gives wrong results but always terminates.
+	template<typename TVisitor>
+	void cull(const Frustum& frustum, TVisitor&& visitor) const
+	{
+		struct OpenSubtree
+		{
+			uint32_t end;
+			uint8_t planeMask;
+		};
+		std::vector<OpenSubtree> open;
+		uint8_t lastRejectPlane = 0;
+
+		const SceneNodeRecord* nodes = getNodes();
+		const uint32_t count = getNodeCount();
+		for (uint32_t i = 0; i < count;)
+		{
+			while (!open.empty() && open.back().end <= i)
+				open.pop_back();
+
+			const SceneNodeRecord& node = nodes[i];
+			const uint32_t subtreeEnd = std::min(std::max(node.subtreeEnd, i + 1), count);
+			uint8_t planeMask = open.empty() ? allFrustumPlanes : open.back().planeMask;
+			const FrustumTest subtreeTest = testFrustum(frustum, node.subtreeBounds, planeMask, lastRejectPlane);
+			if (subtreeTest == FrustumTest::outside)
+			{
+				i = subtreeEnd;
+				continue;
+			}
+
+			if (subtreeTest == FrustumTest::inside)
+			{
+				for (; i < subtreeEnd; ++i)
+					visitor(i, nodes[i]);
+				continue;
+			}
+
+			uint8_t selfPlaneMask = planeMask;
+			if (testFrustum(frustum, node.worldBounds, selfPlaneMask, lastRejectPlane) != FrustumTest::outside)
+				visitor(i, node);
+			open.push_back({ subtreeEnd, planeMask });
+			++i;
+		}
+	}
+
+private:
+	MappedFile m_file;
+	const SceneFileHeader* m_header = nullptr;
+
+	bool fits(uint64_t offset, uint64_t size) const
+	{
+		return offset <= m_file.size() && size <= m_file.size() - offset;
+	}
+
+	const SceneModelRecord& getModelRecord(uint32_t model) const
+	{
+		return reinterpret_cast<const SceneModelRecord*>(m_file.data() + m_header->modelsOffset)[model];
+	}
+};
+
+//Entity tree of a scene file, world matrices and bounds restored as saved. resolveModel(std::string_view id)
+//returns the Model& of an asset id, it is called once per model and not per node. Nodes without model are skipped
+//with their subtree since an Entity always draws one. Returns nullptr if the file does not validate.
+template<typename TResolveModel>
+std::unique_ptr<Entity> instantiateSceneFile(const SceneFile& scene, TResolveModel&& resolveModel)
+{
+	if (!scene.validate() || scene.getNodeCount() == 0 || scene.getNode(0).model == sceneNoModel)
+		return nullptr;
+
+	std::vector<Model*> models(scene.getModelCount());
+	std::vector<AABB> modelBounds;
+	modelBounds.reserve(scene.getModelCount());
+	for (uint32_t i = 0; i < scene.getModelCount(); ++i)
+	{
+		models[i] = &resolveModel(scene.getModelId(i));
+		modelBounds.emplace_back(scene.getModelBounds(i).min, scene.getModelBounds(i).max);
+	}
+
+	std::vector<Entity*> entities(scene.getNodeCount(), nullptr);
+	std::unique_ptr<Entity> root;
+	for (uint32_t i = 0; i < scene.getNodeCount();)
+	{
+		const SceneNodeRecord& node = scene.getNode(i);
+		if (node.model == sceneNoModel || (node.parent != sceneNoParent && !entities[node.parent]))
+		{
+			i = node.subtreeEnd;
+			continue;
+		}
+
+		Entity* entity;
+		if (node.parent == sceneNoParent)
+		{
+			root = std::make_unique<Entity>(*models[node.model], modelBounds[node.model]);
+			entity = root.get();
+		}
+		else
+		{
+			entities[node.parent]->addChild(*models[node.model], modelBounds[node.model]);
+			entity = entities[node.parent]->children.back().get();
+		}
+
+		entity->transform.setLocalPosition(node.position);
+		entity->transform.setLocalRotation(node.rotation);
+		entity->transform.setLocalScale(node.scale);
+		entity->transform.restoreModelMatrix(node.modelMatrix);
+		entity->worldBounds = node.worldBounds;
+		entity->subtreeBounds = node.subtreeBounds;
+		entities[i] = entity;
+		++i;
+	}
+	return root;
+}
+
+//Append the nodes of a scene file to a TransformStore. The depth first order of the file is a valid topological
+//order, so no sort is needed. Returns the handle of the first node, the others follow in file order, or
+//TransformStore::noParent without adding anything if the file does not validate.
+inline TransformHandle loadSceneTransforms(const SceneFile& scene, TransformStore& store, TransformHandle parent = TransformStore::noParent)
+{
+	if (!scene.validate())
+		return TransformStore::noParent;
+
+	const TransformHandle first = static_cast<TransformHandle>(store.size());
+	store.reserve(store.size() + scene.getNodeCount());
+	for (uint32_t i = 0; i < scene.getNodeCount(); ++i)
+	{
+		const SceneNodeRecord& node = scene.getNode(i);
+		store.add(node.parent == sceneNoParent ? parent : first + node.parent, node.position, node.rotation, node.scale);
+	}
+	return first;
+}
+#endif
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+/* Node hierarchy of an animation compiled into flat arrays. Joints are stored depth first so a parent always
+   comes before its children: the pose is evaluated by a single forward loop, without names, maps or recursion. */
+struct Skeleton
+{
+	/* parent joint, -1 for the root */
+	std::vector<int> parents;
+	/* node transformation, used when the joint has no channel */
+	std::vector<glm::mat4> bindLocals;
+	/* joint -> index of its Bone in the Animation, -1 if not animated */
+	std::vector<int> jointChannels;
+	/* joint -> index in the final bone matrices (BoneInfo::id), -1 if no vertex is skinned to it */
+	std::vector<int> paletteIndices;
+	/* joint -> BoneInfo::offset, identity if not in the palette */
+	std::vector<glm::mat4> offsets;
+	/* only used to build and inspect the skeleton, never during evaluation */
+	std::vector<std::string> names;
+
+	int AddJoint(const std::string& name, int parent, const glm::mat4& bindLocal)
+	{
+		parents.push_back(parent);
+		bindLocals.push_back(bindLocal);
+		jointChannels.push_back(-1);
+		paletteIndices.push_back(-1);
+		offsets.push_back(glm::mat4(1.0f));
+		names.push_back(name);
+		return GetJointCount() - 1;
+	}
+
+	int GetJointCount() const { return static_cast<int>(parents.size()); }
+
+	int FindJoint(const std::string& name) const
+	{
+		for (int joint = 0; joint < GetJointCount(); ++joint)
+		{
+			if (names[joint] == name)
+				return joint;
+		}
+		return -1;
+	}
+
+	/* Distance from each joint to its furthest descendant in the bind pose, 0 for the leaves */
+	std::vector<float> ComputeBindSpans() const
+	{
+		std::vector<glm::mat4> globals(GetJointCount());
+		std::vector<float> spans(GetJointCount(), 0.0f);
+		for (int joint = 0; joint < GetJointCount(); ++joint)
+		{
+			const int parent = parents[joint];
+			globals[joint] = parent < 0 ? bindLocals[joint] : globals[parent] * bindLocals[joint];
+			for (int ancestor = parent; ancestor >= 0; ancestor = parents[ancestor])
+				spans[ancestor] = std::max(spans[ancestor], glm::distance(glm::vec3(globals[ancestor][3]), glm::vec3(globals[joint][3])));
+		}
+		return spans;
+	}
+
+	/* Number of final bone matrices the joints write to */
+	int GetPaletteSize() const
+	{
+		int size = 0;
+		for (int index : paletteIndices)
+			size = std::max(size, index + 1);
+		return size;
+	}
+};
@@ -0,0 +1,252 @@
+#ifndef TRANSFORM_STORE_H
+#define TRANSFORM_STORE_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/entity.h>
+#include <learnopengl/job_system.h>
+#include <learnopengl/affine_transform.h>
+
+#include <vector> //std::vector
+#include <cstdint> //uint32_t
+#include <cstring> //std::memset
+#include <cassert> //assert
+#include <algorithm> //std::min, std::max
+
+using TransformHandle = uint32_t;
+
+//Flattened transform hierarchy stored as structure of arrays.
+//Nodes are kept in topological order (a parent is always stored before its children), so the world
+//matrices are resolved by a single linear sweep instead of a pointer chasing recursion.
+//Local transforms are split per component and composed by blocks with the SIMD kernels of affine_transform.h,
+//world matrices are affine 3x4 matrices.
+class TransformStore
+{
+public:
+	static constexpr TransformHandle noParent = ~0u;
+
+	void reserve(size_t count)
+	{
+		m_parents.reserve(count);
+		m_depths.reserve(count);
+		m_trs.reserve(count);
+		m_worldMatrices.reserve(count);
+		m_dirty.reserve(count);
+	}
+
+	//Parent must already be in the store, which keeps the topological order by construction
+	TransformHandle add(TransformHandle parent = noParent, const glm::vec3& pos = glm::vec3(0.f),
+		const glm::quat& rotation = glm::quat(1.f, 0.f, 0.f, 0.f), const glm::vec3& scale = glm::vec3(1.f))
+	{
+		assert(parent == noParent || parent < m_parents.size());
+
+		m_parents.push_back(parent);
+		m_depths.push_back(parent == noParent ? 0u : m_depths[parent] + 1u);
+		m_trs.push_back(pos, glm::normalize(rotation), scale);
+		m_worldMatrices.push_back(glm::mat4x3(1.0f));
+		m_dirty.push_back(1);
+		m_levelsValid = false;
+		return static_cast<TransformHandle>(m_parents.size() - 1);
+	}
+
+	//Euler angles in degrees, like Transform
+	TransformHandle add(TransformHandle parent, const glm::vec3& pos, const glm::vec3& eulerRot, const glm::vec3& scale = glm::vec3(1.f))
+	{
+		return add(parent, pos, eulerDegreesToQuat(eulerRot), scale);
+	}
+
+	//Append root and all its descendants, breadth first. nodes receives the entity of each new handle if provided.
+	TransformHandle addEntityTree(const Entity& root, TransformHandle parent = noParent, std::vector<const Entity*>* nodes = nullptr)
+	{
+		std::vector<std::pair<const Entity*, TransformHandle>> pending{ { &root, parent } };
+		const TransformHandle rootHandle = static_cast<TransformHandle>(size());
+
+		for (size_t cursor = 0; cursor < pending.size(); ++cursor)
+		{
+			const Entity& entity = *pending[cursor].first;
+			const TransformHandle handle = add(pending[cursor].second, entity.transform.getLocalPosition(),
+				entity.transform.getLocalOrientation(), entity.transform.getLocalScale());
+			if (nodes)
+				nodes->push_back(&entity);
+
+			for (auto&& child : entity.children)
+				pending.emplace_back(child.get(), handle);
+		}
+		return rootHandle;
+	}
+
+	void setLocalPosition(TransformHandle handle, const glm::vec3& newPosition)
+	{
+		m_trs.setPosition(handle, newPosition);
+		m_dirty[handle] = 1;
+	}
+
+	void setLocalRotation(TransformHandle handle, const glm::vec3& newRotation)
+	{
+		m_trs.setRotation(handle, eulerDegreesToQuat(newRotation));
+		m_dirty[handle] = 1;
+	}
+
+	void setLocalRotation(TransformHandle handle, const glm::quat& newRotation)
+	{
+		m_trs.setRotation(handle, glm::normalize(newRotation));
+		m_dirty[handle] = 1;
+	}
+
+	void setLocalScale(TransformHandle handle, const glm::vec3& newScale)
+	{
+		m_trs.setScale(handle, newScale);
+		m_dirty[handle] = 1;
+	}
+
+	//Resolve every dirty node and its descendants in one forward sweep. Locals are composed by blocks of
+	//consecutive handles, blocks without any dirty node are skipped.
+	void update()
+	{
+		const size_t count = size();
+		glm::mat4x3 locals[blockSize];
+		for (size_t first = 0; first < count; first += blockSize)
+		{
+			const size_t blockCount = std::min(blockSize, count - first);
+			bool anyDirty = false;
+			for (size_t i = first; i < first + blockCount; ++i)
+				anyDirty |= propagateDirty(i);
+			if (!anyDirty)
+				continue;
+
+			composeAffineBatch(m_trs, first, blockCount, locals);
+			for (size_t k = 0; k < blockCount; ++k)
+				resolveNode(first + k, locals[k]);
+		}
+
+		std::memset(m_dirty.data(), 0, m_dirty.size());
+	}
+
+	//Same as update() but each depth level is split across the job system. Nodes of one level only read
+	//the world matrices of the previous one, so the chunks of a level are independent.
+	void update(JobSystem& jobSystem, size_t grain = 4096)
+	{
+		if (!m_levelsValid)
+			rebuildLevels();
+
+		for (size_t level = 0; level + 1 < m_levelOffsets.size(); ++level)
+		{
+			jobSystem.parallelFor(m_levelOffsets[level], m_levelOffsets[level + 1], grain, [this](size_t begin, size_t end)
+				{
+					glm::mat4x3 locals[blockSize];
+					for (size_t first = begin; first < end; first += blockSize)
+					{
+						const size_t blockCount = std::min(blockSize, end - first);
+						const TransformHandle* handles = &m_levelOrder[first];
+						bool anyDirty = false;
+						for (size_t k = 0; k < blockCount; ++k)
+							anyDirty |= propagateDirty(handles[k]);
+						if (!anyDirty)
+							continue;
+
+						composeAffineIndexed(m_trs, handles, blockCount, locals);
+						for (size_t k = 0; k < blockCount; ++k)
+							resolveNode(handles[k], locals[k]);
+					}
+				});
+		}
+
+		std::memset(m_dirty.data(), 0, m_dirty.size());
+	}
+
+	size_t size() const
+	{
+		return m_parents.size();
+	}
+
+	TransformHandle getParent(TransformHandle handle) const
+	{
+		return m_parents[handle];
+	}
+
+	const glm::mat4x3& getWorldMatrix(TransformHandle handle) const
+	{
+		return m_worldMatrices[handle];
+	}
+
+	const std::vector<glm::mat4x3>& getWorldMatrices() const
+	{
+		return m_worldMatrices;
+	}
+
+	glm::vec3 getLocalPosition(TransformHandle handle) const
+	{
+		return m_trs.getPosition(handle);
+	}
+
+	//Euler angles in degrees recovered from the quaternion
+	glm::vec3 getLocalRotation(TransformHandle handle) const
+	{
+		return quatToEulerDegrees(m_trs.getRotation(handle));
+	}
+
+	glm::quat getLocalOrientation(TransformHandle handle) const
+	{
+		return m_trs.getRotation(handle);
+	}
+
+	glm::vec3 getLocalScale(TransformHandle handle) const
+	{
+		return m_trs.getScale(handle);
+	}
+
+private:
+	std::vector<TransformHandle> m_parents;
+	std::vector<uint32_t> m_depths;
+	TRSArrays m_trs;
+	std::vector<glm::mat4x3> m_worldMatrices;
+	std::vector<uint8_t> m_dirty;
+
+	//Handles sorted by depth, m_levelOffsets[d] is the first one of depth d
+	std::vector<TransformHandle> m_levelOrder;
+	std::vector<size_t> m_levelOffsets;
+	bool m_levelsValid = false;
+
+	//Handles composed together, a multiple of the SIMD width of composeAffineBatch
+	static constexpr size_t blockSize = 8;
+
+	bool propagateDirty(size_t i)
+	{
+		const TransformHandle parent = m_parents[i];
+		//A moved parent moves its whole subtree. Parents are resolved first, so their flag is final here.
+		if (parent != noParent)
+			m_dirty[i] |= m_dirty[parent];
+		return m_dirty[i] != 0;
+	}
+
+	void resolveNode(size_t i, const glm::mat4x3& local)
+	{
+		if (!m_dirty[i])
+			return;
+
+		const TransformHandle parent = m_parents[i];
+		m_worldMatrices[i] = parent == noParent ? local : multiplyAffine(m_worldMatrices[parent], local);
+	}
+
+	//Counting sort on depth, stable so handles stay ascending (and memory access mostly forward) inside a level
+	void rebuildLevels()
+	{
+		uint32_t maxDepth = 0;
+		for (uint32_t depth : m_depths)
+			maxDepth = std::max(maxDepth, depth);
+
+		m_levelOffsets.assign(size() ? maxDepth + 2 : 1, 0);
+		for (uint32_t depth : m_depths)
+			++m_levelOffsets[depth + 1];
+		for (size_t level = 1; level < m_levelOffsets.size(); ++level)
+			m_levelOffsets[level] += m_levelOffsets[level - 1];
+
+		m_levelOrder.resize(size());
+		std::vector<size_t> cursors(m_levelOffsets.begin(), m_levelOffsets.end() - 1);
+		for (size_t i = 0; i < size(); ++i)
+			m_levelOrder[cursors[m_depths[i]]++] = static_cast<TransformHandle>(i);
+
+		m_levelsValid = true;
+	}
+};
+#endif
@@ -0,0 +1,48 @@
+#version 430 core
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 norm;
+layout(location = 2) in vec2 tex;
+layout(location = 3) in vec3 tangent;
+layout(location = 4) in vec3 bitangent;
+layout(location = 5) in ivec4 boneIds;
+layout(location = 6) in vec4 weights;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+
+// the palette range of the character being drawn, three rows of the 3x4 matrix of each bone
+layout(std430, binding = 0) readonly buffer BonePalettes {
+    vec4 bonePalettes[];
+};
+
+const int MAX_BONE_INFLUENCE = 4;
+
+out vec2 TexCoords;
+
+void main()
+{
+    int boneCount = bonePalettes.length() / 3;
+
+    vec4 position = vec4(pos, 1.0f);
+    vec4 totalPosition = vec4(0.0f);
+    for(int i = 0 ; i < MAX_BONE_INFLUENCE ; i++)
+    {
+        if(boneIds[i] == -1)
+            continue;
+        if(boneIds[i] >= boneCount)
+        {
+            totalPosition = position;
+            break;
+        }
+        vec4 r0 = bonePalettes[boneIds[i] * 3];
+        vec4 r1 = bonePalettes[boneIds[i] * 3 + 1];
+        vec4 r2 = bonePalettes[boneIds[i] * 3 + 2];
+        totalPosition += vec4(dot(r0, position), dot(r1, position), dot(r2, position), 1.0f) * weights[i];
+    }
+
+    mat4 viewModel = view * model;
+    gl_Position = projection * viewModel * totalPosition;
+    TexCoords = tex;
+}
@@ -0,0 +1,58 @@
+#version 330 core
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 norm;
+layout(location = 2) in vec2 tex;
+layout(location = 5) in ivec4 boneIds; 
+layout(location = 6) in vec4 weights;
+layout(location = 7) in mat4x3 instanceMatrix;
+// first row of the clip, frame count, frames per second, time offset
+layout(location = 11) in vec4 instanceAnimation;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform float time;
+
+// one row per frame, three texels per bone for the rows of its 3x4 matrix
+uniform sampler2D bakedPalettes;
+
+const int MAX_BONE_INFLUENCE = 4;
+
+out vec2 TexCoords;
+
+vec4 fetchRow(int bone, int r, int row0, int row1, float blend)
+{
+    return mix(texelFetch(bakedPalettes, ivec2(bone * 3 + r, row0), 0), texelFetch(bakedPalettes, ivec2(bone * 3 + r, row1), 0), blend);
+}
+
+void main()
+{
+    // the last frame is the end of the clip, so the loop is frameCount - 1 frames long
+    int frameCount = int(instanceAnimation.y);
+    float frame = mod((time + instanceAnimation.w) * instanceAnimation.z, float(frameCount - 1));
+    int frame0 = int(frame);
+    int row0 = int(instanceAnimation.x) + frame0;
+    int row1 = int(instanceAnimation.x) + min(frame0 + 1, frameCount - 1);
+    float blend = frame - float(frame0);
+    int boneCount = textureSize(bakedPalettes, 0).x / 3;
+
+    vec4 position = vec4(pos, 1.0f);
+    vec4 totalPosition = vec4(0.0f);
+    for(int i = 0 ; i < MAX_BONE_INFLUENCE ; i++)
+    {
+        if(boneIds[i] == -1) 
+            continue;
+        if(boneIds[i] >= boneCount) 
+        {
+            totalPosition = position;
+            break;
+        }
+        vec4 r0 = fetchRow(boneIds[i], 0, row0, row1, blend);
+        vec4 r1 = fetchRow(boneIds[i], 1, row0, row1, blend);
+        vec4 r2 = fetchRow(boneIds[i], 2, row0, row1, blend);
+        totalPosition += vec4(dot(r0, position), dot(r1, position), dot(r2, position), 1.0f) * weights[i];
+    }
+
+    gl_Position = projection * view * mat4(instanceMatrix) * totalPosition;
+    TexCoords = tex;
+}
@@ -0,0 +1,382 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <learnopengl/filesystem.h>
+#include <learnopengl/shader_m.h>
+#include <learnopengl/camera.h>
+#include <learnopengl/crowd_animator.h>
+#include <learnopengl/animation_cache.h>
+#include <learnopengl/baked_animation.h>
+#include <learnopengl/bone_palette_buffer.h>
+#include <learnopengl/gpu_skinning.h>
+#include <learnopengl/model_animation.h>
+
+#include <iostream>
+#include <random>
+#include <algorithm>
+
+
+void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void mouse_callback(GLFWwindow* window, double xpos, double ypos);
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void processInput(GLFWwindow* window);
+
+// settings
+const unsigned int SCR_WIDTH = 800;
+const unsigned int SCR_HEIGHT = 600;
+
+// crowd
+const int CROWD_ROWS = 20;
+const int CROWD_COLUMNS = 20;
+const float CROWD_SPACING = 1.2f;
+// characters closest to the camera skinned by the compute pass, each slot holds a skinned copy of the model
+const int SKINNED_SLOTS = 64;
+
+// camera
+Camera camera(glm::vec3(0.0f, 2.0f, 14.0f));
+float lastX = SCR_WIDTH / 2.0f;
+float lastY = SCR_HEIGHT / 2.0f;
+bool firstMouse = true;
+
+// B switches between CPU animation with per character uniforms and baked palettes drawn instanced
+bool useBaked = false;
+bool bakedKeyPressed = false;
+// L switches the level of detail of the CPU animation on and off
+bool useLod = true;
+bool lodKeyPressed = false;
+// K skins the closest characters once with a compute shader, then draws them in a depth prepass and the main pass
+bool useCompute = false;
+bool computeKeyPressed = false;
+
+// timing
+float deltaTime = 0.0f;
+float lastFrame = 0.0f;
+
+int main()
+{
+	// glfw: initialize and configure
+	// ------------------------------
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+	// glfw window creation
+	// --------------------
+	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+	if (window == NULL)
+	{
+		std::cout << "Failed to create GLFW window" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+	glfwSetCursorPosCallback(window, mouse_callback);
+	glfwSetScrollCallback(window, scroll_callback);
+
+	// tell GLFW to capture our mouse
+	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+	// glad: load all OpenGL function pointers
+	// ---------------------------------------
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	{
+		std::cout << "Failed to initialize GLAD" << std::endl;
+		return -1;
+	}
+
+	// tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
+	stbi_set_flip_vertically_on_load(true);
+
+	// configure global opengl state
+	// -----------------------------
+	glEnable(GL_DEPTH_TEST);
+
+	// build and compile shaders
+	// -------------------------
+	Shader ourShader("anim_model.vs", "anim_model.fs");
+	Shader bakedShader("anim_model_baked.vs", "anim_model.fs");
+	Shader staticShader("static_model.vs", "anim_model.fs");
+
+	
+	// load models
+	// -----------
+	Model ourModel(FileSystem::getPath("resources/objects/vampire/dancing_vampire.dae"));
+	// the clip is imported once and shared by every character, they only keep their own time and pose
+	const Animation& danceAnimation = *AnimationCache::Instance().Get(FileSystem::getPath("resources/objects/vampire/dancing_vampire.dae"), &ourModel);
+
+	// the baked texture, palette buffer and skinner free their GL objects at the end of this block, before glfwTerminate
+	{
+		// the dance sampled at 30 frames per second into a texture of palettes
+		BakedAnimationTexture baked(30.0f);
+		const int danceClip = baked.AddClip(danceAnimation);
+		baked.Upload();
+		BakedCrowdRenderer bakedCrowd;
+		std::cout << "baked palettes: " << baked.GetRowCount() << " frames, " << baked.GetByteSize() / 1024 << " KB" << std::endl;
+
+		// one character per cell of the grid, each at its own time and speed in the dance. Far characters update less
+		// often and without their fingers, the furthest ones copy the baked palettes. Animation gets 2 ms per frame at most.
+		AnimationLodSettings lodSettings;
+		lodSettings.distances[0] = 15.0f;
+		lodSettings.distances[1] = 22.0f;
+		lodSettings.distances[2] = 30.0f;
+		lodSettings.budgetMilliseconds = 2.0;
+		CrowdAnimator crowd(JobSystem::instance(), lodSettings);
+		std::mt19937 generator(42);
+		std::uniform_real_distribution<float> startTime(0.0f, danceAnimation.GetDuration());
+		std::uniform_real_distribution<float> speed(0.8f, 1.2f);
+		std::vector<glm::mat4> characterModels;
+		for (int row = 0; row < CROWD_ROWS; ++row)
+		{
+			for (int column = 0; column < CROWD_COLUMNS; ++column)
+			{
+				const float start = startTime(generator);
+				const int character = crowd.AddCharacter(&danceAnimation, start, speed(generator));
+				const glm::vec3 position((column - CROWD_COLUMNS * 0.5f) * CROWD_SPACING, -0.4f, -row * CROWD_SPACING);
+				crowd.SetPosition(character, position);
+				crowd.SetBakedClip(character, &baked, danceClip);
+				characterModels.push_back(glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(.5f, .5f, .5f)));
+				// baked instances play at the rate of the clip
+				bakedCrowd.AddInstance(characterModels.back(), baked.GetClip(danceClip), start / danceAnimation.GetTicksPerSecond());
+			}
+		}
+		// the palettes of the whole crowd go to one storage buffer, each character binds its range
+		BonePaletteBuffer palettes;
+		std::vector<BonePaletteRange> paletteRanges(crowd.GetCharacterCount());
+		size_t paletteBones = 0;
+		for (int character = 0; character < crowd.GetCharacterCount(); ++character)
+			paletteBones += crowd.GetPaletteSize(character);
+
+		GpuSkinner skinner("skinning.cs");
+		for (int slot = 0; slot < SKINNED_SLOTS; ++slot)
+			skinner.AddInstance(ourModel);
+		std::vector<int> charactersByDistance(crowd.GetCharacterCount());
+
+		double statsTime = 0.0;
+		unsigned int statsFrames = 0;
+		double statsMilliseconds = 0.0;
+
+		// render loop
+		// -----------
+		while (!glfwWindowShouldClose(window))
+		{
+			// per-frame time logic
+			// --------------------
+			float currentFrame = glfwGetTime();
+			deltaTime = currentFrame - lastFrame;
+			lastFrame = currentFrame;
+
+			// input
+			// -----
+			processInput(window);
+			if (!useBaked)
+			{
+				if (useLod)
+					crowd.UpdateAnimations(deltaTime, camera.Position);
+				else
+					crowd.UpdateAnimations(deltaTime);
+				statsMilliseconds += crowd.GetStats().milliseconds;
+
+				palettes.Begin(paletteBones, crowd.GetCharacterCount());
+				for (int character = 0; character < crowd.GetCharacterCount(); ++character)
+					paletteRanges[character] = palettes.Write(crowd.GetFinalBoneMatrices(character), crowd.GetPaletteSize(character));
+				palettes.End();
+			}
+
+			// animation throughput, averaged over a second
+			++statsFrames;
+			if (currentFrame - statsTime >= 1.0)
+			{
+				const double milliseconds = statsMilliseconds / statsFrames;
+				if (useBaked)
+					std::cout << bakedCrowd.GetInstanceCount() << " baked characters: " << bakedCrowd.GetDrawCallCount() << " draw calls, no CPU animation" << std::endl;
+				else
+				{
+					const CrowdUpdateStats& stats = crowd.GetStats();
+					std::cout << crowd.GetCharacterCount() << " characters: " << milliseconds << " ms";
+					if (useLod)
+						std::cout << ", levels " << stats.levels[0] << "/" << stats.levels[1] << "/" << stats.levels[2] << "/" << stats.levels[3]
+							<< ", last frame " << stats.evaluated << " evaluated, " << stats.baked << " baked, " << stats.held << " held, " << stats.deferred << " deferred";
+					if (useCompute)
+						std::cout << ", " << skinner.GetSkinnedVertexCount() << " vertices skinned once for two passes";
+					std::cout << std::endl;
+				}
+				statsTime = currentFrame;
+				statsFrames = 0;
+				statsMilliseconds = 0.0;
+			}
+
+			// render
+			// ------
+			glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			// view/projection transformations
+			glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+			glm::mat4 view = camera.GetViewMatrix();
+
+			if (useBaked)
+			{
+				// the whole crowd in one instanced draw per mesh, animated in the vertex shader
+				bakedShader.use();
+				bakedShader.setMat4("projection", projection);
+				bakedShader.setMat4("view", view);
+				bakedShader.setFloat("time", currentFrame);
+				bakedCrowd.Draw(ourModel, bakedShader, baked);
+			}
+			else
+			{
+				// don't forget to enable shader before setting uniforms
+				ourShader.use();
+				ourShader.setMat4("projection", projection);
+				ourShader.setMat4("view", view);
+
+				int skinnedCount = 0;
+				if (useCompute)
+				{
+					// the closest characters are skinned once, then drawn twice with the static mesh shader
+					for (int character = 0; character < crowd.GetCharacterCount(); ++character)
+						charactersByDistance[character] = character;
+					skinnedCount = std::min(SKINNED_SLOTS, crowd.GetCharacterCount());
+					std::partial_sort(charactersByDistance.begin(), charactersByDistance.begin() + skinnedCount, charactersByDistance.end(), [&](int a, int b)
+						{
+							return glm::distance(glm::vec3(characterModels[a][3]), camera.Position) < glm::distance(glm::vec3(characterModels[b][3]), camera.Position);
+						});
+					for (int slot = 0; slot < skinnedCount; ++slot)
+						skinner.Skin(slot, palettes, paletteRanges[charactersByDistance[slot]]);
+					skinner.Finish();
+
+					staticShader.use();
+					staticShader.setMat4("projection", projection);
+					staticShader.setMat4("view", view);
+					glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+					for (int slot = 0; slot < skinnedCount; ++slot)
+					{
+						staticShader.setMat4("model", characterModels[charactersByDistance[slot]]);
+						skinner.Draw(slot, staticShader, false);
+					}
+					glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+					glDepthFunc(GL_LEQUAL);
+					for (int slot = 0; slot < skinnedCount; ++slot)
+					{
+						staticShader.setMat4("model", characterModels[charactersByDistance[slot]]);
+						skinner.Draw(slot, staticShader);
+					}
+					glDepthFunc(GL_LESS);
+				}
+				else
+				{
+					for (int character = 0; character < crowd.GetCharacterCount(); ++character)
+						charactersByDistance[character] = character;
+				}
+
+				// render the rest of the crowd, skinned in the vertex shader
+				ourShader.use();
+				for (int i = skinnedCount; i < crowd.GetCharacterCount(); ++i)
+				{
+					const int character = charactersByDistance[i];
+					palettes.Bind(paletteRanges[character]);
+					ourShader.setMat4("model", characterModels[character]);
+					ourModel.Draw(ourShader);
+				}
+			}
+
+
+			// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+			// -------------------------------------------------------------------------------
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+		}
+	}
+
+	// glfw: terminate, clearing all previously allocated GLFW resources.
+	// ------------------------------------------------------------------
+	glfwTerminate();
+	return 0;
+}
+
+// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
+// ---------------------------------------------------------------------------------------------------------
+void processInput(GLFWwindow* window)
+{
+	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+		glfwSetWindowShouldClose(window, true);
+
+	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+		camera.ProcessKeyboard(FORWARD, deltaTime);
+	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+		camera.ProcessKeyboard(BACKWARD, deltaTime);
+	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+		camera.ProcessKeyboard(LEFT, deltaTime);
+	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+		camera.ProcessKeyboard(RIGHT, deltaTime);
+
+	if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS && !bakedKeyPressed)
+	{
+		useBaked = !useBaked;
+		bakedKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_B) == GLFW_RELEASE)
+		bakedKeyPressed = false;
+
+	if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS && !lodKeyPressed)
+	{
+		useLod = !useLod;
+		lodKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_L) == GLFW_RELEASE)
+		lodKeyPressed = false;
+
+	if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS && !computeKeyPressed)
+	{
+		useCompute = !useCompute;
+		computeKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_K) == GLFW_RELEASE)
+		computeKeyPressed = false;
+}
+
+// glfw: whenever the window size changed (by OS or user resize) this callback function executes
+// ---------------------------------------------------------------------------------------------
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+	// make sure the viewport matches the new window dimensions; note that width and 
+	// height will be significantly larger than specified on retina displays.
+	glViewport(0, 0, width, height);
+}
+
+// glfw: whenever the mouse moves, this callback is called
+// -------------------------------------------------------
+void mouse_callback(GLFWwindow* window, double xpos, double ypos)
+{
+	if (firstMouse)
+	{
+		lastX = xpos;
+		lastY = ypos;
+		firstMouse = false;
+	}
+
+	float xoffset = xpos - lastX;
+	float yoffset = lastY - ypos; // reversed since y-coordinates go from bottom to top
+
+	lastX = xpos;
+	lastY = ypos;
+
+	camera.ProcessMouseMovement(xoffset, yoffset);
+}
+
+// glfw: whenever the mouse scroll wheel scrolls, this callback is called
+// ----------------------------------------------------------------------
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+	camera.ProcessMouseScroll(yoffset);
+}
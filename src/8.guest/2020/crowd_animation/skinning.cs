@@ -0,0 +1,73 @@
+#version 430 core
+layout (local_size_x = 64) in;
+
+// the palette range of the instance, three rows of the 3x4 matrix of each bone
+layout(std430, binding = 0) readonly buffer BonePalettes {
+    vec4 bonePalettes[];
+};
+
+// position, normal and texture coordinates of each vertex, 8 floats without padding
+layout(std430, binding = 1) readonly buffer RestVertices {
+    float restVertices[];
+};
+
+struct Influence {
+    ivec4 boneIds;
+    vec4 weights;
+};
+
+layout(std430, binding = 2) readonly buffer Influences {
+    Influence influences[];
+};
+
+// same layout as the rest vertices, read by the VAO of the skinned mesh
+layout(std430, binding = 3) writeonly buffer SkinnedVertices {
+    float skinnedVertices[];
+};
+
+uniform uint vertexCount;
+
+const int MAX_BONE_INFLUENCE = 4;
+
+void main()
+{
+    uint vertex = gl_GlobalInvocationID.x;
+    if (vertex >= vertexCount)
+        return;
+
+    uint base = vertex * 8u;
+    vec4 position = vec4(restVertices[base], restVertices[base + 1u], restVertices[base + 2u], 1.0f);
+    vec3 normal = vec3(restVertices[base + 3u], restVertices[base + 4u], restVertices[base + 5u]);
+    int boneCount = bonePalettes.length() / 3;
+    Influence influence = influences[vertex];
+
+    // the math of anim_model.vs, the normal goes through the same matrices
+    vec3 totalPosition = vec3(0.0f);
+    vec3 totalNormal = vec3(0.0f);
+    for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+    {
+        int bone = influence.boneIds[i];
+        if (bone == -1)
+            continue;
+        if (bone >= boneCount)
+        {
+            totalPosition = position.xyz;
+            totalNormal = normal;
+            break;
+        }
+        vec4 r0 = bonePalettes[bone * 3];
+        vec4 r1 = bonePalettes[bone * 3 + 1];
+        vec4 r2 = bonePalettes[bone * 3 + 2];
+        totalPosition += vec3(dot(r0, position), dot(r1, position), dot(r2, position)) * influence.weights[i];
+        totalNormal += vec3(dot(r0.xyz, normal), dot(r1.xyz, normal), dot(r2.xyz, normal)) * influence.weights[i];
+    }
+
+    skinnedVertices[base] = totalPosition.x;
+    skinnedVertices[base + 1u] = totalPosition.y;
+    skinnedVertices[base + 2u] = totalPosition.z;
+    skinnedVertices[base + 3u] = totalNormal.x;
+    skinnedVertices[base + 4u] = totalNormal.y;
+    skinnedVertices[base + 5u] = totalNormal.z;
+    skinnedVertices[base + 6u] = restVertices[base + 6u];
+    skinnedVertices[base + 7u] = restVertices[base + 7u];
+}
@@ -0,0 +1,18 @@
+#version 430 core
+
+// an ordinary static mesh shader, the vertices were skinned by skinning.cs
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 norm;
+layout(location = 2) in vec2 tex;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+
+out vec2 TexCoords;
+
+void main()
+{
+    gl_Position = projection * view * model * vec4(pos, 1.0f);
+    TexCoords = tex;
+}
@@ -89,6 +89,12 @@ int main()
 	// -----------
 	Model ourModel(FileSystem::getPath("resources/objects/vampire/dancing_vampire.dae"));
 	Animation danceAnimation(FileSystem::getPath("resources/objects/vampire/dancing_vampire.dae"),&ourModel);
+
+	// compress the keyframes, errors are in model units and radians
+	ClipCompressionReport compression = danceAnimation.Compress();
+	std::cout << "dancing_vampire: " << compression.originalBytes / 1024 << " KB -> " << compression.compressedBytes / 1024
+		<< " KB (" << compression.GetRatio() << ":1), " << compression.originalKeys << " -> " << compression.compressedKeys << " keys, max error "
+		<< compression.maxTranslationError << " / " << compression.maxRotationError << " rad / " << compression.maxScaleError << std::endl;
 	Animator animator(&danceAnimation);
 
 
@@ -124,9 +130,9 @@ int main()
 		ourShader.setMat4("projection", projection);
 		ourShader.setMat4("view", view);
 
-        auto transforms = animator.GetFinalBoneMatrices();
-		for (int i = 0; i < transforms.size(); ++i)
-			ourShader.setMat4("finalBonesMatrices[" + std::to_string(i) + "]", transforms[i]);
+		// the whole palette in one call, up to the MAX_BONES of the shader
+		const std::vector<glm::mat4>& transforms = animator.GetFinalBoneMatrices();
+		glUniformMatrix4fv(glGetUniformLocation(ourShader.ID, "finalBonesMatrices"), std::min(100, static_cast<int>(transforms.size())), GL_FALSE, &transforms[0][0][0]);
 
 
 		// render the loaded model
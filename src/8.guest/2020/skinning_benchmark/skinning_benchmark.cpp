@@ -0,0 +1,155 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/cpu_skinning.h>
+#include <learnopengl/job_system.h>
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <utility>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+
+// Headless microbenchmark: no window nor GL context is created, so it can run on any build machine.
+// Every SIMD kernel of the build is timed and checked against the scalar version of the math of anim_model.vs:
+// the 4 wide one with SSE2, the 8 wide one too when built with AVX2 (-mavx2, /arch:AVX2).
+
+// settings
+const unsigned int VERTEX_COUNT = 1000000;
+const int BONE_COUNT = 100;
+const unsigned int REPEAT = 10;
+const float TOLERANCE = 1e-4f;
+
+typedef void (*SkinningKernel)(const SkinningInputSoA&, const glm::mat4*, int, VertexStreamsSoA&, size_t, size_t);
+
+// time the best run of a test, in seconds
+double measure(const std::function<void()>& test)
+{
+	double best = 1e30;
+	for (unsigned int i = 0; i < REPEAT; ++i)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		test();
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		best = std::min(best, elapsed.count());
+	}
+	return best;
+}
+
+void report(const char* name, double seconds)
+{
+	std::cout << name << " : " << VERTEX_COUNT / seconds * 1e-6 << " M vertices/s (" << seconds * 1e3 << " ms)" << std::endl;
+}
+
+// largest difference between two skinned meshes, positions and normals
+float maxDifference(const VertexStreamsSoA& a, const VertexStreamsSoA& b)
+{
+	float difference = 0.f;
+	for (size_t i = 0; i < a.size(); ++i)
+	{
+		difference = std::max(difference, glm::length(a.getPosition(i) - b.getPosition(i)));
+		difference = std::max(difference, glm::length(a.getNormal(i) - b.getNormal(i)));
+	}
+	return difference;
+}
+
+int main()
+{
+	// a palette of rotated, scaled and translated bones
+	// -------------------------------------------------
+	std::mt19937 generator(42);
+	std::uniform_real_distribution<float> unit(-1.f, 1.f);
+	std::vector<glm::mat4> palette(BONE_COUNT);
+	for (auto&& bone : palette)
+	{
+		const glm::vec3 axis = glm::normalize(glm::vec3(unit(generator), unit(generator), unit(generator)) + glm::vec3(0.f, 0.f, 2.f));
+		bone = glm::translate(glm::mat4(1.0f), glm::vec3(unit(generator), unit(generator), unit(generator)));
+		bone = glm::rotate(bone, unit(generator) * 3.14f, axis);
+		bone = glm::scale(bone, glm::vec3(1.f + 0.2f * unit(generator)));
+	}
+
+	// vertices with one to four influences, a few unused slots in the middle and a few bones past the palette
+	// -------------------------------------------------------------------------------------------------------
+	std::uniform_int_distribution<int> boneIndex(0, BONE_COUNT - 1);
+	std::uniform_int_distribution<int> influenceCount(1, SKINNING_MAX_INFLUENCES);
+	SkinningInputSoA input;
+	input.resize(VERTEX_COUNT);
+	for (unsigned int i = 0; i < VERTEX_COUNT; ++i)
+	{
+		input.rest.set(i, glm::vec3(unit(generator), unit(generator), unit(generator)) * 2.f,
+			glm::normalize(glm::vec3(unit(generator), unit(generator), unit(generator)) + glm::vec3(0.f, 0.01f, 0.f)));
+		const int influences = influenceCount(generator);
+		float total = 0.f;
+		for (int slot = 0; slot < influences; ++slot)
+		{
+			input.boneIds[slot][i] = boneIndex(generator);
+			input.weights[slot][i] = 0.1f + (unit(generator) + 1.f);
+			total += input.weights[slot][i];
+		}
+		for (int slot = 0; slot < influences; ++slot)
+			input.weights[slot][i] /= total;
+		if (i % 97 == 0)
+			input.boneIds[0][i] = -1;
+		if (i % 1009 == 0)
+			input.boneIds[influences - 1][i] = BONE_COUNT + 3;
+	}
+	std::cout << "SIMD width : " << CPU_SKINNING_WIDTH << ", kernels compiled up to " << CPU_SKINNING_MAX_WIDTH << std::endl;
+
+	// scalar reference, the math of the vertex shader
+	// -----------------------------------------------
+	VertexStreamsSoA reference, simd, parallel;
+	reference.resize(VERTEX_COUNT);
+	simd.resize(VERTEX_COUNT);
+	const double referenceTime = measure([&]()
+		{
+			skinVerticesReference(input, palette.data(), BONE_COUNT, reference, 0, VERTEX_COUNT);
+		});
+	report("skinVerticesReference       ", referenceTime);
+
+	// every kernel of this build on a single thread, skinVertices uses the CPU_SKINNING_WIDTH one
+	// -------------------------------------------------------------------------------------------
+	std::vector<std::pair<int, SkinningKernel>> kernels{ { 1, &skinVerticesWidth<1> } };
+#if CPU_SKINNING_MAX_WIDTH >= 4
+	kernels.push_back({ 4, &skinVerticesWidth<4> });
+#endif
+#if CPU_SKINNING_MAX_WIDTH >= 8
+	kernels.push_back({ 8, &skinVerticesWidth<8> });
+#endif
+	double simdTime = referenceTime;
+	float simdDifference = 0.f;
+	for (auto&& kernel : kernels)
+	{
+		const double kernelTime = measure([&]()
+			{
+				kernel.second(input, palette.data(), BONE_COUNT, simd, 0, VERTEX_COUNT);
+			});
+		std::string name = "skinVerticesWidth<" + std::to_string(kernel.first) + ">";
+		name.resize(28, ' ');
+		report(name.c_str(), kernelTime);
+		simdDifference = std::max(simdDifference, maxDifference(reference, simd));
+		if (kernel.first == CPU_SKINNING_WIDTH)
+			simdTime = kernelTime;
+	}
+
+	// SIMD kernel over the job system
+	// -------------------------------
+	JobSystem& jobSystem = JobSystem::instance();
+	const double parallelTime = measure([&]()
+		{
+			skinVertices(jobSystem, input, palette.data(), BONE_COUNT, parallel);
+		});
+	std::cout << "skinVertices, " << jobSystem.getConcurrency() << " threads ";
+	report("", parallelTime);
+
+	// every kernel must match the reference
+	// -------------------------------------
+	const float parallelDifference = maxDifference(reference, parallel);
+	const bool passed = simdDifference <= TOLERANCE && parallelDifference <= TOLERANCE;
+	std::cout << "Speedup : " << referenceTime / simdTime << "x single thread, " << referenceTime / parallelTime << "x parallel, max difference : "
+		<< std::max(simdDifference, parallelDifference) << (passed ? " (passed)" : " (FAILED)") << std::endl;
+	return passed ? 0 : 1;
+}
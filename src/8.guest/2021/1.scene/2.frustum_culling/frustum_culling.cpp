@@ -10,6 +10,10 @@
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
 #include <learnopengl/entity.h>
+#include <learnopengl/render_list.h>
+#include <learnopengl/dirty_transform_list.h>
+#include <learnopengl/scene_file.h>
+#include <learnopengl/instanced_renderer.h>
 
 #ifndef ENTITY_H
 #define ENTITY_H
@@ -48,7 +52,7 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-int main()
+int main(int argc, char** argv)
 {
 	// glfw: initialize and configure
 	// ------------------------------
@@ -97,17 +101,32 @@ int main()
 
 	// build and compile shaders
 	// -------------------------
-	Shader ourShader("1.model_loading.vs", "1.model_loading.fs");
+	// entities sharing a model are drawn with one instanced call per mesh
+	Shader ourShader("1.model_loading_instanced.vs", "1.model_loading.fs");
 
 	// load entities
 	// -----------
-	Model model(FileSystem::getPath("resources/objects/planet/planet.obj"));
-	Entity ourEntity(model);
-	ourEntity.transform.setLocalPosition({ 0, 0, 0 });
-	const float scale = 1.0;
-	ourEntity.transform.setLocalScale({ scale, scale, scale });
+	const std::string modelPath = FileSystem::getPath("resources/objects/planet/planet.obj");
+	Model model(modelPath);
+
+	// optional scene file: loaded if it exists, written from the procedural scene otherwise
+	const std::string scenePath = argc > 1 ? argv[1] : "";
+	SceneFile sceneFile;
+	std::unique_ptr<Entity> loadedEntity;
+	if (!scenePath.empty() && sceneFile.open(scenePath))
+	{
+		loadedEntity = instantiateSceneFile(sceneFile, [&](std::string_view) -> Model& { return model; });
+		std::cout << "Loaded " << sceneFile.getNodeCount() << " nodes from " << scenePath << std::endl;
+	}
 
+	if (!loadedEntity)
 	{
+		loadedEntity = std::make_unique<Entity>(model);
+		Entity& ourEntity = *loadedEntity;
+		ourEntity.transform.setLocalPosition({ 0, 0, 0 });
+		const float scale = 1.0;
+		ourEntity.transform.setLocalScale({ scale, scale, scale });
+
 		Entity* lastEntity = &ourEntity;
 
 		for (unsigned int x = 0; x < 20; ++x)
@@ -121,59 +140,101 @@ int main()
 				lastEntity->transform.setLocalPosition({ x * 10.f - 100.f,  0.f, z * 10.f - 100.f });
 			}
 		}
+
+		if (!scenePath.empty())
+		{
+			ourEntity.updateSelfAndChild();
+			writeSceneFile(scenePath, ourEntity, { { &model, modelPath } });
+		}
 	}
-	ourEntity.updateSelfAndChild();
+	Entity& ourEntity = *loadedEntity;
+
+	// coarser planets for the far entities, merging the vertices closer than the cell size. The level is picked
+	// per entity so its error stays under a few pixels on screen.
+	Model planetLod1 = model;
+	const float planetLod1Error = simplifyByClustering(planetLod1, 0.5f);
+	Model planetLod2 = model;
+	const float planetLod2Error = simplifyByClustering(planetLod2, 0.8f);
+	LodChain planetLods;
+	planetLods.addLevel(model, 0.f);
+	planetLods.addLevel(planetLod1, planetLod1Error);
+	planetLods.addLevel(planetLod2, std::max(planetLod1Error, planetLod2Error));
+	ourEntity.forceUpdateSelfAndChild([&](Entity& entity) { entity.pLods = &planetLods; });
+
+	LodSettings lodSettings;
+	lodSettings.maxPixelError = 6.f;
+
+	// only the subtrees that moved since the last frame are updated, a static scene costs nothing
+	DirtyTransformList dirtyTransforms;
+	dirtyTransforms.attach(ourEntity);
+	dirtyTransforms.update();
+
+	// the instanced renderer frees its buffers at the end of this block, before glfwTerminate
+	{
+		// culling and draw packets are built on worker threads, only the submission touches the context
+		RenderList renderList;
+		InstancedRenderer instancedRenderer;
+		MeshCullingStats meshStats;
 
-	// draw in wireframe
-	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		// draw in wireframe
+		//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
-	// render loop
-	// -----------
-	while (!glfwWindowShouldClose(window))
-	{
-		// per-frame time logic
-		// --------------------
-		float currentFrame = glfwGetTime();
-		deltaTime = currentFrame - lastFrame;
-		lastFrame = currentFrame;
-
-		// input
-		// -----
-		processInput(window);
-
-		// render
-		// ------
-		glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		// don't forget to enable shader before setting uniforms
-		ourShader.use();
-
-		// view/projection transformations
-		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-		const Frustum camFrustum = createFrustumFromCamera(camera, (float)SCR_WIDTH / (float)SCR_HEIGHT, glm::radians(camera.Zoom), 0.1f, 100.0f);
-
-		cameraSpy.ProcessMouseMovement(2, 0);
-		//static float acc = 0;
-		//acc += deltaTime * 0.0001;
-		//cameraSpy.Position = { cos(acc) * 10, 0.f, sin(acc) * 10 };
-		glm::mat4 view = camera.GetViewMatrix();
-
-		ourShader.setMat4("projection", projection);
-		ourShader.setMat4("view", view);
-
-		// draw our scene graph
-		unsigned int total = 0, display = 0;
-		ourEntity.drawSelfAndChild(camFrustum, ourShader, display, total);
-		std::cout << "Total process in CPU : " << total << " / Total send to GPU : " << display << std::endl;
-
-		//ourEntity.transform.setLocalRotation({ 0.f, ourEntity.transform.getLocalRotation().y + 20 * deltaTime, 0.f });
-		ourEntity.updateSelfAndChild();
-
-		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-		// -------------------------------------------------------------------------------
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+		// render loop
+		// -----------
+		while (!glfwWindowShouldClose(window))
+		{
+			// per-frame time logic
+			// --------------------
+			float currentFrame = glfwGetTime();
+			deltaTime = currentFrame - lastFrame;
+			lastFrame = currentFrame;
+
+			// input
+			// -----
+			processInput(window);
+
+			// render
+			// ------
+			glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			// don't forget to enable shader before setting uniforms
+			ourShader.use();
+
+			// view/projection transformations
+			glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+			const Frustum camFrustum = createFrustumFromCamera(camera, (float)SCR_WIDTH / (float)SCR_HEIGHT, glm::radians(camera.Zoom), 0.1f, 100.0f);
+
+			cameraSpy.ProcessMouseMovement(2, 0);
+			//static float acc = 0;
+			//acc += deltaTime * 0.0001;
+			//cameraSpy.Position = { cos(acc) * 10, 0.f, sin(acc) * 10 };
+			glm::mat4 view = camera.GetViewMatrix();
+
+			ourShader.setMat4("projection", projection);
+			ourShader.setMat4("view", view);
+
+			// draw our scene graph
+			lodSettings.setProjection(glm::radians(camera.Zoom), (float)SCR_HEIGHT);
+			renderList.setLodSettings(lodSettings);
+			renderList.build(ourEntity, camFrustum, camera.Position);
+			meshStats.reset();
+			instancedRenderer.submit(renderList, camFrustum, ourShader, meshStats);
+			std::cout << "Total process in CPU : " << renderList.getTotalCount() << " / Total send to GPU : " << renderList.getDisplayCount()
+				<< " in " << instancedRenderer.getDrawCallCount() << " draw calls"
+				<< " / Meshes rejected : " << meshStats.meshesRejected << " of " << meshStats.meshesTested
+				<< " (" << meshStats.trianglesRejected << " triangles)"
+				<< " / LOD reduced : " << renderList.getLodStats().entitiesReduced
+				<< " (" << renderList.getLodStats().trianglesSaved << " triangles saved)" << std::endl;
+
+			//ourEntity.transform.setLocalRotation({ 0.f, ourEntity.transform.getLocalRotation().y + 20 * deltaTime, 0.f });
+			dirtyTransforms.update();
+
+			// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+			// -------------------------------------------------------------------------------
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+		}
 	}
 
 	// glfw: terminate, clearing all previously allocated GLFW resources.
@@ -0,0 +1,177 @@
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/shader_m.h>
+#include <learnopengl/camera.h>
+#include <learnopengl/model.h>
+#include <learnopengl/entity.h>
+#include <learnopengl/batch_culling.h>
+#include <learnopengl/dynamic_aabb_tree.h>
+#include <learnopengl/occlusion_culling.h>
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <functional>
+
+// Headless microbenchmark: no window nor GL context is created, so it can run on any build machine.
+
+// settings
+const unsigned int BOX_COUNT = 1000000;
+const unsigned int REPEAT = 20;
+const float WORLD_SIZE = 400.f;
+
+// time the best run of a test, in seconds
+double measure(const std::function<void()>& test)
+{
+	double best = 1e30;
+	for (unsigned int i = 0; i < REPEAT; ++i)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		test();
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		best = std::min(best, elapsed.count());
+	}
+	return best;
+}
+
+void report(const char* name, double seconds, unsigned int visible)
+{
+	std::cout << name << " : " << BOX_COUNT / seconds * 1e-6 << " M boxes/s (" << seconds * 1e3 << " ms, " << visible << " visible)" << std::endl;
+}
+
+int main()
+{
+	// generate a world full of randomly placed, rotated and scaled boxes
+	// ------------------------------------------------------------------
+	std::mt19937 generator(42);
+	std::uniform_real_distribution<float> position(-WORLD_SIZE, WORLD_SIZE);
+	std::uniform_real_distribution<float> angle(0.f, 360.f);
+	std::uniform_real_distribution<float> scale(0.5f, 3.f);
+
+	const AABB localAABB(glm::vec3(-1.f), glm::vec3(1.f));
+	std::vector<Transform> transforms(BOX_COUNT);
+	for (auto&& transform : transforms)
+	{
+		transform.setLocalPosition({ position(generator), position(generator) * 0.1f, position(generator) });
+		transform.setLocalRotation({ angle(generator), angle(generator), angle(generator) });
+		transform.setLocalScale(glm::vec3(scale(generator)));
+		transform.computeModelMatrix();
+	}
+
+	Camera camera(glm::vec3(0.0f, 10.0f, 0.0f));
+	const Frustum camFrustum = createFrustumFromCamera(camera, 800.f / 600.f, glm::radians(camera.Zoom), 0.1f, 100.0f);
+	std::cout << "SIMD width : " << BATCH_CULLING_WIDTH << std::endl;
+
+	// current implementation: world AABB and six planes per entity through the virtual call
+	// --------------------------------------------------------------------------------------
+	const BoundingVolume& boundingVolume = localAABB;
+	std::vector<uint8_t> reference(BOX_COUNT);
+	unsigned int referenceVisible = 0;
+	const double referenceTime = measure([&]()
+		{
+			referenceVisible = 0;
+			for (unsigned int i = 0; i < BOX_COUNT; ++i)
+			{
+				reference[i] = boundingVolume.isOnFrustum(camFrustum, transforms[i]);
+				referenceVisible += reference[i];
+			}
+		});
+	report("BoundingVolume::isOnFrustum       ", referenceTime, referenceVisible);
+
+	// batch kernel on world AABBs already in SoA form, the usual case once bounds are cached
+	// --------------------------------------------------------------------------------------
+	AABBSoA worldAABBs;
+	worldAABBs.reserve(BOX_COUNT);
+	for (auto&& transform : transforms)
+		worldAABBs.pushTransformed(localAABB, transform.getAffineMatrix());
+
+	std::vector<uint64_t> visibleMask;
+	std::vector<uint32_t> visibleIndices;
+	const double batchTime = measure([&]()
+		{
+			cullAABBs(camFrustum, worldAABBs, visibleMask);
+		});
+	visibleMaskToIndices(visibleMask, visibleIndices);
+	report("cullAABBs                         ", batchTime, static_cast<unsigned int>(visibleIndices.size()));
+
+	// batch kernel including the world AABB update and the index list compaction
+	// --------------------------------------------------------------------------
+	const double fullTime = measure([&]()
+		{
+			worldAABBs.clear();
+			for (auto&& transform : transforms)
+				worldAABBs.pushTransformed(localAABB, transform.getAffineMatrix());
+			cullAABBs(camFrustum, worldAABBs, visibleMask);
+			visibleMaskToIndices(visibleMask, visibleIndices);
+		});
+	report("pushTransformed + cullAABBs + list", fullTime, static_cast<unsigned int>(visibleIndices.size()));
+
+	// dynamic AABB tree: only the visible part of the world is traversed
+	// ------------------------------------------------------------------
+	DynamicAABBTree tree;
+	for (unsigned int i = 0; i < BOX_COUNT; ++i)
+	{
+		const glm::vec3 center{ worldAABBs.centerX[i], worldAABBs.centerY[i], worldAABBs.centerZ[i] };
+		const glm::vec3 extents{ worldAABBs.extentX[i], worldAABBs.extentY[i], worldAABBs.extentZ[i] };
+		tree.createProxy(BoundingBox::fromCenterExtents(center, extents), reinterpret_cast<void*>(static_cast<uintptr_t>(i)));
+	}
+
+	unsigned int treeVisible = 0;
+	const double treeTime = measure([&]()
+		{
+			treeVisible = 0;
+			tree.queryFrustum(camFrustum, [&](int32_t, void*) { treeVisible++; });
+		});
+	// the leaves are fattened so a few more boxes than the exact count are reported
+	report("DynamicAABBTree::queryFrustum     ", treeTime, treeVisible);
+
+	// software occlusion culling of the frustum survivors behind a large wall
+	// -----------------------------------------------------------------------
+	const glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), 800.f / 600.f, 0.1f, 100.0f);
+	const BoundingBox wall(glm::vec3(-40.f, -20.f, -32.f), glm::vec3(40.f, 40.f, -30.f));
+	const OccluderMesh wallOccluder = OccluderMesh::fromBox(wall);
+
+	OcclusionCuller occlusionCuller;
+	std::vector<uint32_t> unoccluded;
+	const double occlusionTime = measure([&]()
+		{
+			occlusionCuller.beginFrame(projection * camera.GetViewMatrix());
+			occlusionCuller.rasterizeOccluder(wallOccluder, glm::mat4(1.0f));
+			unoccluded.clear();
+			for (uint32_t i : visibleIndices)
+			{
+				const glm::vec3 center{ worldAABBs.centerX[i], worldAABBs.centerY[i], worldAABBs.centerZ[i] };
+				const glm::vec3 extents{ worldAABBs.extentX[i], worldAABBs.extentY[i], worldAABBs.extentZ[i] };
+				if (occlusionCuller.isVisible(BoundingBox::fromCenterExtents(center, extents)))
+					unoccluded.push_back(i);
+			}
+		});
+	const OcclusionStats& occlusionStats = occlusionCuller.getStats();
+	std::cout << "OcclusionCuller : " << occlusionStats.tested << " tested, " << occlusionStats.occluded << " occluded, "
+		<< occlusionStats.visible << " visible (" << occlusionStats.occluderTriangles << " occluder triangles rasterized in "
+		<< occlusionStats.rasterizeMs << " ms, tests " << occlusionStats.testMs << " ms, total " << occlusionTime * 1e3 << " ms)" << std::endl;
+
+	// both paths must agree, and nothing in front of the wall can be occluded
+	// -----------------------------------------------------------------------
+	unsigned int mismatches = 0;
+	for (unsigned int i = 0; i < BOX_COUNT; ++i)
+	{
+		const bool visible = (visibleMask[i / 64] >> (i % 64)) & 1;
+		mismatches += visible != (reference[i] != 0);
+	}
+	size_t cursor = 0;
+	for (uint32_t i : visibleIndices)
+	{
+		const bool occluded = cursor >= unoccluded.size() || unoccluded[cursor] != i;
+		if (!occluded)
+			++cursor;
+		else if (worldAABBs.centerZ[i] + worldAABBs.extentZ[i] > wall.max.z)
+			++mismatches;
+	}
+	std::cout << "Speedup : " << referenceTime / batchTime << "x, mismatches : " << mismatches << std::endl;
+	return mismatches == 0 ? 0 : 1;
+}
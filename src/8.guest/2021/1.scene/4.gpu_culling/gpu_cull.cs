@@ -0,0 +1,133 @@
+#version 430 core
+
+layout (local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// ----------------------------------------------------------------------------
+//
+// buffers
+//
+// ----------------------------------------------------------------------------
+
+struct Instance {
+	mat4 model;
+	vec4 boundsCenter;      /** World AABB */
+	vec4 boundsExtents;
+	uvec4 drawId;           /** x only, the rest is padding */
+};
+
+struct DrawCommand {
+	uint count;
+	uint instanceCount;
+	uint firstIndex;
+	int baseVertex;
+	uint baseInstance;
+};
+
+layout(std430, binding = 0) readonly buffer Instances {
+	Instance instances[];
+};
+
+layout(std430, binding = 1) buffer DrawCommands {
+	DrawCommand commands[];
+};
+
+layout(std430, binding = 2) writeonly buffer VisibleInstances {
+	uint visibleInstances[];
+};
+
+layout(std430, binding = 3) readonly buffer GroupCapacities {
+	uint groupCapacities[];  /** Room of each draw group in visibleInstances */
+};
+
+// ----------------------------------------------------------------------------
+//
+// uniforms
+//
+// ----------------------------------------------------------------------------
+
+uniform uint instanceCount;
+uniform vec4 frustumPlanes[6];  /** Normal and offset, positive inside */
+
+uniform bool useHiZ;
+uniform mat4 hiZViewProjection; /** Camera of the frame the Hi-Z was built from */
+uniform vec2 hiZSize;
+uniform int hiZLevels;
+uniform sampler2D hiZ;
+
+// ----------------------------------------------------------------------------
+//
+// functions
+//
+// ----------------------------------------------------------------------------
+
+bool isInFrustum(vec3 center, vec3 extents) {
+	for (int i = 0; i < 6; ++i) {
+		vec4 plane = frustumPlanes[i];
+		if (dot(plane.xyz, center) + plane.w < -dot(abs(plane.xyz), extents))
+			return false;
+	}
+	return true;
+}
+
+bool isOccluded(vec3 center, vec3 extents) {
+	vec3 uvMin = vec3(1.0);
+	vec3 uvMax = vec3(0.0);
+	for (int i = 0; i < 8; ++i) {
+		vec3 corner = center + extents * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+		vec4 clip = hiZViewProjection * vec4(corner, 1.0);
+		// crossing the near plane of the previous frame, nothing can be said
+		if (clip.w <= 1e-5)
+			return false;
+		vec3 uvz = clip.xyz / clip.w * 0.5 + 0.5;
+		uvMin = min(uvMin, uvz);
+		uvMax = max(uvMax, uvz);
+	}
+
+	// off screen in the previous frame, the frustum test already decided
+	if (any(greaterThan(uvMin.xy, vec2(1.0))) || any(lessThan(uvMax.xy, vec2(0.0))))
+		return false;
+
+	ivec2 size = ivec2(hiZSize);
+	ivec2 pixelMin = clamp(ivec2(uvMin.xy * hiZSize), ivec2(0), size - 1);
+	ivec2 pixelMax = clamp(ivec2(uvMax.xy * hiZSize), ivec2(0), size - 1);
+
+	// the level where the rectangle spans at most 2x2 texels
+	ivec2 span = pixelMax - pixelMin + 1;
+	int level = clamp(int(ceil(log2(float(max(span.x, span.y))))), 0, hiZLevels - 1);
+	ivec2 levelSize = max(size >> level, ivec2(1));
+	ivec2 texelMin = min(pixelMin >> level, levelSize - 1);
+	ivec2 texelMax = min(pixelMax >> level, levelSize - 1);
+
+	float farthest = 0.0;
+	for (int y = texelMin.y; y <= texelMax.y; ++y)
+		for (int x = texelMin.x; x <= texelMax.x; ++x)
+			farthest = max(farthest, texelFetch(hiZ, ivec2(x, y), level).r);
+
+	// hidden when its nearest point is behind everything drawn over its rectangle
+	return uvMin.z > farthest;
+}
+
+void main() {
+	uint id = gl_GlobalInvocationID.x;
+	if (id >= instanceCount)
+		return;
+
+	vec3 center = instances[id].boundsCenter.xyz;
+	vec3 extents = instances[id].boundsExtents.xyz;
+	if (!isInFrustum(center, extents))
+		return;
+	if (useHiZ && isOccluded(center, extents))
+		return;
+
+	uint drawId = instances[id].drawId.x;
+	if (drawId >= uint(groupCapacities.length()))
+		return;
+
+	uint slot = atomicAdd(commands[drawId].instanceCount, 1u);
+	// group full: the slot would belong to the next group, every add past the capacity is undone by its own min
+	if (slot >= groupCapacities[drawId]) {
+		atomicMin(commands[drawId].instanceCount, groupCapacities[drawId]);
+		return;
+	}
+	visibleInstances[commands[drawId].baseInstance + slot] = id;
+}
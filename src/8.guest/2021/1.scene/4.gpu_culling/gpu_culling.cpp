@@ -0,0 +1,375 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <learnopengl/shader_m.h>
+#include <learnopengl/camera.h>
+#include <learnopengl/model.h>
+#include <learnopengl/entity.h>
+#include <learnopengl/batch_culling.h>
+#include <learnopengl/gpu_culling.h>
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cstdlib>
+
+void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void mouse_callback(GLFWwindow* window, double xpos, double ypos);
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void processInput(GLFWwindow* window);
+unsigned int createMeshes(unsigned int& cubeIndexCount, unsigned int& pyramidIndexCount, int& pyramidBaseVertex);
+
+// settings
+const unsigned int SCR_WIDTH = 800;
+const unsigned int SCR_HEIGHT = 600;
+const unsigned int GRID_SIZE = 150;
+const float GRID_SPACING = 4.f;
+const float Z_NEAR = 0.1f;
+const float Z_FAR = 400.f;
+
+// camera
+Camera camera(glm::vec3(0.0f, 10.0f, 20.0f));
+float lastX = SCR_WIDTH / 2.0f;
+float lastY = SCR_HEIGHT / 2.0f;
+bool firstMouse = true;
+int windowWidth = SCR_WIDTH;
+int windowHeight = SCR_HEIGHT;
+
+// timing
+float deltaTime = 0.0f;
+float lastFrame = 0.0f;
+
+// Usage: pass a frame count to exit after that many frames, which lets a CI machine running Mesa llvmpipe under
+// a virtual display check the result of the culling pass against the CPU.
+int main(int argc, char* argv[])
+{
+	const int frameLimit = argc > 1 ? std::atoi(argv[1]) : 0;
+
+	// glfw: initialize and configure
+	// ------------------------------
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+	// glfw window creation
+	// --------------------
+	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+	if (window == NULL)
+	{
+		std::cout << "Failed to create GLFW window" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+	glfwSetCursorPosCallback(window, mouse_callback);
+	glfwSetScrollCallback(window, scroll_callback);
+	glfwSwapInterval(0);
+
+	// tell GLFW to capture our mouse
+	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+	// glad: load all OpenGL function pointers
+	// ---------------------------------------
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	{
+		std::cout << "Failed to initialize GLAD" << std::endl;
+		return -1;
+	}
+
+	// configure global opengl state
+	// -----------------------------
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_CULL_FACE);
+
+	camera.MovementSpeed = 20.f;
+
+	int exitCode = EXIT_SUCCESS;
+	// the culler frees its buffers and programs at the end of this block, before glfwTerminate
+	{
+		// build and compile shaders
+		// -------------------------
+		Shader shader("gpu_culling.vs", "gpu_culling.fs");
+		GpuCuller culler("hiz_build.cs", "gpu_cull.cs");
+
+		// a cube and a pyramid share the vertex and index buffers, each one is a draw group
+		// ---------------------------------------------------------------------------------
+		unsigned int cubeIndexCount, pyramidIndexCount;
+		int pyramidBaseVertex;
+		const unsigned int VAO = createMeshes(cubeIndexCount, pyramidIndexCount, pyramidBaseVertex);
+
+		const unsigned int instanceCount = GRID_SIZE * GRID_SIZE + GRID_SIZE / 10;
+		const uint32_t cubeGroup = culler.addDrawGroup(cubeIndexCount, 0, 0, instanceCount);
+		const uint32_t pyramidGroup = culler.addDrawGroup(pyramidIndexCount, cubeIndexCount, pyramidBaseVertex, instanceCount);
+
+		glBindVertexArray(VAO);
+		culler.setupVisibleInstanceAttribute(2);
+		glBindVertexArray(0);
+
+		// a field of small props with low walls hiding the rows right behind them
+		// ---------------------------------------------------------------
+		std::mt19937 generator(42);
+		std::uniform_real_distribution<float> angle(0.f, 360.f);
+		std::uniform_real_distribution<float> scale(0.5f, 1.5f);
+
+		const AABB unitAABB(glm::vec3(0.f), 1.f, 1.f, 1.f);
+		std::vector<GpuInstance> instances;
+		AABBSoA worldAABBs;
+		auto addInstance = [&](uint32_t drawId, const glm::mat4& model)
+		{
+			worldAABBs.pushTransformed(unitAABB, model);
+			GpuInstance instance;
+			instance.model = model;
+			instance.boundsCenter = glm::vec4(worldAABBs.centerX.back(), worldAABBs.centerY.back(), worldAABBs.centerZ.back(), 0.f);
+			instance.boundsExtents = glm::vec4(worldAABBs.extentX.back(), worldAABBs.extentY.back(), worldAABBs.extentZ.back(), 0.f);
+			instance.drawId = drawId;
+			instances.push_back(instance);
+		};
+
+		const float halfGrid = GRID_SIZE * GRID_SPACING * 0.5f;
+		for (unsigned int x = 0; x < GRID_SIZE; ++x)
+		{
+			for (unsigned int z = 0; z < GRID_SIZE; ++z)
+			{
+				glm::mat4 model = glm::translate(glm::mat4(1.0f), { x * GRID_SPACING - halfGrid, 1.f, z * GRID_SPACING - halfGrid * 2.f });
+				model = glm::rotate(model, glm::radians(angle(generator)), glm::vec3(0.f, 1.f, 0.f));
+				model = glm::scale(model, glm::vec3(scale(generator)));
+				addInstance((x + z) % 2 ? cubeGroup : pyramidGroup, model);
+			}
+		}
+		for (unsigned int i = 0; i < GRID_SIZE / 10; ++i)
+		{
+			const glm::mat4 model = glm::scale(glm::translate(glm::mat4(1.0f), { 0.f, 2.f, -40.f * i - 2.f }), { halfGrid, 2.f, 0.5f });
+			addInstance(cubeGroup, model);
+		}
+		culler.setInstances(instances);
+
+		// render target: the depth is a texture so the Hi-Z can be built from it
+		// -----------------------------------------------------------------------
+		unsigned int framebuffer, colorBuffer, depthTexture;
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glGenRenderbuffers(1, &colorBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, SCR_WIDTH, SCR_HEIGHT);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+		glGenTextures(1, &depthTexture);
+		glBindTexture(GL_TEXTURE_2D, depthTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, SCR_WIDTH, SCR_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "Framebuffer not complete!" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		// render loop
+		// -----------
+		int frame = 0;
+		while (!glfwWindowShouldClose(window) && (frameLimit == 0 || frame < frameLimit))
+		{
+			// per-frame time logic
+			// --------------------
+			float currentFrame = glfwGetTime();
+			deltaTime = currentFrame - lastFrame;
+			lastFrame = currentFrame;
+
+			// input
+			// -----
+			processInput(window);
+
+			// view/projection transformations
+			const float aspect = (float)SCR_WIDTH / (float)SCR_HEIGHT;
+			const glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), aspect, Z_NEAR, Z_FAR);
+			const glm::mat4 view = camera.GetViewMatrix();
+			const Frustum camFrustum = createFrustumFromCamera(camera, aspect, glm::radians(camera.Zoom), Z_NEAR, Z_FAR);
+
+			// cull on the GPU: nothing per instance comes back to the CPU
+			culler.cull(camFrustum);
+
+			// render
+			// ------
+			glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+			glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+			glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			shader.use();
+			shader.setMat4("projection", projection);
+			shader.setMat4("view", view);
+			glBindVertexArray(VAO);
+			culler.draw();
+			glBindVertexArray(0);
+
+			// the depth of this frame feeds the occlusion test of the next one
+			culler.buildHiZ(depthTexture, SCR_WIDTH, SCR_HEIGHT, projection * view);
+
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+			glBlitFramebuffer(0, 0, SCR_WIDTH, SCR_HEIGHT, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+			// statistics, reading the counts back stalls so it is only done once in a while
+			if (frame == 0)
+			{
+				// no Hi-Z yet on the first frame, the GPU must agree with the CPU frustum culling
+				std::vector<uint64_t> visibleMask;
+				std::vector<uint32_t> visibleIndices;
+				cullAABBs(camFrustum, worldAABBs, visibleMask);
+				visibleMaskToIndices(visibleMask, visibleIndices);
+
+				const std::vector<uint32_t> counts = culler.readVisibleCounts();
+				const uint32_t gpuVisible = counts[cubeGroup] + counts[pyramidGroup];
+				std::cout << "Frustum culling : GPU " << gpuVisible << " / CPU " << visibleIndices.size() << " visible of " << instanceCount << std::endl;
+				if (gpuVisible != visibleIndices.size())
+					exitCode = EXIT_FAILURE;
+			}
+			else if (frame % 100 == 1)
+			{
+				const std::vector<uint32_t> counts = culler.readVisibleCounts();
+				std::cout << "Frustum + Hi-Z culling : " << counts[cubeGroup] << " cubes, " << counts[pyramidGroup] << " pyramids drawn of "
+					<< instanceCount << " instances (" << 1 / deltaTime << " FPS)" << std::endl;
+			}
+			++frame;
+
+			// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+			// -------------------------------------------------------------------------------
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+		}
+
+		// optional: de-allocate all resources once they've outlived their purpose:
+		// ------------------------------------------------------------------------
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteRenderbuffers(1, &colorBuffer);
+		glDeleteTextures(1, &depthTexture);
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteProgram(shader.ID);
+	}
+
+	// glfw: terminate, clearing all previously allocated GLFW resources.
+	// ------------------------------------------------------------------
+	glfwTerminate();
+	return exitCode;
+}
+
+// createMeshes() puts a unit cube and a unit pyramid in the same buffers, the pyramid right after the cube
+// ---------------------------------------------------------------------------------------------------------
+unsigned int createMeshes(unsigned int& cubeIndexCount, unsigned int& pyramidIndexCount, int& pyramidBaseVertex)
+{
+	std::vector<float> vertices; // position, normal
+	std::vector<unsigned int> indices;
+	auto addFace = [&](const std::vector<glm::vec3>& corners, const glm::vec3& normal, unsigned int baseVertex)
+	{
+		const unsigned int first = static_cast<unsigned int>(vertices.size() / 6) - baseVertex;
+		for (auto&& corner : corners)
+			vertices.insert(vertices.end(), { corner.x, corner.y, corner.z, normal.x, normal.y, normal.z });
+		for (unsigned int i = 1; i + 1 < corners.size(); ++i)
+			indices.insert(indices.end(), { first, first + i, first + i + 1 });
+	};
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		for (float side : { -1.f, 1.f })
+		{
+			glm::vec3 normal(0.f);
+			normal[axis] = side;
+			glm::vec3 u(0.f), v(0.f);
+			u[(axis + 1) % 3] = 1.f;
+			v[(axis + 2) % 3] = side;
+			addFace({ normal - u - v, normal + u - v, normal + u + v, normal - u + v }, normal, 0);
+		}
+	}
+	cubeIndexCount = static_cast<unsigned int>(indices.size());
+
+	// the pyramid indices are relative to its own first vertex
+	pyramidBaseVertex = static_cast<int>(vertices.size() / 6);
+	const glm::vec3 apex(0.f, 1.f, 0.f);
+	const glm::vec3 base[4] = { { -1.f, -1.f, -1.f }, { 1.f, -1.f, -1.f }, { 1.f, -1.f, 1.f }, { -1.f, -1.f, 1.f } };
+	addFace({ base[0], base[1], base[2], base[3] }, { 0.f, -1.f, 0.f }, pyramidBaseVertex);
+	for (int i = 0; i < 4; ++i)
+	{
+		const glm::vec3& a = base[(i + 1) % 4];
+		const glm::vec3& b = base[i];
+		addFace({ a, b, apex }, glm::normalize(glm::cross(b - a, apex - a)), pyramidBaseVertex);
+	}
+	pyramidIndexCount = static_cast<unsigned int>(indices.size()) - cubeIndexCount;
+
+	unsigned int VAO, VBO, EBO;
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &EBO);
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+	glBindVertexArray(0);
+	return VAO;
+}
+
+// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
+// ---------------------------------------------------------------------------------------------------------
+void processInput(GLFWwindow* window)
+{
+	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+		glfwSetWindowShouldClose(window, true);
+
+	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+		camera.ProcessKeyboard(FORWARD, deltaTime);
+	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+		camera.ProcessKeyboard(BACKWARD, deltaTime);
+	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+		camera.ProcessKeyboard(LEFT, deltaTime);
+	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+		camera.ProcessKeyboard(RIGHT, deltaTime);
+}
+
+// glfw: whenever the window size changed (by OS or user resize) this callback function executes
+// ---------------------------------------------------------------------------------------------
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+	// the scene is drawn at a fixed size in the offscreen framebuffer, then scaled to the window
+	windowWidth = width;
+	windowHeight = height;
+}
+
+// glfw: whenever the mouse moves, this callback is called
+// -------------------------------------------------------
+void mouse_callback(GLFWwindow* window, double xpos, double ypos)
+{
+	if (firstMouse)
+	{
+		lastX = xpos;
+		lastY = ypos;
+		firstMouse = false;
+	}
+
+	float xoffset = xpos - lastX;
+	float yoffset = lastY - ypos; // reversed since y-coordinates go from bottom to top
+
+	lastX = xpos;
+	lastY = ypos;
+
+	camera.ProcessMouseMovement(xoffset, yoffset);
+}
+
+// glfw: whenever the mouse scroll wheel scrolls, this callback is called
+// ----------------------------------------------------------------------
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+	camera.ProcessMouseScroll(yoffset);
+}
@@ -0,0 +1,12 @@
+#version 430 core
+out vec4 FragColor;
+
+in vec3 Normal;
+in vec3 Color;
+
+void main()
+{
+	vec3 lightDir = normalize(vec3(0.3, 1.0, 0.5));
+	float diffuse = max(dot(normalize(Normal), lightDir), 0.0);
+	FragColor = vec4(Color * (0.25 + 0.75 * diffuse), 1.0);
+}
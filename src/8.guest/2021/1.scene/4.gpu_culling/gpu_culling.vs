@@ -0,0 +1,30 @@
+#version 430 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in uint aInstance;
+
+struct Instance {
+	mat4 model;
+	vec4 boundsCenter;
+	vec4 boundsExtents;
+	uvec4 drawId;
+};
+
+layout(std430, binding = 0) readonly buffer Instances {
+	Instance instances[];
+};
+
+out vec3 Normal;
+out vec3 Color;
+
+uniform mat4 projection;
+uniform mat4 view;
+
+void main()
+{
+	mat4 model = instances[aInstance].model;
+	Normal = mat3(model) * aNormal;
+	// a stable color per instance makes popping easy to spot
+	Color = vec3(0.4) + 0.6 * fract(vec3(aInstance) * vec3(0.1031, 0.1030, 0.0973));
+	gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
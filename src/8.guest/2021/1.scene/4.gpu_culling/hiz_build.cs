@@ -0,0 +1,49 @@
+#version 430 core
+
+layout (local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+// ----------------------------------------------------------------------------
+//
+// uniforms
+//
+// ----------------------------------------------------------------------------
+
+layout(r32f, binding = 0) writeonly uniform image2D destination;
+
+uniform sampler2D source;       /** Depth texture for the first level, previous Hi-Z level otherwise */
+uniform int sourceLevel;
+uniform ivec2 sourceSize;
+uniform ivec2 destinationSize;
+uniform bool reduce;            /** False to copy the depth buffer in the first level */
+
+// ----------------------------------------------------------------------------
+//
+// functions
+//
+// ----------------------------------------------------------------------------
+
+void main() {
+	ivec2 texelCoord = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(texelCoord, destinationSize)))
+		return;
+
+	if (!reduce) {
+		imageStore(destination, texelCoord, vec4(texelFetch(source, texelCoord, 0).r));
+		return;
+	}
+
+	// keep the farthest depth of the 2x2 footprint, 3 texels wide on the last column or row of an odd source
+	ivec2 first = texelCoord * 2;
+	ivec2 last = first + 1;
+	if (texelCoord.x == destinationSize.x - 1 && (sourceSize.x & 1) == 1)
+		last.x++;
+	if (texelCoord.y == destinationSize.y - 1 && (sourceSize.y & 1) == 1)
+		last.y++;
+	last = min(last, sourceSize - 1);
+
+	float depth = 0.0;
+	for (int y = first.y; y <= last.y; ++y)
+		for (int x = first.x; x <= last.x; ++x)
+			depth = max(depth, texelFetch(source, ivec2(x, y), sourceLevel).r);
+	imageStore(destination, texelCoord, vec4(depth));
+}